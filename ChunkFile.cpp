@@ -0,0 +1,162 @@
+#include "ChunkFile.hpp"
+#include "crc32c.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <future>
+#include <thread>
+
+namespace {
+	//check checksums on several threads once there's enough data to make it worthwhile:
+	constexpr size_t ParallelValidateBytes = 1 << 20;
+}
+
+ChunkFile::ChunkFile(uint8_t const *data_, size_t size_, std::shared_ptr< void const > storage_) : data(data_), size(size_), storage(storage_) {
+	Header const expected;
+	if (size >= 4 && std::memcmp(data, expected.magic, 4) == 0) {
+		if (size < sizeof(Header)) {
+			throw std::runtime_error("Chunk file is too small to hold a header.");
+		}
+		Header header;
+		std::memcpy(&header, data, sizeof(header));
+		if (header.version != Version) {
+			throw std::runtime_error("Chunk file has version " + std::to_string(header.version) + " (expected 1 or 2).");
+		}
+		version = header.version;
+		if (header.header_size < sizeof(Header) || header.file_size > size || header.header_size > header.file_size) {
+			throw std::runtime_error("Chunk file is truncated (or its header is malformed).");
+		}
+		if (header.alignment == 0 || (header.alignment & (header.alignment - 1)) != 0) {
+			throw std::runtime_error("Chunk file has an alignment that isn't a power of two.");
+		}
+		uint64_t toc_size = uint64_t(header.chunk_count) * sizeof(TocEntry);
+		if (toc_size > header.file_size - header.header_size) {
+			throw std::runtime_error("Chunk file's table of contents is outside the file.");
+		}
+		uint8_t const *toc = data + header.header_size;
+		if (crc32c(toc, size_t(toc_size)) != header.toc_crc) {
+			throw std::runtime_error("Chunk file's table of contents doesn't match its checksum.");
+		}
+
+		chunks.reserve(header.chunk_count);
+		for (uint32_t i = 0; i < header.chunk_count; ++i) {
+			TocEntry entry;
+			std::memcpy(&entry, toc + i * sizeof(TocEntry), sizeof(entry));
+			if (entry.offset % header.alignment != 0
+			 || entry.offset < header.header_size + toc_size
+			 || entry.offset > header.file_size
+			 || entry.size > header.file_size - entry.offset) {
+				throw std::runtime_error("Chunk '" + std::string(entry.magic, 4) + "' is outside the file.");
+			}
+			Chunk chunk;
+			chunk.magic = std::string(entry.magic, 4);
+			chunk.version = entry.version;
+			chunk.offset = size_t(entry.offset);
+			chunk.size = size_t(entry.size);
+			chunk.crc = entry.crc;
+			chunks.emplace_back(chunk);
+		}
+		trailing = size - size_t(header.file_size);
+	} else {
+		//version 1: walk the chunk headers:
+		version = 1;
+		size_t offset = 0;
+		while (size - offset >= 8) {
+			uint32_t chunk_size;
+			std::memcpy(&chunk_size, data + offset + 4, 4);
+			if (chunk_size > size - offset - 8) break;
+			Chunk chunk;
+			chunk.magic = std::string(reinterpret_cast< char const * >(data + offset), 4);
+			chunk.offset = offset + 8;
+			chunk.size = chunk_size;
+			chunks.emplace_back(chunk);
+			offset += 8 + chunk_size;
+		}
+		trailing = size - offset;
+	}
+}
+
+ChunkFile::Chunk const *ChunkFile::find(std::string const &magic) const {
+	for (auto const &chunk : chunks) {
+		if (chunk.magic == magic) return &chunk;
+	}
+	return nullptr;
+}
+
+void ChunkFile::validate() const {
+	if (version < 2) return;
+
+	std::vector< uint8_t > matches(chunks.size(), 0);
+	std::atomic< uint32_t > next(0);
+	auto worker = [&]() {
+		for (uint32_t i = next++; i < chunks.size(); i = next++) {
+			matches[i] = (crc32c(data + chunks[i].offset, chunks[i].size) == chunks[i].crc);
+		}
+	};
+
+	size_t total = 0;
+	for (auto const &chunk : chunks) total += chunk.size;
+	uint32_t threads = 1;
+	if (total >= ParallelValidateBytes) {
+		threads = std::max(1u, std::min(std::thread::hardware_concurrency(), uint32_t(chunks.size())));
+	}
+	std::vector< std::future< void > > helpers;
+	for (uint32_t t = 1; t < threads; ++t) {
+		helpers.emplace_back(std::async(std::launch::async, worker));
+	}
+	worker();
+	for (auto &h : helpers) h.get();
+
+	for (uint32_t i = 0; i < chunks.size(); ++i) {
+		if (!matches[i]) {
+			throw std::runtime_error("Chunk '" + chunks[i].magic + "' doesn't match its checksum.");
+		}
+	}
+}
+
+void ChunkFileWriter::add(std::string const &magic, uint8_t const *contents, size_t size, uint32_t version) {
+	if (magic.size() != 4) throw std::runtime_error("Chunk magic '" + magic + "' isn't four characters.");
+	Chunk chunk;
+	chunk.magic = magic;
+	chunk.version = version;
+	chunk.contents.assign(contents, contents + size);
+	chunks.emplace_back(std::move(chunk));
+}
+
+void ChunkFileWriter::write(std::ostream *to_) const {
+	assert(to_);
+	auto &to = *to_;
+
+	ChunkFile::Header header;
+	header.chunk_count = uint32_t(chunks.size());
+
+	//lay out chunks after the table of contents:
+	auto align = [](uint64_t offset) {
+		return (offset + ChunkFile::Alignment - 1) / ChunkFile::Alignment * ChunkFile::Alignment;
+	};
+	std::vector< ChunkFile::TocEntry > toc;
+	uint64_t offset = sizeof(header) + chunks.size() * sizeof(ChunkFile::TocEntry);
+	for (auto const &chunk : chunks) {
+		ChunkFile::TocEntry entry;
+		std::memcpy(entry.magic, chunk.magic.data(), 4);
+		entry.version = chunk.version;
+		entry.offset = align(offset);
+		entry.size = chunk.contents.size();
+		entry.crc = crc32c(chunk.contents.data(), chunk.contents.size());
+		toc.emplace_back(entry);
+		offset = entry.offset + entry.size;
+	}
+	header.file_size = offset;
+	header.toc_crc = crc32c(reinterpret_cast< uint8_t const * >(toc.data()), toc.size() * sizeof(ChunkFile::TocEntry));
+
+	to.write(reinterpret_cast< char const * >(&header), sizeof(header));
+	to.write(reinterpret_cast< char const * >(toc.data()), toc.size() * sizeof(ChunkFile::TocEntry));
+	uint64_t written = sizeof(header) + toc.size() * sizeof(ChunkFile::TocEntry);
+	for (uint32_t i = 0; i < chunks.size(); ++i) {
+		static char const zeros[ChunkFile::Alignment] = {0};
+		to.write(zeros, size_t(toc[i].offset - written));
+		to.write(reinterpret_cast< char const * >(chunks[i].contents.data()), chunks[i].contents.size());
+		written = toc[i].offset + toc[i].size;
+	}
+}
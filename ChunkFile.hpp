@@ -0,0 +1,146 @@
+#pragma once
+
+/*
+ * A ChunkFile reads a chunk-based binary file (e.g., '.pnct', '.scene', '.w')
+ *  in place from memory, finding chunks by their magic numbers.
+ *
+ * Version 1 files are just a sequence of chunks, as written by write_chunk()
+ *  (see read_write_chunk.hpp), so can only be read in order.
+ * Version 2 files start with a header and a table of contents:
+ *
+ * |c|h|n|k| |version| |header_size| |chunk_count| |alignment| |toc_crc| |file_size (8)| (padded to 64 bytes)
+ * chunk_count x |magic| |version| |offset (8)| |size (8)| |crc| |0| (32 bytes each)
+ * chunk contents, each starting at a multiple of 'alignment' (zero padded)
+ *
+ * So loaders can go straight to the chunks they need, skip chunks they don't
+ *  know about, view contents without copying (they're aligned), and check each
+ *  chunk's CRC-32C (see crc32c.hpp) -- in parallel for large files.
+ *
+ * ChunkFile reads both versions, so loaders needn't care which they were given:
+ *
+ * std::shared_ptr< DataFile const > data = vfs_read(filename);
+ * ChunkFile file(data->data, data->size, data);
+ * file.validate(); //throws if a chunk doesn't match its checksum (version 2 only)
+ * ChunkView< glm::vec3 > positions;
+ * file.read("p...", &positions);
+ *
+ * ChunkFileWriter writes version 2 files.
+ *
+ */
+
+#include "read_write_chunk.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+struct ChunkFile {
+	static constexpr uint32_t Version = 2; //newest container version
+	static constexpr uint32_t Alignment = 64; //of chunk contents in files written by ChunkFileWriter
+
+	//parse the header and table of contents (or, for version 1 files, the chunk headers);
+	// throws if they are malformed. 'storage' (if given) keeps [data, data+size) valid:
+	ChunkFile(uint8_t const *data, size_t size, std::shared_ptr< void const > storage = nullptr);
+
+	struct Chunk {
+		std::string magic;
+		uint32_t version = 0; //version of the chunk's contents (always 0 in version 1 files)
+		size_t offset = 0; //start of contents, from the start of the file
+		size_t size = 0; //bytes of contents
+		uint32_t crc = 0; //CRC-32C of contents (version 2 only)
+	};
+
+	//first chunk with the given magic number, or nullptr if there is none:
+	Chunk const *find(std::string const &magic) const;
+
+	//view the contents of the chunk with the given magic number and version:
+	// (throws if there is no such chunk, it has a different version, or its size isn't a multiple of sizeof(T))
+	template< typename T >
+	void read(std::string const &magic, ChunkView< T > *to, uint32_t version = 0) const;
+
+	//as above, but returns false (leaving 'to' empty) if there is no such chunk:
+	template< typename T >
+	bool read_optional(std::string const &magic, ChunkView< T > *to, uint32_t version = 0) const;
+
+	//check every chunk's contents against its checksum, spreading large files over several threads:
+	// throws if any don't match (does nothing for version 1 files, which have no checksums)
+	void validate() const;
+
+	uint32_t version = 0; //container version: 1 or 2
+	std::vector< Chunk > chunks; //in the order they appear in the table of contents (or file)
+	size_t trailing = 0; //bytes after the end of the chunks (version 1: after the last whole chunk)
+
+	uint8_t const *data = nullptr;
+	size_t size = 0;
+	std::shared_ptr< void const > storage;
+
+	//on-disk layout of version 2 files:
+	struct Header {
+		char magic[4] = {'c','h','n','k'};
+		uint32_t version = Version;
+		uint32_t header_size = sizeof(Header); //the table of contents starts here
+		uint32_t chunk_count = 0; //entries in the table of contents
+		uint32_t alignment = Alignment; //chunk contents start at multiples of this (a power of two)
+		uint32_t toc_crc = 0; //CRC-32C of the table of contents
+		uint64_t file_size = 0; //in bytes, to catch truncated files
+		uint8_t reserved[32] = {0};
+	};
+	static_assert(sizeof(Header) == 64, "ChunkFile::Header is packed");
+
+	struct TocEntry {
+		char magic[4] = {'\0', '\0', '\0', '\0'};
+		uint32_t version = 0; //of the chunk's contents
+		uint64_t offset = 0; //start of contents (a multiple of the header's alignment)
+		uint64_t size = 0;
+		uint32_t crc = 0; //CRC-32C of contents
+		uint32_t reserved = 0;
+	};
+	static_assert(sizeof(TocEntry) == 32, "ChunkFile::TocEntry is packed");
+};
+
+//Collects chunks, then writes them as a version 2 chunk file:
+struct ChunkFileWriter {
+	template< typename T >
+	void add(std::string const &magic, std::vector< T > const &contents, uint32_t version = 0) {
+		static_assert(std::is_trivially_copyable< T >::value, "chunk contents are written as raw bytes");
+		add(magic, reinterpret_cast< uint8_t const * >(contents.data()), contents.size() * sizeof(T), version);
+	}
+	void add(std::string const &magic, uint8_t const *contents, size_t size, uint32_t version = 0);
+
+	//write header, table of contents, and (aligned) chunks; check 'to' afterward to see if this failed:
+	void write(std::ostream *to) const;
+
+	struct Chunk {
+		std::string magic;
+		uint32_t version = 0;
+		std::vector< uint8_t > contents;
+	};
+	std::vector< Chunk > chunks;
+};
+
+template< typename T >
+void ChunkFile::read(std::string const &magic, ChunkView< T > *to, uint32_t version) const {
+	if (!read_optional(magic, to, version)) {
+		throw std::runtime_error("Missing '" + magic + "' chunk");
+	}
+}
+
+template< typename T >
+bool ChunkFile::read_optional(std::string const &magic, ChunkView< T > *to, uint32_t version) const {
+	assert(to);
+	*to = ChunkView< T >();
+	Chunk const *chunk = find(magic);
+	if (!chunk) return false;
+	if (chunk->version != version) {
+		throw std::runtime_error("Chunk '" + magic + "' has version " + std::to_string(chunk->version) + " (expected " + std::to_string(version) + ")");
+	}
+	if (chunk->size % sizeof(T) != 0) {
+		throw std::runtime_error("Size of chunk not divisible by element size");
+	}
+	view_chunk(data + chunk->offset, chunk->size, storage, to);
+	return true;
+}
@@ -3,7 +3,8 @@
 #include "gl_compile_program.hpp"
 #include "gl_errors.hpp"
 
-Load< ColorProgram > color_program(LoadTagEarly);
+//(compiled on first use, since only some modes draw lines)
+Load< ColorProgram > color_program(LoadTagLazy);
 
 ColorProgram::ColorProgram() {
 	//Compile vertex and fragment shaders using the convenient 'gl_compile_program' helper function:
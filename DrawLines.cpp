@@ -6,13 +6,13 @@
 
 #include <glm/gtc/type_ptr.hpp>
 
-//All DrawLines instances share a vertex array object and vertex buffer, initialized at load time:
+//All DrawLines instances share a vertex array object and vertex buffer, initialized when the first one is drawn:
 
 //n.b. declared static so they don't conflict with similarly named global variables elsewhere:
 static GLuint vertex_buffer = 0;
 static GLuint vertex_buffer_for_color_program = 0;
 
-static Load< void > setup_buffers(LoadTagDefault, [](){
+static Load< void > setup_buffers(LoadTagLazy, [](){
 	//you may recognize this init code from DrawSprites.cpp:
 
 	{ //set up vertex buffer:
@@ -60,7 +60,7 @@ static Load< void > setup_buffers(LoadTagDefault, [](){
 	}
 
 	GL_ERRORS(); //PARANOIA: make sure nothing strange happened during setup
-});
+}, { color_program });
 
 
 DrawLines::DrawLines(glm::mat4 const &world_to_clip_) : world_to_clip(world_to_clip_) {
@@ -137,6 +137,8 @@ DrawLines::~DrawLines() {
 
 	//based on DrawSprites.cpp :
 
+	setup_buffers.get(); //(sets up the buffers the first time lines are drawn)
+
 	//upload vertices to vertex_buffer:
 	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer); //set vertex_buffer as current
 	glBufferData(GL_ARRAY_BUFFER, attribs.size() * sizeof(attribs[0]), attribs.data(), GL_STREAM_DRAW); //upload attribs array
@@ -0,0 +1,154 @@
+#include "HotReload.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#define HOT_RELOAD_USE_INOTIFY
+#endif
+
+namespace {
+	typedef std::chrono::steady_clock Clock;
+
+	//files are reloaded once they have gone this long without being written:
+	// (exporters may write a file in several steps, or write several files in a row)
+	constexpr double SettleSeconds = 0.1;
+
+	struct Watched {
+		std::vector< void const * > keys; //Load<>s to reload when the file changes
+		bool changed = false;
+		Clock::time_point first_change; //(for reporting latency)
+		Clock::time_point last_change;
+	};
+
+	std::mutex mutex; //protects the values below (watch_key() may be called from worker threads)
+	std::unordered_map< std::string, Watched > files; //by path
+	bool started = false;
+
+#ifdef HOT_RELOAD_USE_INOTIFY
+	int inotify = -1;
+	//inotify watch descriptor -> the prefixes (everything up to and including the last '/', or nothing) of the watched paths in that directory:
+	// (events name files within the directory, so a watched path is found again as prefix + name; several prefixes -- like "" and "./" -- may share a directory)
+	std::unordered_map< int, std::vector< std::string > > directories;
+
+	//watch the directory holding 'path':
+	// (directories are watched, rather than files, since files are often replaced by renaming a new version over them)
+	void watch_directory(std::string const &path) {
+		if (inotify == -1) return;
+		std::string prefix = path.substr(0, path.rfind('/') + 1); //(npos + 1 == 0, so no '/' gives "")
+		for (auto const &watched : directories) {
+			if (std::find(watched.second.begin(), watched.second.end(), prefix) != watched.second.end()) return;
+		}
+		std::string directory = (prefix.empty() ? "." : prefix);
+		int descriptor = inotify_add_watch(inotify, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+		if (descriptor == -1) {
+			std::cerr << "WARNING: can't watch '" << directory << "' for changes (" << std::strerror(errno) << ")." << std::endl;
+			return;
+		}
+		directories[descriptor].emplace_back(prefix);
+	}
+#endif
+}
+
+void HotReload::init() {
+	std::lock_guard< std::mutex > lock(mutex);
+	if (started) return;
+	started = true;
+#ifdef HOT_RELOAD_USE_INOTIFY
+	inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (inotify == -1) {
+		std::cerr << "WARNING: can't watch files for changes (" << std::strerror(errno) << "); hot reloading is off." << std::endl;
+		return;
+	}
+	for (auto const &file : files) {
+		watch_directory(file.first);
+	}
+	std::cout << "Hot reloading: watching " << files.size() << " files in " << directories.size() << " directories." << std::endl;
+#else
+	std::cerr << "WARNING: hot reloading needs inotify (Linux); files won't be watched." << std::endl;
+#endif
+}
+
+void HotReload::shutdown() {
+	std::lock_guard< std::mutex > lock(mutex);
+#ifdef HOT_RELOAD_USE_INOTIFY
+	if (inotify != -1) {
+		close(inotify); //(also removes the watches)
+		inotify = -1;
+	}
+	directories.clear();
+#endif
+	started = false;
+}
+
+void HotReload::watch_key(std::string const &filename, void const *key) {
+	std::lock_guard< std::mutex > lock(mutex);
+	auto &keys = files[filename].keys;
+	if (std::find(keys.begin(), keys.end(), key) != keys.end()) return;
+	keys.emplace_back(key);
+#ifdef HOT_RELOAD_USE_INOTIFY
+	if (started) watch_directory(filename);
+#endif
+}
+
+void HotReload::update() {
+	{
+		std::lock_guard< std::mutex > lock(mutex);
+		auto now = Clock::now();
+
+#ifdef HOT_RELOAD_USE_INOTIFY
+		//note which watched files were written:
+		while (inotify != -1) {
+			alignas(inotify_event) char buffer[4096];
+			ssize_t got = read(inotify, buffer, sizeof(buffer));
+			if (got <= 0) break; //(EAGAIN: no more events)
+			for (char const *at = buffer; at < buffer + got; ) {
+				inotify_event const &event = *reinterpret_cast< inotify_event const * >(at);
+				at += sizeof(inotify_event) + event.len;
+
+				auto mark = [&now](Watched &watched) {
+					if (!watched.changed) watched.first_change = now;
+					watched.changed = true;
+					watched.last_change = now;
+				};
+				if (event.mask & IN_Q_OVERFLOW) {
+					//events were lost, so anything might have changed:
+					for (auto &file : files) mark(file.second);
+					continue;
+				}
+				if (event.len == 0) continue;
+				auto directory = directories.find(event.wd);
+				if (directory == directories.end()) continue;
+				for (std::string const &prefix : directory->second) {
+					auto found = files.find(prefix + event.name);
+					if (found != files.end()) mark(found->second);
+				}
+			}
+		}
+#endif
+
+		//reload files that have stopped changing:
+		for (auto &file : files) {
+			std::string const &path = file.first;
+			Watched &watched = file.second;
+			if (!watched.changed) continue;
+			if (std::chrono::duration< double >(now - watched.last_change).count() < SettleSeconds) continue;
+			watched.changed = false;
+			std::cout << "'" << path << "' changed " << std::fixed << std::setprecision(1) << std::chrono::duration< double, std::milli >(now - watched.first_change).count() << " ms ago; reloading." << std::defaultfloat << std::endl;
+			for (void const *key : watched.keys) {
+				reload_load(key);
+			}
+		}
+	}
+
+	update_reloads();
+}
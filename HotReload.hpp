@@ -0,0 +1,50 @@
+#pragma once
+
+/*
+ * HotReload watches the files that Load<>s were loaded from; when one changes,
+ *  its Load<> is loaded again (along with the Load<>s that list it as a dependency),
+ *  and the new values are swapped in between frames. (see update_reloads() in Load.hpp)
+ *
+ * This is useful for picking up re-exported assets without restarting:
+ *
+ * Load< Scene > level(LoadTagAsync, []() -> Scene const * {
+ *     HotReload::watch(data_path("level.scene"), level);
+ *     return new Scene(data_path("level.scene"), ...);
+ * });
+ *
+ * //in main():
+ * HotReload::init(); //after call_load_functions()
+ * while (...) {
+ *     HotReload::update(); //between frames
+ *     ...
+ * }
+ *
+ * Files are watched with inotify, so this only works on Linux.
+ *
+ */
+
+#include "Load.hpp"
+
+#include <string>
+
+namespace HotReload {
+
+//start watching files (elsewhere than Linux, this just prints a warning):
+void init();
+
+//stop watching files:
+void shutdown();
+
+//reload the Load<> at 'key' whenever 'filename' is written:
+// (may be called from load functions on any thread, before or after init(); calling again with the same arguments does nothing)
+void watch_key(std::string const &filename, void const *key);
+template< typename T >
+void watch(std::string const &filename, Load< T > const &load) {
+	watch_key(filename, &load);
+}
+
+//request reloads for files that have changed, then call update_reloads():
+// (call once per frame, from the main thread, between frames)
+void update();
+
+} //namespace HotReload
@@ -1,20 +1,232 @@
 #include "Load.hpp"
+#include "ThreadPool.hpp"
 
+#include <algorithm>
 #include <array>
 #include <list>
 #include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#ifdef __GNUG__
+#include <cxxabi.h>
+#include <cstdlib>
+#endif
 
 namespace {
-	std::array< std::list< std::function< void() > >, MaxLoadTag > &get_load_lists() {
-		static std::array< std::list< std::function< void() > >, MaxLoadTag > load_lists;
-		return load_lists;
+	typedef std::chrono::high_resolution_clock Clock;
+
+	struct LoadFunction {
+		LoadTag tag;
+		std::function< void() > fn;
+		void const *key = nullptr; //address of the Load<> this function loads (if any)
+		std::vector< LoadDependency > after; //Load<>s that must load first
+		std::string name;
+
+		//progress (read by load_now() to decide whether to call, wait for, or re-throw from this function):
+		enum State {
+			Waiting, //not started
+			Queued, //on the worker pool, not started
+			Running, //being called (by 'thread')
+			Done,
+			Failed, //threw 'error'
+		} state = Waiting;
+		std::thread::id thread;
+		std::exception_ptr error;
+
+		//used while loading (by call_load_functions()):
+		std::vector< LoadFunction * > dependents; //functions waiting on this one
+		uint32_t waiting_on = 0; //dependencies not yet loaded
+		double ready_ms = 0.0; //when the last dependency finished
+		double start_ms = 0.0;
+		double end_ms = 0.0;
+
+		//used while hot reloading (by update_reloads()):
+		std::function< LoadSwapFn() > reload; //calls 'fn' again, returning a function that swaps the new value in
+		std::function< bool() > reload_ready; //is the swapped-in value ready for the functions that list this one? (may be empty)
+		enum ReloadState {
+			NotReloading,
+			ReloadWaiting, //waiting on dependencies being reloaded
+			Reloading, //being called on a worker
+			Reloaded, //called on a worker; 'swap' is waiting to be called by the main thread
+			ReloadSwapped, //swapped in; waiting for 'reload_ready' before releasing the functions that list this one
+			ReloadDone,
+			ReloadFailed, //threw 'reload_error' (the old value is kept)
+			ReloadSkipped, //not called, since a dependency failed to reload
+		} reload_state = NotReloading;
+		uint32_t reload_waiting_on = 0; //dependencies not yet reloaded
+		bool reload_skip = false; //a dependency failed to reload
+		LoadSwapFn swap;
+		LoadDestroyFn replaced; //destroys the value the swap replaced (if it isn't kept)
+		std::exception_ptr reload_error;
+		double reload_ms = 0.0; //time spent calling 'reload'
+	};
+
+	//Shared by call_load_functions() and the lazy loading functions (load_now() and prefetch_load()):
+	struct Loader {
+		std::list< LoadFunction > functions;
+		std::unordered_map< void const *, LoadFunction * > by_key;
+
+		std::mutex mutex; //protects the progress and scheduling fields of the functions
+		std::condition_variable changed; //notified whenever a function finishes or fails
+
+		//hot reloading:
+		std::vector< void const * > reload_requests; //reloads to start once the current ones finish
+		std::vector< LoadFunction * > reloading; //functions being reloaded (in the order they were added)
+		std::vector< LoadDestroyFn > retired; //destroy values replaced by the previous reloads
+		Clock::time_point reload_start;
+
+		//(declared last so its workers are stopped before the above is destroyed)
+		std::unique_ptr< ThreadPool > pool;
+		ThreadPool &get_pool() {
+			if (!pool) pool.reset(new ThreadPool());
+			return *pool;
+		}
+	};
+
+	Loader &get_loader() {
+		static Loader loader;
+		return loader;
+	}
+
+	//readable version of a typeid() name:
+	std::string demangle(char const *name) {
+		std::string ret = name;
+#ifdef __GNUG__
+		int status = 0;
+		char *readable = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+		if (status == 0 && readable) ret = readable;
+		std::free(readable);
+#else
+		//MSVC names are already readable, but start with "struct " or "class ":
+		for (std::string prefix : {"struct ", "class "}) {
+			if (ret.compare(0, prefix.size(), prefix) == 0) ret = ret.substr(prefix.size());
+		}
+#endif
+		return ret;
 	}
 }
 
 void add_load_function(LoadTag tag, std::function< void() > const &fn) {
-	auto &load_lists = get_load_lists();
-	assert(tag < load_lists.size());
-	load_lists[tag].emplace_back(fn);
+	add_load_function(tag, fn, nullptr, {}, "function");
+}
+
+void add_load_function(LoadTag tag, std::function< void() > const &fn, void const *key, std::vector< LoadDependency > const &after, char const *name) {
+	assert(tag < MaxLoadTag);
+	Loader &loader = get_loader();
+	std::lock_guard< std::mutex > lock(loader.mutex);
+	loader.functions.emplace_back();
+	LoadFunction &function = loader.functions.back();
+	function.tag = tag;
+	function.fn = fn;
+	function.key = key;
+	function.after = after;
+	function.name = demangle(name);
+	if (key) loader.by_key[key] = &function;
+}
+
+void add_reload_function(void const *key, std::function< LoadSwapFn() > const &reload_fn, std::function< bool() > const &ready_fn) {
+	Loader &loader = get_loader();
+	std::lock_guard< std::mutex > lock(loader.mutex);
+	auto found = loader.by_key.find(key);
+	assert(found != loader.by_key.end() && "reload functions are added after their load functions");
+	found->second->reload = reload_fn;
+	found->second->reload_ready = ready_fn;
+}
+
+//call lazy function 'f' on this thread (call with 'lock' held on loader.mutex; returns with it held):
+static void call_lazy(Loader &loader, LoadFunction &f, std::unique_lock< std::mutex > &lock, char const *how) {
+	f.state = LoadFunction::Running;
+	f.thread = std::this_thread::get_id();
+	lock.unlock();
+
+	std::exception_ptr thrown;
+	double ms = 0.0;
+	try {
+		for (LoadDependency const &dependency : f.after) {
+			load_now(dependency.key);
+		}
+		auto start = Clock::now();
+		f.fn();
+		ms = std::chrono::duration< double, std::milli >(Clock::now() - start).count();
+	} catch (...) {
+		thrown = std::current_exception();
+	}
+
+	lock.lock();
+	if (thrown) {
+		f.state = LoadFunction::Failed;
+		f.error = thrown;
+	} else {
+		f.state = LoadFunction::Done;
+		std::cout << "Loaded " << f.name << " " << how << " (" << ms << " ms)." << std::endl;
+	}
+	loader.changed.notify_all();
+}
+
+void load_now(void const *key) {
+	Loader &loader = get_loader();
+	std::unique_lock< std::mutex > lock(loader.mutex);
+
+	auto found = loader.by_key.find(key);
+	if (found == loader.by_key.end()) {
+		throw std::runtime_error("A Load<> was used before it was constructed (is it used by a global's constructor?).");
+	}
+	LoadFunction &f = *found->second;
+
+	while (true) {
+		if (f.state == LoadFunction::Done) {
+			return;
+		} else if (f.state == LoadFunction::Failed) {
+			std::rethrow_exception(f.error);
+		} else if (f.state == LoadFunction::Running) {
+			if (f.thread == std::this_thread::get_id()) {
+				throw std::runtime_error("Load< " + f.name + " > was used by its own loading function (there is a cycle).");
+			}
+			loader.changed.wait(lock);
+		} else if (f.tag == LoadTagLazy) {
+			//not started (or only queued by prefetch_load() -- the worker will skip it), so call it here:
+			call_lazy(loader, f, lock, "on first use");
+		} else if (f.state == LoadFunction::Queued) {
+			//(async functions are called by their worker, which will notify when done)
+			loader.changed.wait(lock);
+		} else {
+			throw std::runtime_error("Load< " + f.name + " > was used before it was loaded (should it be listed as a dependency?).");
+		}
+	}
+}
+
+void prefetch_load(void const *key) {
+	Loader &loader = get_loader();
+	std::unique_lock< std::mutex > lock(loader.mutex);
+
+	auto found = loader.by_key.find(key);
+	if (found == loader.by_key.end()) return;
+	LoadFunction &f = *found->second;
+	if (f.tag != LoadTagLazy || f.state != LoadFunction::Waiting) return;
+
+	//(only worth starting if it won't immediately fail waiting on something call_load_functions() hasn't loaded)
+	for (LoadDependency const &dependency : f.after) {
+		auto dep = loader.by_key.find(dependency.key);
+		if (dep == loader.by_key.end()) return;
+		if (dep->second->tag != LoadTagLazy && dep->second->state != LoadFunction::Done) return;
+	}
+
+	f.state = LoadFunction::Queued;
+	loader.get_pool().run([&loader,fn=&f](){
+		std::unique_lock< std::mutex > lock(loader.mutex);
+		if (fn->state != LoadFunction::Queued) return; //(already called by its first user)
+		call_lazy(loader, *fn, lock, "in the background");
+	});
 }
 
 void call_load_functions() {
@@ -22,11 +234,418 @@ void call_load_functions() {
 	assert(!has_been_called && "call_load_functions should only be called *once*");
 	has_been_called = true;
 
-	auto &load_lists = get_load_lists();
-	for (auto &fn_list : load_lists) {
-		while (!fn_list.empty()) {
-			(*fn_list.begin())(); //call first function in the list
-			fn_list.pop_front(); //remove from list
+	auto load_start = Clock::now();
+	auto ms_since_start = [&load_start]() {
+		return std::chrono::duration< double, std::milli >(Clock::now() - load_start).count();
+	};
+
+	Loader &loader = get_loader();
+	auto &load_functions = loader.functions;
+	auto &by_key = loader.by_key;
+	std::unique_lock< std::mutex > lock(loader.mutex);
+
+	//name functions with the same type apart, in the order they were added:
+	{
+		std::unordered_map< std::string, uint32_t > counts;
+		for (auto &f : load_functions) counts[f.name] += 1;
+		std::unordered_map< std::string, uint32_t > seen;
+		for (auto &f : load_functions) {
+			if (counts[f.name] > 1) f.name += " #" + std::to_string(++seen[f.name]);
+		}
+	}
+
+	//connect dependencies:
+	// (lazy functions load their own dependencies when first used, and functions that list a lazy one load it when they use it)
+	for (auto &f : load_functions) {
+		for (LoadDependency const &dependency : f.after) {
+			auto found = by_key.find(dependency.key);
+			if (found == by_key.end()) {
+				throw std::runtime_error("Load< " + f.name + " > depends on a Load<> that was never constructed.");
+			}
+			if (f.tag == LoadTagLazy || found->second->tag == LoadTagLazy) continue;
+			found->second->dependents.emplace_back(&f);
+			f.waiting_on += 1;
+		}
+	}
+
+	//(scheduling fields below are protected by loader.mutex, like those of the functions)
+	uint32_t running = 0; //functions queued or running on workers
+	std::exception_ptr error; //first exception thrown by a function
+	double worker_ms = 0.0; //total time spent in functions on workers
+	bool used_pool = false;
+
+	//queue a ready async function on the worker pool (call with 'lock' locked):
+	std::function< void(LoadFunction &) > start_async;
+	//note that a function has finished, and queue any async functions that were waiting only on it (call with 'lock' locked):
+	auto finish = [&](LoadFunction &f) {
+		f.state = LoadFunction::Done;
+		f.end_ms = ms_since_start();
+		loader.changed.notify_all();
+		for (LoadFunction *d : f.dependents) {
+			assert(d->waiting_on > 0);
+			d->waiting_on -= 1;
+			if (d->waiting_on == 0) {
+				d->ready_ms = f.end_ms;
+				if (d->tag == LoadTagAsync && !error) start_async(*d);
+			}
+		}
+	};
+	//mark a function as failed, so anything waiting on it in load_now() re-throws (call with 'lock' locked):
+	auto failed = [&](LoadFunction &f, std::exception_ptr thrown) {
+		f.state = LoadFunction::Failed;
+		f.error = thrown;
+		if (!error) error = thrown;
+		loader.changed.notify_all();
+	};
+	start_async = [&](LoadFunction &f) {
+		used_pool = true;
+		running += 1;
+		f.state = LoadFunction::Queued;
+		loader.get_pool().run([&,fn=&f](){
+			{
+				std::lock_guard< std::mutex > lock(loader.mutex);
+				fn->state = LoadFunction::Running;
+				fn->thread = std::this_thread::get_id();
+			}
+			double start = ms_since_start();
+			std::exception_ptr thrown;
+			try {
+				fn->fn();
+			} catch (...) {
+				thrown = std::current_exception();
+			}
+			std::lock_guard< std::mutex > lock(loader.mutex);
+			fn->start_ms = start;
+			running -= 1;
+			if (thrown) {
+				failed(*fn, thrown);
+			} else {
+				finish(*fn);
+				worker_ms += fn->end_ms - fn->start_ms;
+			}
+			loader.changed.notify_all();
+		});
+	};
+
+	//on failure, let running functions finish (they refer to the values above) and start no more, then throw:
+	// (call with 'lock' locked)
+	auto fail = [&](std::exception_ptr thrown) {
+		if (!error) error = thrown;
+		while (running > 0) loader.changed.wait(lock);
+		std::rethrow_exception(thrown);
+	};
+
+	//start async functions first, so they run while the rest are called:
+	for (auto &f : load_functions) {
+		if (f.tag == LoadTagAsync && f.waiting_on == 0) start_async(f);
+	}
+
+	//throws if nothing else can make progress (call with 'lock' locked, and nothing running):
+	auto throw_stuck = [&]() {
+		std::string names;
+		for (auto const &f : load_functions) {
+			if (f.tag != LoadTagLazy && f.state != LoadFunction::Done) names += (names.empty() ? "" : ", ") + f.name;
 		}
+		fail(std::make_exception_ptr(std::runtime_error("Load<> dependencies can't be satisfied (there is a cycle); still waiting: " + names + ".")));
+	};
+
+	//call the main-thread functions, tag by tag:
+	std::array< double, MaxLoadTag > tag_ms;
+	tag_ms.fill(0.0);
+	double main_ms = 0.0; //time spent calling functions on the main thread
+	double idle_ms = 0.0; //time the main thread spent waiting for workers
+	for (uint32_t tag = 0; tag < MaxLoadTag; ++tag) {
+		if (tag == LoadTagAsync || tag == LoadTagLazy) continue;
+		std::list< LoadFunction * > todo;
+		for (auto &f : load_functions) {
+			if (f.tag == tag) todo.emplace_back(&f);
+		}
+		while (!todo.empty()) {
+			if (error) fail(error);
+			//call the first function whose dependencies have loaded:
+			auto ready = std::find_if(todo.begin(), todo.end(), [](LoadFunction const *f){ return f->waiting_on == 0; });
+			if (ready != todo.end()) {
+				LoadFunction &f = **ready;
+				todo.erase(ready);
+				f.state = LoadFunction::Running;
+				f.thread = std::this_thread::get_id();
+				lock.unlock();
+				f.start_ms = ms_since_start();
+				std::exception_ptr thrown;
+				try {
+					f.fn();
+				} catch (...) {
+					thrown = std::current_exception();
+				}
+				lock.lock();
+				if (thrown) {
+					failed(f, thrown);
+					fail(thrown);
+				}
+				finish(f);
+				main_ms += f.end_ms - f.start_ms;
+				tag_ms[tag] += f.end_ms - f.start_ms;
+				continue;
+			}
+			//...or wait for workers to finish something:
+			if (running == 0) throw_stuck();
+			double wait_start = ms_since_start();
+			loader.changed.wait(lock);
+			idle_ms += ms_since_start() - wait_start;
+		}
+	}
+
+	//wait for async functions (re-throwing any exceptions):
+	double wait_start = ms_since_start();
+	while (running > 0 && !error) {
+		loader.changed.wait(lock);
+	}
+	if (error) fail(error);
+	for (auto const &f : load_functions) {
+		if (f.tag != LoadTagLazy && f.state != LoadFunction::Done) throw_stuck();
+	}
+	idle_ms += ms_since_start() - wait_start;
+
+	std::cout << "Loading took " << ms_since_start() << " ms"
+		<< " (main thread: " << main_ms << " ms loading -- early: " << tag_ms[LoadTagEarly] << " ms, default: " << tag_ms[LoadTagDefault] << " ms, late: " << tag_ms[LoadTagLate] << " ms --"
+		<< " and " << idle_ms << " ms waiting for workers";
+	if (used_pool) {
+		std::cout << "; " << worker_ms << " ms of work on " << loader.pool->size() << " worker threads";
+	}
+	std::cout << "):" << std::endl;
+
+	//breakdown, in the order the functions started:
+	std::vector< LoadFunction const * > order;
+	uint32_t unused = 0; //lazy functions not called yet
+	for (auto const &f : load_functions) {
+		if (f.tag != LoadTagLazy) order.emplace_back(&f);
+		else if (f.state == LoadFunction::Waiting) unused += 1;
+	}
+	std::stable_sort(order.begin(), order.end(), [](LoadFunction const *a, LoadFunction const *b){ return a->start_ms < b->start_ms; });
+	std::cout << "    start      ms  thread  (waited)  load" << std::endl;
+	for (LoadFunction const *f : order) {
+		std::cout << std::fixed << std::setprecision(1)
+			<< "  " << std::setw(7) << f->start_ms << " " << std::setw(7) << (f->end_ms - f->start_ms)
+			<< "  " << (f->tag == LoadTagAsync ? "worker" : "main  ")
+			<< "  " << std::setw(8) << (f->start_ms - f->ready_ms)
+			<< "  " << f->name;
+		if (!f->after.empty()) {
+			std::cout << " (after";
+			for (LoadDependency const &d : f->after) std::cout << " " << by_key[d.key]->name;
+			std::cout << ")";
+		}
+		std::cout << std::defaultfloat << std::endl;
+	}
+	if (unused) {
+		std::cout << "  (and " << unused << " lazy loads, to be called on first use)" << std::endl;
+	}
+	//(functions are kept, since lazy ones are called later and load_now() checks the others)
+}
+
+//------------------------------------------------
+
+void reload_load(void const *key) {
+	Loader &loader = get_loader();
+	std::lock_guard< std::mutex > lock(loader.mutex);
+	loader.reload_requests.emplace_back(key);
+}
+
+void update_reloads() {
+	Loader &loader = get_loader();
+	std::unique_lock< std::mutex > lock(loader.mutex);
+
+	auto lists = [](LoadFunction const *f, LoadFunction const *dependency) {
+		for (LoadDependency const &d : f->after) {
+			if (d.key == dependency->key) return true;
+		}
+		return false;
+	};
+
+	//start the requested reloads once the previous ones have finished:
+	if (loader.reloading.empty() && !loader.reload_requests.empty()) {
+		//values replaced by the previous reloads can't be reached any more (code using them has had at least a frame to look things up again):
+		// (destroyed without the lock held, since destructors may use other Load<>s)
+		std::vector< LoadDestroyFn > retired;
+		retired.swap(loader.retired);
+		lock.unlock();
+		for (auto &destroy : retired) {
+			destroy();
+		}
+		retired.clear();
+		lock.lock();
+
+		//everything requested, and everything that lists something that will be reloaded:
+		// (skipping functions that haven't been called -- like unused lazy loads -- since they will load the new data anyway)
+		std::vector< LoadFunction * > todo;
+		for (void const *key : loader.reload_requests) {
+			auto found = loader.by_key.find(key);
+			if (found != loader.by_key.end()) todo.emplace_back(found->second);
+		}
+		loader.reload_requests.clear();
+		while (!todo.empty()) {
+			LoadFunction *f = todo.back();
+			todo.pop_back();
+			if (f->reload_state != LoadFunction::NotReloading || f->state != LoadFunction::Done || !f->reload) continue;
+			f->reload_state = LoadFunction::ReloadWaiting;
+			for (auto &g : loader.functions) {
+				if (lists(&g, f)) todo.emplace_back(&g);
+			}
+		}
+		for (auto &f : loader.functions) {
+			if (f.reload_state != LoadFunction::ReloadWaiting) continue;
+			loader.reloading.emplace_back(&f);
+			f.reload_waiting_on = 0;
+			f.reload_skip = false;
+			f.reload_error = nullptr;
+			f.replaced = nullptr;
+			f.reload_ms = 0.0;
+		}
+		for (LoadFunction *f : loader.reloading) {
+			for (LoadFunction *g : loader.reloading) {
+				if (lists(g, f)) g->reload_waiting_on += 1;
+			}
+		}
+		loader.reload_start = Clock::now();
+	}
+
+	if (loader.reloading.empty()) return;
+
+	//note that 'f' is finished, so functions that list it can go ahead (or be skipped, if it failed):
+	auto release = [&](LoadFunction *f, bool ok) {
+		for (LoadFunction *g : loader.reloading) {
+			if (!lists(g, f)) continue;
+			assert(g->reload_waiting_on > 0);
+			g->reload_waiting_on -= 1;
+			if (!ok) g->reload_skip = true;
+		}
+	};
+
+	//note that 'f' has its new value, releasing the functions that list it once that value is ready:
+	// (e.g., a MeshBuffer loaded with MeshBuffer::Async isn't ready until upload_pending() has uploaded all of it,
+	//  which happens between calls to this function, so functions that list it are started by a later call)
+	auto swapped = [&](LoadFunction *f) {
+		if (f->reload_ready && !f->reload_ready()) {
+			f->reload_state = LoadFunction::ReloadSwapped;
+		} else {
+			f->reload_state = LoadFunction::ReloadDone;
+			release(f, true);
+		}
+	};
+
+	//swap in values from workers and start whatever is ready, until nothing changes:
+	bool progress = true;
+	while (progress) {
+		progress = false;
+		for (LoadFunction *f : loader.reloading) {
+			if (f->reload_state == LoadFunction::Reloaded) {
+				if (f->swap) f->replaced = f->swap();
+				f->swap = nullptr;
+				swapped(f);
+				progress = true;
+			} else if (f->reload_state == LoadFunction::ReloadSwapped) {
+				if (f->reload_ready()) {
+					f->reload_state = LoadFunction::ReloadDone;
+					release(f, true);
+					progress = true;
+				}
+			} else if (f->reload_state == LoadFunction::ReloadWaiting && f->reload_waiting_on == 0) {
+				progress = true;
+				if (f->reload_skip) {
+					f->reload_state = LoadFunction::ReloadSkipped;
+					release(f, false);
+				} else if (f->tag == LoadTagAsync) {
+					f->reload_state = LoadFunction::Reloading;
+					loader.get_pool().run([&loader,f](){
+						auto start = Clock::now();
+						LoadSwapFn swap;
+						std::exception_ptr thrown;
+						try {
+							swap = f->reload();
+						} catch (...) {
+							thrown = std::current_exception();
+						}
+						double ms = std::chrono::duration< double, std::milli >(Clock::now() - start).count();
+						std::lock_guard< std::mutex > lock(loader.mutex);
+						f->swap = swap;
+						f->reload_error = thrown;
+						f->reload_ms = ms;
+						f->reload_state = (thrown ? LoadFunction::ReloadFailed : LoadFunction::Reloaded);
+					});
+				} else {
+					//(other functions may need OpenGL, so are called here; their values are swapped in right away)
+					lock.unlock();
+					auto start = Clock::now();
+					LoadSwapFn swap;
+					std::exception_ptr thrown;
+					try {
+						swap = f->reload();
+					} catch (...) {
+						thrown = std::current_exception();
+					}
+					f->reload_ms = std::chrono::duration< double, std::milli >(Clock::now() - start).count();
+					lock.lock();
+					if (thrown) {
+						f->reload_error = thrown;
+						f->reload_state = LoadFunction::ReloadFailed;
+					} else {
+						if (swap) f->replaced = swap();
+						swapped(f);
+					}
+				}
+			} else if (f->reload_state == LoadFunction::ReloadFailed && f->reload_error) {
+				std::string what = "unknown exception";
+				try {
+					std::rethrow_exception(f->reload_error);
+				} catch (std::exception &e) {
+					what = e.what();
+				} catch (...) {
+				}
+				std::cerr << "WARNING: reloading " << f->name << " failed (" << what << "); keeping the old version." << std::endl;
+				f->reload_error = nullptr;
+				release(f, false);
+				progress = true;
+			}
+		}
+	}
+
+	//report once everything has finished:
+	for (LoadFunction const *f : loader.reloading) {
+		if (f->reload_state == LoadFunction::ReloadWaiting || f->reload_state == LoadFunction::Reloading || f->reload_state == LoadFunction::Reloaded || f->reload_state == LoadFunction::ReloadSwapped) return;
+	}
+	//queue replaced values to be destroyed when the next reload starts:
+	// (unless something that lists them failed to reload, and so still has an old value that may use them)
+	uint32_t kept = 0;
+	for (LoadFunction *f : loader.reloading) {
+		if (!f->replaced) continue;
+		bool used = false;
+		for (LoadFunction *g : loader.reloading) {
+			if (lists(g, f) && g->reload_state != LoadFunction::ReloadDone) used = true;
+		}
+		if (used) kept += 1;
+		else loader.retired.emplace_back(f->replaced);
+		f->replaced = nullptr;
+	}
+
+	std::string reloaded, skipped;
+	for (LoadFunction *f : loader.reloading) {
+		if (f->reload_state == LoadFunction::ReloadDone) {
+			std::ostringstream info;
+			info << f->name << " (" << std::fixed << std::setprecision(1) << f->reload_ms << " ms" << (f->tag == LoadTagAsync ? " on a worker" : "") << ")";
+			reloaded += (reloaded.empty() ? "" : ", ") + info.str();
+		} else if (f->reload_state == LoadFunction::ReloadSkipped) {
+			skipped += (skipped.empty() ? "" : ", ") + f->name;
+		}
+		f->reload_state = LoadFunction::NotReloading;
+	}
+	loader.reloading.clear();
+	if (!reloaded.empty()) {
+		std::cout << "Reloaded " << reloaded << "; " << std::fixed << std::setprecision(1)
+			<< std::chrono::duration< double, std::milli >(Clock::now() - loader.reload_start).count() << " ms from request to swap." << std::defaultfloat << std::endl;
+	}
+	if (!skipped.empty()) {
+		std::cerr << "WARNING: didn't reload " << skipped << ", since something they use failed to reload." << std::endl;
+	}
+	if (kept) {
+		std::cerr << "WARNING: keeping " << kept << " replaced value(s) for good, since something that uses them failed to reload." << std::endl;
 	}
 }
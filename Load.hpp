@@ -6,9 +6,9 @@
  * This is useful for global-scope resources that need an OpenGL context:
  *
  * //at global scope:
- * Load< Mesh > main_mesh([]() -> const Mesh * {
- *     return &Meshes.get("Main");
- * });
+ * Load< Mesh > main_mesh(LoadTagDefault, []() -> const Mesh * {
+ *     return &main_meshes->lookup("Main");
+ * }, { main_meshes }, LoadKeepReplaced); //(the Mesh belongs to main_meshes, so a reload mustn't delete it)
  *
  * //later:
  * void GameMode::draw() {
@@ -20,27 +20,123 @@
  * These functions are grouped by 'tags', which allow some sequencing of calls.
  * (particularly, this is useful for loading large data blobs [e.g. Meshes] before looking up individual elements within them.)
  *
+ * Functions tagged LoadTagAsync are different: they are run on a pool of worker
+ *  threads, concurrently with each other and with the other tags' functions.
+ * (call_load_functions() waits for them all before returning, so they are still loaded before first use.)
+ * This is useful for slow loads that don't need OpenGL, like decoding sounds:
+ *
+ * Load< Sound::Sample > music(LoadTagAsync, []() -> Sound::Sample const * {
+ *     return new Sound::Sample(data_path("music.opus"));
+ * });
+ *
+ * A Load<> may also list the other Load<>s its function uses; it is only called once those
+ *  have loaded. This lets work that reads other Load<>s (but doesn't need OpenGL) run on the
+ *  worker threads too:
+ *
+ * Load< Scene > level(LoadTagAsync, []() -> Scene const * {
+ *     return new Scene(data_path("level.scene"), [](...){ ... level_meshes->lookup(...) ... });
+ * }, { level_meshes, lit_color_texture_program });
+ *
+ * Functions with other tags still run on the main thread, tag by tag (so they may use
+ *  OpenGL and anything loaded by an earlier tag); within a tag, a function waiting on a
+ *  dependency lets the ones after it go first.
+ * (a Load<> listed as a dependency must have been constructed -- i.e., be linked in -- by the
+ *  time call_load_functions() runs; cycles, and dependencies that can never run, throw)
+ *
+ * Functions tagged LoadTagLazy aren't called by call_load_functions() at all; instead, they are
+ *  called (on whatever thread asks, after their own dependencies) the first time the Load<> is used.
+ * This is useful for resources that some programs (or modes) never touch, like the shader used
+ *  to draw debug lines:
+ *
+ * Load< ColorProgram > color_program(LoadTagLazy);
+ *
+ * A lazy Load<> that doesn't need OpenGL can be asked to start loading on a worker thread
+ *  before it is needed with prefetch(); using it then waits for that to finish.
+ * (Load<>s listing a lazy Load<> as a dependency don't wait for it; they load it when they use it.)
+ *
  */
 
+#include <atomic>
 #include <functional>
+#include <initializer_list>
 #include <stdexcept>
+#include <typeinfo>
+#include <vector>
 
 enum LoadTag : uint32_t {
 	LoadTagEarly,
 	LoadTagDefault,
 	LoadTagLate,
+	LoadTagAsync, //<-- run on worker threads, alongside the other tags
+	LoadTagLazy, //<-- run on first use (see above)
 	MaxLoadTag //<-- just used to track # of load tags
 };
 
+//What hot reloading does with the value a reload replaces (see update_reloads()):
+enum LoadReplaced : uint32_t {
+	LoadDeleteReplaced, //delete it once nothing can use it -- for load functions that return a value they 'new'
+	LoadKeepReplaced, //keep it forever -- for load functions that return something they don't own
+};
+
+template< typename T >
+struct Load;
+
+//Names a Load<> that another Load<> uses (see above):
+struct LoadDependency {
+	template< typename T >
+	LoadDependency(Load< T > const &load) : key(&load) { }
+	void const *key;
+};
+
 //Add a function to an internal list of loading functions:
 // (only call *before* "call_load_functions()")
 void add_load_function(LoadTag tag, std::function< void() > const &fn);
 
-//Call all loading functions:
+//...optionally identified by 'key' (the address of its Load<>, so others can depend on it),
+// only called after the functions of the Load<>s in 'after', and named 'name' (a type name, from typeid) when timings are printed:
+void add_load_function(LoadTag tag, std::function< void() > const &fn, void const *key, std::vector< LoadDependency > const &after, char const *name);
+
+//Call all loading functions (and print how long they took, along with a breakdown by function):
 // (loading functions may throw exceptions if they fail.)
 // (only call *once*)
 void call_load_functions();
 
+//Used by Load<> (see below):
+//make sure the function of the Load<> at 'key' has been called -- calling it now if it is lazy, or waiting if it is running elsewhere:
+// (re-throws the exception if the function failed)
+void load_now(void const *key);
+//start calling the function of the lazy Load<> at 'key' on a worker thread, if it hasn't started already:
+void prefetch_load(void const *key);
+//used to load the Load<> at 'key' again: calls the load function and returns a function that swaps the new value in,
+// which returns a function that destroys the value it replaced (or nullptr, if that value is kept):
+// (if given, 'ready_fn' is polled on the main thread after the swap; Load<>s that list this one aren't reloaded until it returns true)
+typedef std::function< void() > LoadDestroyFn;
+typedef std::function< LoadDestroyFn() > LoadSwapFn;
+void add_reload_function(void const *key, std::function< LoadSwapFn() > const &reload_fn, std::function< bool() > const &ready_fn = nullptr);
+
+//Used by Load<> to decide whether a reloaded value is ready for the Load<>s that list it:
+// values with a 'bool ready() const' member (like a MeshBuffer, whose vertex data is uploaded over several frames) are ready once it returns true;
+// anything else is ready right away.
+template< typename T >
+auto load_value_ready(T const &value, int) -> decltype(bool(value.ready())) { return value.ready(); }
+template< typename T >
+bool load_value_ready(T const &, long) { return true; }
+
+//Hot reloading (see HotReload.hpp for the file watcher that uses this):
+//ask for the Load<> at 'key' to be loaded again -- along with every Load<> that lists it as a dependency (and so on):
+// (may be called from any thread; takes effect in update_reloads())
+void reload_load(void const *key);
+
+//start requested reloads and swap in the values of any that have finished:
+// (call once per frame, from the main thread, between frames)
+// (LoadTagAsync functions are called again on worker threads, and others on this thread;
+//  a Load<> is only reloaded once the Load<>s it lists have their new values, and those values are ready -- e.g., uploaded)
+//Replaced values are deleted (unless their Load<> was constructed with LoadKeepReplaced) on the main thread when
+// the next reload starts, so code that keeps pointers into a Load<>'s value should compare get() with the value
+// it saw last and look things up again when it changes (e.g., at the start of its next update).
+// (a replaced value is kept forever if a Load<> that lists it fails to reload, since that Load<>'s old value may still use it)
+void update_reloads();
+
 
 //work-around for MSVC not accepting this as a lambda:
 template< typename T >
@@ -49,22 +145,52 @@ T const *new_T() { return new T; }
 template< typename T >
 struct Load {
 	//Constructing a Load< T > adds the passed function to the list of functions to call:
-	Load(LoadTag tag, const std::function< T const *() > &load_fn = new_T< T >) : value(nullptr) {
+	// (it will be called after the functions of the Load<>s listed in 'after'; 'replaced' says what hot reloading does with old values)
+	// note: a load function that returns a pointer it doesn't own (rather than one it made with 'new') must pass LoadKeepReplaced
+	Load(LoadTag tag, const std::function< T const *() > &load_fn = new_T< T >, std::initializer_list< LoadDependency > after = {}, LoadReplaced replaced = LoadDeleteReplaced) : value(nullptr) {
 		add_load_function(tag, [this,load_fn](){
 			this->value = load_fn();
 			if (!(this->value)) {
 				throw std::runtime_error("Loading failed.");
 			}
+			loaded.store(true, std::memory_order_release);
+		}, this, after, typeid(T).name());
+		add_reload_function(this, [this,load_fn,replaced]() -> LoadSwapFn {
+			T const *next = load_fn();
+			if (!next) {
+				throw std::runtime_error("Loading failed.");
+			}
+			return [this,next,replaced]() -> LoadDestroyFn {
+				T const *old = this->value;
+				this->value = next;
+				if (replaced == LoadKeepReplaced || old == next) return nullptr;
+				return [old](){ delete old; };
+			};
+		}, [this]() -> bool {
+			return load_value_ready(*this->value, 0);
 		});
 	}
 
+	//The loaded value (loading it first, if it is lazy and this is its first use):
+	T const *get() const {
+		if (!loaded.load(std::memory_order_acquire)) load_now(this);
+		return value;
+	}
+
+	//Hint that a lazy Load<> will be used soon, so it can start loading on a worker thread:
+	// (only for functions that don't use OpenGL)
+	void prefetch() const {
+		if (!loaded.load(std::memory_order_acquire)) prefetch_load(this);
+	}
+
 	//Make a "Load< T >" behave like a "T const *":
-	explicit operator bool() { return value != nullptr; }
-	operator T const *() { return value; }
-	T const &operator*() { return *value; }
-	T const *operator->() { return value; }
+	explicit operator bool() { return get() != nullptr; }
+	operator T const *() { return get(); }
+	T const &operator*() { return *get(); }
+	T const *operator->() { return get(); }
 
 	T const *value;
+	std::atomic< bool > loaded{false}; //set once 'value' is valid
 };
 
 
@@ -73,9 +199,23 @@ struct Load {
 template< >
 struct Load< void > {
 	//Constructing a Load< T > adds the passed function to the list of functions to call:
-	Load( LoadTag tag, const std::function< void() > &load_fn) {
-		add_load_function(tag, load_fn);
+	Load( LoadTag tag, const std::function< void() > &load_fn, std::initializer_list< LoadDependency > after = {}) {
+		add_load_function(tag, [this,load_fn](){
+			load_fn();
+			loaded.store(true, std::memory_order_release);
+		}, this, after, "void");
+		add_reload_function(this, [load_fn]() -> LoadSwapFn {
+			load_fn();
+			return nullptr;
+		});
+	}
+
+	//Make sure the function has been called (calling it now, if it is lazy):
+	void get() const {
+		if (!loaded.load(std::memory_order_acquire)) load_now(this);
 	}
+
+	std::atomic< bool > loaded{false};
 };
 
 
@@ -0,0 +1,29 @@
+#pragma once
+
+/*
+ * A MappedFile is a read-only view of a whole file's contents, memory-mapped
+ *  so that the operating system pages data in as it is used (and can share
+ *  those pages between processes) instead of copying it into a buffer.
+ *
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+struct MappedFile {
+	//map the file; will throw if the file can't be opened or mapped:
+	MappedFile(std::string const &filename);
+	~MappedFile();
+
+	MappedFile(MappedFile const &) = delete;
+	MappedFile &operator=(MappedFile const &) = delete;
+
+	//file contents (stays valid for the lifetime of the MappedFile):
+	// (data is nullptr for empty files)
+	uint8_t const *data = nullptr;
+	size_t size = 0;
+
+	//internals:
+	void *mapping = nullptr; //(Windows file mapping handle; unused elsewhere)
+};
@@ -1,23 +1,30 @@
 #include "Mesh.hpp"
-#include "read_write_chunk.hpp"
+#include "ChunkFile.hpp"
+#include "vfs.hpp"
 
 #include <glm/glm.hpp>
 
 #include <stdexcept>
-#include <fstream>
 #include <iostream>
 #include <vector>
 #include <string>
 #include <set>
+#include <list>
+#include <future>
+#include <chrono>
+#include <algorithm>
 #include <cstddef>
+#include <atomic>
+#include <thread>
+#include <cmath>
 
-MeshBuffer::MeshBuffer(std::string const &filename) {
-	glGenBuffers(1, &buffer);
-
-	std::ifstream file(filename, std::ios::binary);
-
-	GLuint total = 0;
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MESH_USE_SSE
+#endif
 
+namespace {
+	//vertex format used by '.pnct' files:
 	struct Vertex {
 		glm::vec3 Position;
 		glm::vec3 Normal;
@@ -25,20 +32,212 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 		glm::vec2 TexCoord;
 	};
 	static_assert(sizeof(Vertex) == 3*4+3*4+4*1+2*4, "Vertex is packed.");
-	std::vector< Vertex > data;
 
-	//read + upload data chunk:
-	if (filename.size() >= 5 && filename.substr(filename.size()-5) == ".pnct") {
-		read_chunk(file, "pnct", &data);
+	//MeshBuffers currently being loaded via the Async constructor:
+	// (only touched from the main thread)
+	std::list< MeshBuffer * > &get_pending_buffers() {
+		static std::list< MeshBuffer * > pending_buffers;
+		return pending_buffers;
+	}
+
+	//staging buffer (re-specified -- "orphaned" -- before each slice) used to feed slices to their destination buffers:
+	GLuint staging_buffer = 0;
+
+	//triangles whose (twice) area is below this fraction of their squared edge lengths are "degenerate":
+	constexpr float DegenerateRatio = 1e-6f;
+
+	//compute bounding box, bounding sphere, area, and degenerate triangle count in one pass:
+	// the bounding sphere is grown incrementally (Ritter-style), then replaced by the box's
+	// bounding sphere if that happens to be smaller.
+	// (with SSE, 'vectorized' picks between the SSE and plain versions, so they can be checked against each other)
+	void compute_bounds_and_stats(Vertex const *data, Mesh *mesh_, bool vectorized) {
+		Mesh &mesh = *mesh_;
+		if (mesh.count == 0) return;
+		Vertex const *begin = data + mesh.start;
+		Vertex const *end = begin + mesh.count;
+
+		double area = 0.0;
+		uint32_t degenerate_count = 0;
+
+#ifdef MESH_USE_SSE
+		if (vectorized) {
+			//each vertex is loaded as (Position.x, Position.y, Position.z, Normal.x), with the last lane masked off as needed:
+			__m128 const xyz_mask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+			auto load = [&](Vertex const &v) { return _mm_loadu_ps(&v.Position.x); };
+			auto dot3 = [&](__m128 a, __m128 b) {
+				__m128 m = _mm_and_ps(_mm_mul_ps(a, b), xyz_mask);
+				m = _mm_add_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1,0,3,2)));
+				m = _mm_add_ss(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2,3,0,1)));
+				return _mm_cvtss_f32(m);
+			};
+
+			__m128 min = load(*begin);
+			__m128 max = min;
+			__m128 center = min;
+			float radius = 0.0f;
+			float radius2 = 0.0f;
+
+			auto grow = [&](__m128 p) {
+				min = _mm_min_ps(min, p);
+				max = _mm_max_ps(max, p);
+				__m128 to = _mm_sub_ps(p, center);
+				float dist2 = dot3(to, to);
+				if (dist2 > radius2) {
+					//move sphere toward p just enough to contain it:
+					float dist = std::sqrt(dist2);
+					float new_radius = 0.5f * (radius + dist);
+					center = _mm_add_ps(center, _mm_mul_ps(to, _mm_set1_ps((new_radius - radius) / dist)));
+					radius = new_radius;
+					radius2 = radius * radius;
+				}
+			};
+
+			Vertex const *v = begin;
+			for (; v + 3 <= end; v += 3) {
+				__m128 a = load(v[0]);
+				__m128 b = load(v[1]);
+				__m128 c = load(v[2]);
+				grow(a);
+				grow(b);
+				grow(c);
+
+				__m128 e1 = _mm_and_ps(_mm_sub_ps(b, a), xyz_mask);
+				__m128 e2 = _mm_and_ps(_mm_sub_ps(c, a), xyz_mask);
+				__m128 cross = _mm_sub_ps(
+					_mm_mul_ps(_mm_shuffle_ps(e1, e1, _MM_SHUFFLE(3,0,2,1)), _mm_shuffle_ps(e2, e2, _MM_SHUFFLE(3,1,0,2))),
+					_mm_mul_ps(_mm_shuffle_ps(e1, e1, _MM_SHUFFLE(3,1,0,2)), _mm_shuffle_ps(e2, e2, _MM_SHUFFLE(3,0,2,1)))
+				);
+				float twice_area = std::sqrt(dot3(cross, cross));
+				area += 0.5 * twice_area;
+				if (twice_area <= DegenerateRatio * (dot3(e1, e1) + dot3(e2, e2))) ++degenerate_count;
+			}
+			for (; v < end; ++v) {
+				grow(load(*v));
+			}
+
+			alignas(16) float out[4];
+			_mm_store_ps(out, min);
+			mesh.min = glm::vec3(out[0], out[1], out[2]);
+			_mm_store_ps(out, max);
+			mesh.max = glm::vec3(out[0], out[1], out[2]);
+			_mm_store_ps(out, center);
+			mesh.center = glm::vec3(out[0], out[1], out[2]);
+			mesh.radius = radius;
+		} else
+#else
+		(void)vectorized;
+#endif
+		{
+			glm::vec3 min = begin->Position;
+			glm::vec3 max = min;
+			glm::vec3 center = min;
+			float radius = 0.0f;
+
+			auto grow = [&](glm::vec3 const &p) {
+				min = glm::min(min, p);
+				max = glm::max(max, p);
+				glm::vec3 to = p - center;
+				float dist2 = glm::dot(to, to);
+				if (dist2 > radius * radius) {
+					//move sphere toward p just enough to contain it:
+					float dist = std::sqrt(dist2);
+					float new_radius = 0.5f * (radius + dist);
+					center += to * ((new_radius - radius) / dist);
+					radius = new_radius;
+				}
+			};
+
+			Vertex const *v = begin;
+			for (; v + 3 <= end; v += 3) {
+				grow(v[0].Position);
+				grow(v[1].Position);
+				grow(v[2].Position);
+
+				glm::vec3 e1 = v[1].Position - v[0].Position;
+				glm::vec3 e2 = v[2].Position - v[0].Position;
+				float twice_area = glm::length(glm::cross(e1, e2));
+				area += 0.5 * twice_area;
+				if (twice_area <= DegenerateRatio * (glm::dot(e1, e1) + glm::dot(e2, e2))) ++degenerate_count;
+			}
+			for (; v < end; ++v) {
+				grow(v->Position);
+			}
+
+			mesh.min = min;
+			mesh.max = max;
+			mesh.center = center;
+			mesh.radius = radius;
+		}
+
+		float box_radius = 0.5f * glm::length(mesh.max - mesh.min);
+		if (box_radius < mesh.radius) {
+			mesh.center = 0.5f * (mesh.min + mesh.max);
+			mesh.radius = box_radius;
+		}
+		//pad slightly so that round-off can't leave vertices outside:
+		// (both in the incremental updates and in the center itself, whose error grows with distance from the origin)
+		float extent = std::max(glm::length(mesh.min), glm::length(mesh.max));
+		mesh.radius = mesh.radius * (1.0f + 1e-5f) + extent * 1e-6f;
+
+		mesh.area = float(area);
+		mesh.degenerate_count = degenerate_count;
+	}
+}
 
-		//upload data:
-		glBindBuffer(GL_ARRAY_BUFFER, buffer);
-		glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(Vertex), data.data(), GL_STATIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
+struct MeshBuffer::Pending {
+	std::string filename; //(for reporting parse errors)
+	ChunkView< uint8_t > vertex_data; //written by read_file on the worker thread
+	size_t uploaded = 0; //bytes of vertex_data already copied to the buffer
+	bool allocated = false; //has storage for 'buffer' been allocated?
+};
 
-		total = GLuint(data.size()); //store total for later checks on index
+MeshBuffer::MeshBuffer(std::string const &filename) {
+	set_attribs_for(filename);
+
+	ChunkView< uint8_t > vertex_data;
+	read_file(filename, &vertex_data);
+
+	//upload data:
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glBufferData(GL_ARRAY_BUFFER, vertex_data.size(), vertex_data.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+MeshBuffer::MeshBuffer(std::string const &filename, Async) {
+	set_attribs_for(filename);
+
+	//the buffer name exists right away, so vertex array objects can be made before data arrives:
+	glGenBuffers(1, &buffer);
+
+	pending.reset(new Pending);
+	Pending *p = pending.get();
+	p->filename = filename;
+	parsed = std::async(std::launch::async, [this,p,filename](){
+		read_file(filename, &p->vertex_data);
+	}).share();
+
+	get_pending_buffers().emplace_back(this);
+}
+
+MeshBuffer::~MeshBuffer() {
+	if (pending) {
+		//can't cancel the worker (it writes into this object), so wait for it:
+		parsed.wait();
+		get_pending_buffers().remove(this);
+	}
+	if (!vaos.empty()) {
+		glDeleteVertexArrays(GLsizei(vaos.size()), vaos.data());
+		vaos.clear();
+	}
+	if (buffer != 0) {
+		glDeleteBuffers(1, &buffer);
+		buffer = 0;
+	}
+}
 
-		//store attrib locations:
+void MeshBuffer::set_attribs_for(std::string const &filename) {
+	if (filename.size() >= 5 && filename.substr(filename.size()-5) == ".pnct") {
 		Position = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Position));
 		Normal = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Normal));
 		Color = Attrib(4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), offsetof(Vertex, Color));
@@ -46,9 +245,32 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 	} else {
 		throw std::runtime_error("Unknown file type '" + filename + "'");
 	}
+}
+
+void MeshBuffer::read_file(std::string const &filename, ChunkView< uint8_t > *vertex_data) {
+	assert(vertex_data);
+
+	//chunks are read in place from the mapped file (or pack):
+	std::shared_ptr< DataFile const > contents = vfs_read(filename);
+	ChunkFile file(contents->data, contents->size, contents);
+	file.validate();
+
+	ChunkView< Vertex > data;
 
-	std::vector< char > strings;
-	read_chunk(file, "str0", &strings);
+	//read data chunk:
+	if (filename.size() >= 5 && filename.substr(filename.size()-5) == ".pnct") {
+		file.read("pnct", &data);
+	} else {
+		throw std::runtime_error("Unknown file type '" + filename + "'");
+	}
+
+	GLuint total = GLuint(data.size()); //store total for later checks on index
+
+	{ //copy names (see 'strings' in Mesh.hpp):
+		ChunkView< char > str0;
+		file.read("str0", &str0);
+		strings.assign(str0.begin(), str0.end());
+	}
 
 	{ //read index chunk, add to meshes:
 		struct IndexEntry {
@@ -57,9 +279,12 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 		};
 		static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
 
-		std::vector< IndexEntry > index;
-		read_chunk(file, "idx0", &index);
+		ChunkView< IndexEntry > index;
+		file.read("idx0", &index);
 
+		meshes.reserve(index.size());
+		mesh_names.reserve(index.size());
+		names.reserve(index.size());
 		for (auto const &entry : index) {
 			if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings.size())) {
 				throw std::runtime_error("index entry has out-of-range name begin/end");
@@ -67,49 +292,282 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 			if (!(entry.vertex_begin <= entry.vertex_end && entry.vertex_end <= total)) {
 				throw std::runtime_error("index entry has out-of-range vertex start/count");
 			}
-			std::string name(&strings[0] + entry.name_begin, &strings[0] + entry.name_end);
+			std::string_view name(strings.data() + entry.name_begin, entry.name_end - entry.name_begin);
 			Mesh mesh;
 			mesh.type = GL_TRIANGLES;
 			mesh.start = entry.vertex_begin;
 			mesh.count = entry.vertex_end - entry.vertex_begin;
-			for (uint32_t v = entry.vertex_begin; v < entry.vertex_end; ++v) {
-				mesh.min = glm::min(mesh.min, data[v].Position);
-				mesh.max = glm::max(mesh.max, data[v].Position);
-			}
-			bool inserted = meshes.insert(std::make_pair(name, mesh)).second;
-			if (!inserted) {
-				std::cerr << "WARNING: mesh name '" + name + "' in filename '" + filename + "' collides with existing mesh." << std::endl;
+			names.emplace_back(Name{name, Handle(meshes.size())});
+			meshes.emplace_back(mesh);
+			mesh_names.emplace_back(name);
+		}
+
+		//sort names for lookup, keeping only the first mesh with any given name:
+		std::stable_sort(names.begin(), names.end(), [](Name const &a, Name const &b) {
+			return a.name < b.name;
+		});
+		uint32_t kept = 0;
+		for (auto const &n : names) {
+			if (kept > 0 && names[kept-1].name == n.name) {
+				std::cerr << "WARNING: mesh name '" << n.name << "' in filename '" << filename << "' collides with existing mesh." << std::endl;
+				continue;
 			}
+			names[kept++] = n;
 		}
+		names.resize(kept);
 	}
 
-	if (file.peek() != EOF) {
+	//compute bounds and statistics (on several threads, for large files):
+	compute_stats(reinterpret_cast< uint8_t const * >(data.data()), total, &meshes);
+
+	//read optional chunks (any others are skipped):
+	if (file.find("clu0")) read_clusters(file, filename, total);
+	if (file.find("lod0")) read_lods(file, total);
+
+	if (file.trailing != 0) {
 		std::cerr << "WARNING: trailing data in mesh file '" << filename << "'" << std::endl;
 	}
 
 	/* //DEBUG:
 	std::cout << "File '" << filename << "' contained meshes";
-	for (auto const &m : meshes) {
-		if (&m.second == &meshes.rbegin()->second && meshes.size() > 1) std::cout << " and";
-		std::cout << " '" << m.first << "'";
-		if (&m.second != &meshes.rbegin()->second) std::cout << ",";
+	for (auto const &n : names) {
+		if (&n == &names.back() && names.size() > 1) std::cout << " and";
+		std::cout << " '" << n.name << "'";
+		if (&n != &names.back()) std::cout << ",";
 	}
 	std::cout << std::endl;
 	*/
+
+	vertex_data->elements = reinterpret_cast< uint8_t const * >(data.data());
+	vertex_data->count = data.size_bytes();
+	vertex_data->storage = data.storage;
+}
+
+void MeshBuffer::compute_stats(uint8_t const *pnct, GLuint total, std::vector< Mesh > *meshes_, uint32_t threads, bool vectorized) {
+	assert(meshes_);
+	std::vector< Mesh > &meshes = *meshes_;
+	Vertex const *data = reinterpret_cast< Vertex const * >(pnct);
+	for (auto const &mesh : meshes) {
+		assert(mesh.start + mesh.count <= total);
+		(void)mesh;
+	}
+
+	//spread meshes over several threads for large files:
+	std::atomic< uint32_t > next(0);
+	auto worker = [&]() {
+		for (uint32_t i = next++; i < meshes.size(); i = next++) {
+			compute_bounds_and_stats(data, &meshes[i], vectorized);
+		}
+	};
+	if (threads == 0) {
+		threads = 1;
+		if (total >= ParallelStatsVertices) threads = std::thread::hardware_concurrency();
+	}
+	threads = std::max(1u, std::min(threads, uint32_t(meshes.size())));
+	std::vector< std::future< void > > helpers;
+	for (uint32_t t = 1; t < threads; ++t) {
+		helpers.emplace_back(std::async(std::launch::async, worker));
+	}
+	worker();
+	for (auto &h : helpers) h.get();
+}
+
+//read cluster chunk (written by make-clusters), attach clusters to meshes:
+void MeshBuffer::read_clusters(ChunkFile const &file, std::string const &filename, GLuint total) {
+	struct ClusterEntry {
+		uint32_t vertex_begin, vertex_end;
+		glm::vec3 center;
+		float radius;
+		glm::vec3 cone_axis;
+		float cone_cutoff;
+	};
+	static_assert(sizeof(ClusterEntry) == 4+4+4*3+4+4*3+4, "Cluster entry should be packed");
+
+	ChunkView< ClusterEntry > entries;
+	file.read("clu0", &entries);
+
+	clusters.reserve(entries.size());
+	for (auto const &entry : entries) {
+		if (!(entry.vertex_begin <= entry.vertex_end && entry.vertex_end <= total)) {
+			throw std::runtime_error("cluster entry has out-of-range vertex start/count");
+		}
+		if (!clusters.empty() && entry.vertex_begin < clusters.back().start + clusters.back().count) {
+			throw std::runtime_error("cluster entries are not sorted by vertex start");
+		}
+		MeshCluster cluster;
+		cluster.start = entry.vertex_begin;
+		cluster.count = entry.vertex_end - entry.vertex_begin;
+		cluster.center = entry.center;
+		cluster.radius = entry.radius;
+		cluster.cone_axis = entry.cone_axis;
+		cluster.cone_cutoff = entry.cone_cutoff;
+		clusters.emplace_back(cluster);
+	}
+
+	//clusters are sorted, so each mesh's clusters are a contiguous run:
+	for (Handle h = 0; h < meshes.size(); ++h) {
+		Mesh &mesh = meshes[h];
+		auto begin = std::lower_bound(clusters.begin(), clusters.end(), mesh.start, [](MeshCluster const &c, GLuint start) {
+			return c.start < start;
+		});
+		auto end = begin;
+		GLuint covered = mesh.start;
+		while (end != clusters.end() && end->start == covered && covered < mesh.start + mesh.count) {
+			covered += end->count;
+			++end;
+		}
+		if (begin != end && covered == mesh.start + mesh.count) {
+			mesh.clusters = &*begin;
+			mesh.cluster_count = uint32_t(end - begin);
+		} else if (begin != end) {
+			std::cerr << "WARNING: clusters don't exactly cover mesh '" << mesh_names[h] << "' in '" << filename << "'; ignoring them." << std::endl;
+		}
+	}
+}
+
+//read level-of-detail chunk (written by make-lods), attach levels to meshes:
+void MeshBuffer::read_lods(ChunkFile const &file, GLuint total) {
+	struct LodEntry {
+		uint32_t mesh; //index of mesh in 'idx0' chunk
+		uint32_t vertex_begin, vertex_end;
+		float error;
+	};
+	static_assert(sizeof(LodEntry) == 4+4+4+4, "LOD entry should be packed");
+
+	ChunkView< LodEntry > entries;
+	file.read("lod0", &entries);
+
+	lods.reserve(entries.size());
+	for (auto const &entry : entries) {
+		if (!(entry.mesh < meshes.size())) {
+			throw std::runtime_error("LOD entry has out-of-range mesh index");
+		}
+		if (!(entry.vertex_begin <= entry.vertex_end && entry.vertex_end <= total)) {
+			throw std::runtime_error("LOD entry has out-of-range vertex start/count");
+		}
+		if (!lods.empty() && entry.mesh < entries[lods.size()-1].mesh) {
+			throw std::runtime_error("LOD entries are not sorted by mesh");
+		}
+		MeshLod lod;
+		lod.start = entry.vertex_begin;
+		lod.count = entry.vertex_end - entry.vertex_begin;
+		lod.error = entry.error;
+		lods.emplace_back(lod);
+	}
+
+	//entries are sorted by mesh (and then by level), so each mesh's levels are a contiguous run:
+	for (uint32_t begin = 0; begin < entries.size(); /* later */) {
+		uint32_t end = begin;
+		while (end < entries.size() && entries[end].mesh == entries[begin].mesh) ++end;
+		Mesh &mesh = meshes[entries[begin].mesh];
+		mesh.lods = &lods[begin];
+		mesh.lod_count = end - begin;
+		begin = end;
+	}
+}
+
+MeshBuffer::Handle MeshBuffer::find(std::string_view name) const {
+	wait_parsed();
+	auto f = std::lower_bound(names.begin(), names.end(), name, [](Name const &a, std::string_view b) {
+		return a.name < b;
+	});
+	if (f == names.end() || f->name != name) return InvalidHandle;
+	return f->handle;
+}
+
+const Mesh &MeshBuffer::lookup(std::string_view name) const {
+	Handle handle = find(name);
+	if (handle == InvalidHandle) {
+		throw std::runtime_error("Looking up mesh '" + std::string(name) + "' that doesn't exist.");
+	}
+	return meshes[handle];
+}
+
+void MeshBuffer::finish_upload() {
+	if (!pending) return;
+	parsed.get();
+
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	if (!pending->allocated) {
+		glBufferData(GL_ARRAY_BUFFER, pending->vertex_data.size(), pending->vertex_data.data(), GL_STATIC_DRAW);
+	} else if (pending->uploaded < pending->vertex_data.size()) {
+		glBufferSubData(GL_ARRAY_BUFFER, pending->uploaded, pending->vertex_data.size() - pending->uploaded, pending->vertex_data.data() + pending->uploaded);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	get_pending_buffers().remove(this);
+	pending.reset();
 }
 
-const Mesh &MeshBuffer::lookup(std::string const &name) const {
-	auto f = meshes.find(name);
-	if (f == meshes.end()) {
-		throw std::runtime_error("Looking up mesh '" + name + "' that doesn't exist.");
+void MeshBuffer::upload_pending(size_t byte_budget) {
+	auto &pending_buffers = get_pending_buffers();
+	for (auto bi = pending_buffers.begin(); bi != pending_buffers.end() && byte_budget > 0; /* later */) {
+		MeshBuffer &mb = **bi;
+		assert(mb.pending);
+		Pending &p = *mb.pending;
+
+		//skip buffers that are still being parsed:
+		if (mb.parsed.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+			++bi;
+			continue;
+		}
+		//if parsing failed, report it once and stop uploading: (find() and lookup() re-throw the error)
+		// (rather than throwing from here every frame)
+		std::string error;
+		try {
+			mb.parsed.get();
+		} catch (std::exception &e) {
+			error = e.what();
+		} catch (...) {
+			error = "unknown exception";
+		}
+		if (!error.empty()) {
+			std::cerr << "ERROR: reading mesh buffer '" << p.filename << "' failed (" << error << "); it will stay empty." << std::endl;
+			mb.pending.reset();
+			bi = pending_buffers.erase(bi);
+			continue;
+		}
+
+		//allocate storage for the destination buffer without filling it:
+		if (!p.allocated) {
+			glBindBuffer(GL_ARRAY_BUFFER, mb.buffer);
+			glBufferData(GL_ARRAY_BUFFER, p.vertex_data.size(), nullptr, GL_STATIC_DRAW);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			p.allocated = true;
+		}
+
+		//copy one slice through the staging buffer:
+		size_t slice = std::min(byte_budget, p.vertex_data.size() - p.uploaded);
+		if (slice > 0) {
+			if (staging_buffer == 0) glGenBuffers(1, &staging_buffer);
+			glBindBuffer(GL_COPY_READ_BUFFER, staging_buffer);
+			//orphan the previous slice's storage so this write doesn't wait on the previous copy:
+			glBufferData(GL_COPY_READ_BUFFER, slice, nullptr, GL_STREAM_DRAW);
+			glBufferSubData(GL_COPY_READ_BUFFER, 0, slice, p.vertex_data.data() + p.uploaded);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, mb.buffer);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, p.uploaded, slice);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+			glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+			p.uploaded += slice;
+			byte_budget -= slice;
+		}
+
+		if (p.uploaded == p.vertex_data.size()) {
+			//done; buffer is ready for drawing:
+			mb.pending.reset();
+			bi = pending_buffers.erase(bi);
+		} else {
+			++bi;
+		}
 	}
-	return f->second;
 }
 
 GLuint MeshBuffer::make_vao_for_program(GLuint program) const {
 	//create a new vertex array object:
 	GLuint vao = 0;
 	glGenVertexArrays(1, &vao);
+	vaos.emplace_back(vao);
 	glBindVertexArray(vao);
 
 	//Try to bind all attributes in this buffer:
@@ -5,16 +5,56 @@
  *  the OpenGL pipeline together.
  * A "MeshBuffer" holds a collection of such meshes (loaded from a file) in
  *  a single OpenGL array buffer. Individual meshes can be looked up by name
- *  using the MeshBuffer::lookup() function.
+ *  using the MeshBuffer::lookup() function, or by MeshBuffer::Handle (a small
+ *  integer, found once with MeshBuffer::find()) using MeshBuffer::get().
+ *
+ * Meshes may be split into "MeshCluster"s (by the offline make-clusters tool)
+ *  so that parts of large meshes can be culled separately.
+ * Meshes may also have a chain of simplified "MeshLod"s (built by the offline
+ *  make-lods tool), which Scene::draw picks between based on screen size.
+ *
+ * MeshBuffers may also be loaded asynchronously (MeshBuffer::Async):
+ *  the file is read and parsed on a background thread, and the vertex data
+ *  is uploaded a few megabytes at a time by MeshBuffer::upload_pending(),
+ *  which should be called once per frame from the main loop.
  *
  */
 
 #include "GL.hpp"
 #include <glm/glm.hpp>
-#include <map>
 #include <limits>
 #include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <future>
+
+//(see ChunkFile.hpp and read_write_chunk.hpp)
+struct ChunkFile;
+template< typename T > struct ChunkView;
+
+
+//A "MeshCluster" is a small (~64-128 triangle) vertex range within a Mesh,
+// with a bounding sphere and a cone bounding its triangles' normals:
+struct MeshCluster {
+	GLuint start = 0; //index of first vertex
+	GLuint count = 0; //count of vertices
 
+	glm::vec3 center = glm::vec3(0.0f);
+	float radius = 0.0f;
+
+	//all triangles in the cluster face away from 'eye' when:
+	// dot(center - eye, cone_axis) >= cone_cutoff * length(center - eye) + radius
+	glm::vec3 cone_axis = glm::vec3(0.0f, 0.0f, 1.0f);
+	float cone_cutoff = 2.0f; //(values > 1 mean "never back-facing")
+};
+
+//A "MeshLod" is a simplified version of a Mesh, stored elsewhere in the same MeshBuffer:
+struct MeshLod {
+	GLuint start = 0; //index of first vertex
+	GLuint count = 0; //count of vertices
+	float error = 0.0f; //approximate distance (in mesh units) of this version from the original surface
+};
 
 struct Mesh {
 	//Meshes are vertex ranges (and primitive types) in their MeshBuffer:
@@ -27,6 +67,24 @@ struct Mesh {
 	//useful for debug visualization and (perhaps, eventually) collision detection:
 	glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
 	glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+
+	//Bounding sphere (contains all vertices; not necessarily minimal).
+	//useful for culling and level-of-detail selection:
+	glm::vec3 center = glm::vec3(0.0f);
+	float radius = -1.0f; //negative for meshes with no vertices
+
+	//Statistics about the mesh's triangles, for diagnostics:
+	float area = 0.0f; //total surface area
+	uint32_t degenerate_count = 0; //number of (nearly) zero-area triangles
+
+	//(optional) clusters exactly covering [start, start+count), or nullptr if the file had no cluster chunk:
+	MeshCluster const *clusters = nullptr;
+	uint32_t cluster_count = 0;
+
+	//(optional) increasingly-simplified versions of the mesh, or nullptr if the file had no level-of-detail chunk:
+	// (the mesh itself is level zero; lods[i] is level i+1)
+	MeshLod const *lods = nullptr;
+	uint32_t lod_count = 0;
 };
 
 struct MeshBuffer {
@@ -34,12 +92,53 @@ struct MeshBuffer {
 	// note: will throw if file fails to read.
 	MeshBuffer(std::string const &filename);
 
+	//construct from a file, reading + parsing on a background thread:
+	// note: the buffer is not drawable until ready() returns true
+	// note: file errors are thrown from lookup() and find() (upload_pending() just reports them)
+	struct Async { };
+	MeshBuffer(std::string const &filename, Async);
+
+	~MeshBuffer();
+
 	//look up a particular mesh by name:
 	// note: will throw if mesh not found.
-	const Mesh &lookup(std::string const &name) const;
+	// note: if loading asynchronously, will wait for parsing to finish.
+	const Mesh &lookup(std::string_view name) const;
+
+	//meshes are also identified by handle, which is the mesh's position in the file's index:
+	// (handles stay valid for the lifetime of the MeshBuffer)
+	typedef uint32_t Handle;
+	static constexpr Handle InvalidHandle = -1U;
+
+	//find a mesh's handle by name (returns InvalidHandle if mesh not found):
+	// note: if loading asynchronously, will wait for parsing to finish.
+	Handle find(std::string_view name) const;
+
+	//get a mesh (or its name) by handle:
+	// note: handle must be valid
+	// note: if loading asynchronously, will wait for parsing to finish (like size()).
+	const Mesh &get(Handle handle) const { wait_parsed(); return meshes[handle]; }
+	std::string_view name(Handle handle) const { wait_parsed(); return mesh_names[handle]; }
+	uint32_t size() const { wait_parsed(); return uint32_t(meshes.size()); }
+
+	//wait for asynchronous parsing to finish, re-throwing any error from it:
+	// (does nothing for buffers that weren't loaded asynchronously)
+	void wait_parsed() const { if (parsed.valid()) parsed.get(); }
+
+	//has all vertex data been uploaded to 'buffer'?
+	// (also true once asynchronous parsing has failed and upload_pending() has given up on the buffer)
+	bool ready() const { return !pending; }
+
+	//wait for parsing and upload all remaining vertex data right away:
+	void finish_upload();
+
+	//upload (at most) 'byte_budget' bytes of vertex data for asynchronously loading MeshBuffers:
+	// (call once per frame from the thread that owns the OpenGL context)
+	static void upload_pending(size_t byte_budget);
 	
 	//build a vertex array object that links this vbo to attributes to a program:
 	// note: will throw if program defines attributes not contained in this buffer
+	// note: the vertex array object is deleted along with this MeshBuffer
 	GLuint make_vao_for_program(GLuint program) const;
 
 	//This is the OpenGL vertex buffer object containing the mesh data:
@@ -47,8 +146,31 @@ struct MeshBuffer {
 
 	//-- internals ---
 
-	//used by the lookup() function:
-	std::map< std::string, Mesh > meshes;
+	//meshes and their names, indexed by handle:
+	std::vector< Mesh > meshes;
+	std::vector< std::string_view > mesh_names; //views into 'strings'
+
+	//name -> handle index (sorted by name) used by find() and lookup():
+	// (if several meshes share a name, only the first is included)
+	struct Name {
+		std::string_view name;
+		Handle handle;
+	};
+	std::vector< Name > names;
+
+	//contents of the file's string chunk, which holds mesh names:
+	// (a copy, so the file needn't stay mapped once loading is done)
+	std::vector< char > strings;
+
+	//storage for the Mesh::clusters arrays (not modified after loading):
+	std::vector< MeshCluster > clusters;
+
+	//storage for the Mesh::lods arrays (not modified after loading):
+	std::vector< MeshLod > lods;
+
+	//vertex array objects made by make_vao_for_program(), deleted by the destructor:
+	// (a vertex array object keeps the buffers it uses alive, so deleting only 'buffer' wouldn't free its storage)
+	mutable std::vector< GLuint > vaos;
 
 	//These 'Attrib' structures describe the location of various attributes within the buffer (in exactly format wanted by glVertexAttribPointer). They are set when the file is loaded and are used by the "make_vao_for_program" call:
 	struct Attrib {
@@ -67,4 +189,28 @@ struct MeshBuffer {
 	Attrib Normal;
 	Attrib Color;
 	Attrib TexCoord;
+
+	//sets attribs based on the file type (throws on unknown file types):
+	void set_attribs_for(std::string const &filename);
+
+	//reads vertex data and fills in 'meshes', 'clusters', and 'lods'; does not touch OpenGL, so may run on any thread:
+	// ('vertex_data' is a view of the file's vertex chunk, so the file stays mapped while the view exists)
+	void read_file(std::string const &filename, ChunkView< uint8_t > *vertex_data);
+	//helpers for read_file that read optional chunks ('total' is the vertex count):
+	void read_clusters(ChunkFile const &file, std::string const &filename, GLuint total);
+	void read_lods(ChunkFile const &file, GLuint total);
+
+	//computes bounds and statistics (min through degenerate_count) of 'meshes' from '.pnct' vertex data with 'total' vertices:
+	// meshes are spread over 'threads' threads (or, if zero, over all cores for files of at least ParallelStatsVertices vertices);
+	// 'vectorized' = false uses the plain code even where SSE is available (bench-mesh-stats checks one against the other)
+	static constexpr uint32_t ParallelStatsVertices = 1 << 18;
+	static void compute_stats(uint8_t const *pnct, GLuint total, std::vector< Mesh > *meshes, uint32_t threads = 0, bool vectorized = true);
+
+	//becomes ready once read_file has finished on the worker thread (invalid if not loading asynchronously):
+	// (never reset, so find() and lookup() may wait on it from any thread while upload_pending() runs)
+	std::shared_future< void > parsed;
+
+	//book-keeping for asynchronous loading (nullptr once everything is uploaded; only used by the thread that owns the OpenGL context):
+	struct Pending;
+	std::unique_ptr< Pending > pending;
 };
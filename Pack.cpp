@@ -0,0 +1,134 @@
+#include "Pack.hpp"
+#include "lz4.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+Pack::Pack(std::string const &filename_) : filename(filename_) {
+	file = std::make_shared< MappedFile >(filename);
+
+	Header header;
+	Header const expected;
+	if (file->size < sizeof(header)) {
+		throw std::runtime_error("Pack '" + filename + "' is too small to hold a header.");
+	}
+	std::memcpy(&header, file->data, sizeof(header));
+	if (std::memcmp(header.magic, expected.magic, 4) != 0) {
+		throw std::runtime_error("'" + filename + "' is not a pack.");
+	}
+	if (header.version != expected.version) {
+		throw std::runtime_error("Pack '" + filename + "' has version " + std::to_string(header.version) + " (expected " + std::to_string(expected.version) + ").");
+	}
+
+	//index and names must be in the file (and the index aligned, since it is used in place):
+	if (header.index_offset % alignof(Entry) != 0
+	 || header.index_offset > file->size
+	 || uint64_t(header.entry_count) * sizeof(Entry) > file->size - header.index_offset
+	 || header.names_offset > file->size
+	 || header.names_size > file->size - header.names_offset) {
+		throw std::runtime_error("Pack '" + filename + "' has an index or names outside the file.");
+	}
+	entries = reinterpret_cast< Entry const * >(file->data + header.index_offset);
+	entry_count = header.entry_count;
+	names = reinterpret_cast< char const * >(file->data + header.names_offset);
+
+	for (uint32_t i = 0; i < entry_count; ++i) {
+		Entry const &entry = entries[i];
+		if (uint64_t(entry.name_begin) + entry.name_length > header.names_size) {
+			throw std::runtime_error("Pack '" + filename + "' has an entry with a name outside the names.");
+		}
+		if (entry.offset % Alignment != 0 || entry.offset > file->size || entry.stored_size > file->size - entry.offset) {
+			throw std::runtime_error("Pack '" + filename + "' entry '" + std::string(name(entry)) + "' is outside the file.");
+		}
+		if (entry.compression == Stored ? entry.stored_size != entry.size : entry.compression != LZ4) {
+			throw std::runtime_error("Pack '" + filename + "' entry '" + std::string(name(entry)) + "' has an unknown compression or wrong size.");
+		}
+		if (i > 0 && !(name(entries[i-1]) < name(entry))) {
+			throw std::runtime_error("Pack '" + filename + "' index is not sorted by name.");
+		}
+	}
+}
+
+std::string_view Pack::name(Entry const &entry) const {
+	return std::string_view(names + entry.name_begin, entry.name_length);
+}
+
+Pack::Entry const *Pack::find(std::string_view want) const {
+	Entry const *end = entries + entry_count;
+	Entry const *found = std::lower_bound(entries, end, want, [this](Entry const &entry, std::string_view const &n) {
+		return name(entry) < n;
+	});
+	if (found == end || name(*found) != want) return nullptr;
+	return found;
+}
+
+void Pack::extract(Entry const &entry, uint8_t *out) const {
+	if (entry.compression == LZ4) {
+		lz4_decompress(stored(entry), size_t(entry.stored_size), out, size_t(entry.size));
+	} else {
+		std::memcpy(out, stored(entry), size_t(entry.size));
+	}
+}
+
+void Pack::write(std::string const &filename, std::vector< std::pair< std::string, std::vector< uint8_t > > > const &files, bool compress) {
+	std::vector< std::pair< std::string, std::vector< uint8_t > > const * > sorted;
+	for (auto const &f : files) sorted.emplace_back(&f);
+	std::sort(sorted.begin(), sorted.end(), [](auto const *a, auto const *b) { return a->first < b->first; });
+	for (size_t i = 1; i < sorted.size(); ++i) {
+		if (sorted[i-1]->first == sorted[i]->first) throw std::runtime_error("Pack would hold '" + sorted[i]->first + "' twice.");
+	}
+
+	std::ofstream out(filename, std::ios::binary);
+	uint64_t written = 0;
+	auto write = [&](void const *data, size_t size) {
+		out.write(reinterpret_cast< char const * >(data), size);
+		written += size;
+	};
+	auto pad = [&](uint64_t alignment) {
+		static uint8_t const zeros[Alignment] = {0};
+		write(zeros, size_t((alignment - written % alignment) % alignment));
+	};
+
+	Header header;
+	write(&header, sizeof(header));
+
+	std::vector< Entry > index;
+	std::string names;
+	for (auto const *f : sorted) {
+		if (f->first.size() > 0xffff) throw std::runtime_error("Pack entry name '" + f->first + "' is too long.");
+		Entry entry;
+		entry.name_begin = uint32_t(names.size());
+		entry.name_length = uint16_t(f->first.size());
+		names += f->first;
+
+		pad(Alignment);
+		entry.offset = written;
+		entry.size = f->second.size();
+		std::vector< uint8_t > compressed;
+		if (compress) compressed = lz4_compress(f->second.data(), f->second.size());
+		if (compress && compressed.size() <= f->second.size() - f->second.size() / 8) {
+			entry.compression = LZ4;
+			entry.stored_size = compressed.size();
+			write(compressed.data(), compressed.size());
+		} else {
+			entry.compression = Stored;
+			entry.stored_size = f->second.size();
+			write(f->second.data(), f->second.size());
+		}
+		index.emplace_back(entry);
+	}
+
+	pad(Alignment);
+	header.index_offset = written;
+	header.entry_count = uint32_t(index.size());
+	write(index.data(), index.size() * sizeof(Entry));
+	header.names_offset = written;
+	header.names_size = uint32_t(names.size());
+	write(names.data(), names.size());
+
+	out.seekp(0);
+	out.write(reinterpret_cast< char const * >(&header), sizeof(header));
+	if (!out) throw std::runtime_error("Failed to write pack '" + filename + "'.");
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+/*
+ * A Pack is an archive holding many data files, read through a memory
+ *  mapping of the whole archive (so stored files are used in place, without copies).
+ * Packs are built by the make-pack tool and read through the functions in vfs.hpp.
+ *
+ * File format (little-endian):
+ *  - PackHeader (64 bytes);
+ *  - file contents, each starting at a multiple of 64 bytes from the start of the file;
+ *  - index: PackHeader::entry_count PackEntry structures, sorted by name;
+ *  - names: the entries' names (paths relative to the packed directory, using '/'), not null-terminated.
+ *
+ * Entries may be stored as-is or compressed with LZ4 (see lz4.hpp);
+ *  make-pack only keeps the compressed version when it saves at least an eighth of the size.
+ *
+ */
+
+#include "MappedFile.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct Pack {
+	enum Compression : uint8_t {
+		Stored = 0,
+		LZ4 = 1,
+	};
+	static constexpr uint64_t Alignment = 64;
+
+	struct Header {
+		char magic[4] = {'p','a','c','k'};
+		uint32_t version = 1;
+		uint32_t entry_count = 0;
+		uint32_t names_size = 0;
+		uint64_t index_offset = 0;
+		uint64_t names_offset = 0;
+		uint8_t reserved[32] = {0};
+	};
+	static_assert(sizeof(Header) == 64, "Pack::Header is packed.");
+
+	struct Entry {
+		uint64_t offset = 0; //start of contents (a multiple of Alignment)
+		uint64_t stored_size = 0; //bytes in the pack
+		uint64_t size = 0; //bytes once decompressed
+		uint32_t name_begin = 0; //name is [name_begin, name_begin + name_length) in the names
+		uint16_t name_length = 0;
+		Compression compression = Stored;
+		uint8_t reserved = 0;
+	};
+	static_assert(sizeof(Entry) == 32, "Pack::Entry is packed.");
+
+	//open a pack; will throw if it can't be read or is malformed:
+	Pack(std::string const &filename);
+
+	//find an entry by name (returns nullptr if there isn't one):
+	Entry const *find(std::string_view name) const;
+
+	std::string_view name(Entry const &entry) const;
+
+	//the entry's bytes as stored in the pack (compressed, if it is):
+	uint8_t const *stored(Entry const &entry) const { return file->data + entry.offset; }
+
+	//decompress (or copy) the entry's contents to 'out' (which must hold entry.size bytes):
+	void extract(Entry const &entry, uint8_t *out) const;
+
+	std::string filename;
+	std::shared_ptr< MappedFile const > file;
+	Entry const *entries = nullptr; //(points into 'file')
+	uint32_t entry_count = 0;
+	char const *names = nullptr; //(points into 'file')
+
+	//write a pack holding 'files' (pairs of name and contents); will throw if writing fails:
+	// (if 'compress' is set, entries are compressed when that saves at least an eighth of their size)
+	static void write(std::string const &filename, std::vector< std::pair< std::string, std::vector< uint8_t > > > const &files, bool compress);
+};
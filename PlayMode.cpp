@@ -5,22 +5,32 @@
 #include "DrawLines.hpp"
 #include "Mesh.hpp"
 #include "Load.hpp"
+#include "HotReload.hpp"
+#include "Sound.hpp"
 #include "gl_errors.hpp"
 #include "data_path.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/quaternion.hpp>
 
+#include <cstdio>
+#include <memory>
 #include <random>
 
 GLuint phonebank_meshes_for_lit_color_texture_program = 0;
 Load< MeshBuffer > phonebank_meshes(LoadTagDefault, []() -> MeshBuffer const * {
-	MeshBuffer const *ret = new MeshBuffer(data_path("phone-bank.pnct"));
+	HotReload::watch(data_path("phone-bank.pnct"), phonebank_meshes);
+	//vertex data is uploaded in slices by MeshBuffer::upload_pending() in the main loop:
+	std::unique_ptr< MeshBuffer > ret(new MeshBuffer(data_path("phone-bank.pnct"), MeshBuffer::Async()));
+	//when hot reloading (there is already a value), wait for parsing here, so a bad file fails the reload -- keeping the old meshes -- rather than the upload:
+	if (phonebank_meshes.value) ret->wait_parsed();
 	phonebank_meshes_for_lit_color_texture_program = ret->make_vao_for_program(lit_color_texture_program->program);
-	return ret;
-});
+	return ret.release();
+}, { lit_color_texture_program });
 
-Load< Scene > phonebank_scene(LoadTagDefault, []() -> Scene const * {
+//(reading the scene doesn't touch OpenGL, so it happens on a worker once the meshes and program are ready)
+Load< Scene > phonebank_scene(LoadTagAsync, []() -> Scene const * {
+	HotReload::watch(data_path("phone-bank.scene"), phonebank_scene);
 	return new Scene(data_path("phone-bank.scene"), [&](Scene &scene, Scene::Transform *transform, std::string const &mesh_name){
 		Mesh const &mesh = phonebank_meshes->lookup(mesh_name);
 
@@ -33,18 +43,30 @@ Load< Scene > phonebank_scene(LoadTagDefault, []() -> Scene const * {
 		drawable.pipeline.type = mesh.type;
 		drawable.pipeline.start = mesh.start;
 		drawable.pipeline.count = mesh.count;
+		drawable.pipeline.mesh = &mesh;
 
 	});
-});
+}, { phonebank_meshes, lit_color_texture_program });
 
-WalkMesh const *walkmesh = nullptr;
-Load< WalkMeshes > phonebank_walkmeshes(LoadTagDefault, []() -> WalkMeshes const * {
-	WalkMeshes *ret = new WalkMeshes(data_path("phone-bank.w"));
-	walkmesh = &ret->lookup("WalkMesh");
-	return ret;
+Load< WalkMeshes > phonebank_walkmeshes(LoadTagAsync, []() -> WalkMeshes const * {
+	HotReload::watch(data_path("phone-bank.w"), phonebank_walkmeshes);
+	return new WalkMeshes(data_path("phone-bank.w"));
 });
 
-PlayMode::PlayMode() : scene(*phonebank_scene) {
+PlayMode::PlayMode() {
+	reset_scene();
+
+	walkmeshes = phonebank_walkmeshes.get();
+	walkmesh = &walkmeshes->lookup("WalkMesh");
+
+	//start player walking at nearest walk point:
+	player.at = walkmesh->nearest_walk_point(player.transform->position);
+}
+
+void PlayMode::reset_scene() {
+	scene_source = phonebank_scene.get();
+	scene = *scene_source;
+
 	//create a player transform:
 	scene.transforms.emplace_back();
 	player.transform = &scene.transforms.back();
@@ -63,11 +85,9 @@ PlayMode::PlayMode() : scene(*phonebank_scene) {
 	//rotate camera facing direction (-z) to player facing direction (+y):
 	player.camera->transform->rotation = glm::angleAxis(glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
 
-	//start player walking at nearest walk point:
-	player.at = walkmesh->nearest_walk_point(player.transform->position);
-
 
 	//init tiles vector
+	carried_tile = nullptr;
 	tiles = std::vector<Tile>(2);
 	tiles[0].color = COLOR::ORANGE;
 	tiles[1].color = COLOR::PURPLE;
@@ -81,6 +101,8 @@ PlayMode::PlayMode() : scene(*phonebank_scene) {
 	gates = std::vector<Gate>(2);
 
 	// get pointer to each transform for reference
+	penguin = nullptr;
+	pickupPt = nullptr;
 	for (auto& transform : scene.transforms) {
 		if (transform.name == "Penguin") penguin = &transform;
 		if (transform.name == "PickupPt") pickupPt = &transform;
@@ -149,6 +171,9 @@ bool PlayMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size)
 			down.downs += 1;
 			down.pressed = true;
 			return true;
+		} else if (evt.key.keysym.sym == SDLK_F1) {
+			show_audio_stats = !show_audio_stats;
+			return true;
 		} else if (evt.key.keysym.sym == SDLK_q) {  // QUIT
 			quit = true;
 			return true;
@@ -244,6 +269,24 @@ bool PlayMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size)
 }
 
 void PlayMode::update(float elapsed) {
+	//pick up hot-reloaded versions of the scene and walkmesh (see HotReload.hpp):
+	if (phonebank_scene.get() != scene_source) {
+		//keep the player where they were (puzzle progress starts over, since the tiles, pegs, and gates were replaced):
+		glm::vec3 position = player.transform->position;
+		glm::quat rotation = player.transform->rotation;
+		glm::quat look = player.camera->transform->rotation;
+		reset_scene();
+		player.transform->position = position;
+		player.transform->rotation = rotation;
+		player.camera->transform->rotation = look;
+		if (attached_to_walkmesh) player.at = walkmesh->nearest_walk_point(position);
+	}
+	if (phonebank_walkmeshes.get() != walkmeshes) {
+		walkmeshes = phonebank_walkmeshes.get();
+		walkmesh = &walkmeshes->lookup("WalkMesh");
+		player.at = walkmesh->nearest_walk_point(player.transform->position);
+	}
+
 	//player walking:
 	{
 		//combine inputs into a move:
@@ -404,7 +447,10 @@ void PlayMode::draw(glm::uvec2 const &drawable_size) {
 	glEnable(GL_DEPTH_TEST);
 	glDepthFunc(GL_LESS); //this is the default depth comparison function, but FYI you can change it.
 
-	scene.draw(*player.camera);
+	//skip drawing the scene until its vertex data has finished uploading:
+	if (phonebank_meshes->ready()) {
+		scene.draw(*player.camera);
+	}
 
 	{ //use DrawLines to overlay some text:
 		glDisable(GL_DEPTH_TEST);
@@ -426,6 +472,49 @@ void PlayMode::draw(glm::uvec2 const &drawable_size) {
 			glm::vec3(-aspect + 0.1f * H + ofs, -1.0 + + 0.1f * H + ofs, 0.0),
 			glm::vec3(H, 0.0f, 0.0f), glm::vec3(0.0f, H, 0.0f),
 			glm::u8vec4(0xff, 0xff, 0xff, 0x00));
+
+		if (show_audio_stats) {
+			//graph of recent mix times (top-left), scaled so the top of the box is the mixing deadline:
+			Sound::Stats stats = Sound::get_stats();
+			glm::vec2 min = glm::vec2(-aspect + 0.1f * H, 1.0f - 0.1f * H - 0.5f);
+			glm::vec2 max = glm::vec2(min.x + 1.0f, 1.0f - 0.1f * H);
+			glm::u8vec4 const box_color(0x88, 0x88, 0x88, 0xff);
+			lines.draw(glm::vec3(min.x, min.y, 0.0f), glm::vec3(max.x, min.y, 0.0f), box_color);
+			lines.draw(glm::vec3(min.x, min.y, 0.0f), glm::vec3(min.x, max.y, 0.0f), box_color);
+			lines.draw(glm::vec3(max.x, min.y, 0.0f), glm::vec3(max.x, max.y, 0.0f), box_color);
+			lines.draw(glm::vec3(min.x, max.y, 0.0f), glm::vec3(max.x, max.y, 0.0f), glm::u8vec4(0xff, 0x00, 0x00, 0xff));
+
+			auto graph_point = [&](uint32_t i) {
+				float amt = std::min(1.0f, stats.mix_ms[i] / stats.block_ms);
+				return glm::vec3(
+					min.x + (max.x - min.x) * float(i) / float(stats.mix_ms.size() - 1),
+					min.y + (max.y - min.y) * amt,
+					0.0f
+				);
+			};
+			for (uint32_t i = 0; i + 1 < stats.mix_ms.size(); ++i) {
+				lines.draw(graph_point(i), graph_point(i+1), glm::u8vec4(0x00, 0xff, 0x00, 0xff));
+			}
+
+			//numbers, below the graph:
+			auto fixed = [](float value, int digits) {
+				char buffer[32];
+				std::snprintf(buffer, sizeof(buffer), "%.*f", digits, value);
+				return std::string(buffer);
+			};
+			float peak_db = 20.0f * std::log10(std::max(stats.peak, 1e-5f));
+			std::string text[3] = {
+				"mix " + fixed(stats.mix_ms.back(), 2) + "ms (worst " + fixed(stats.worst_mix_ms, 2) + "ms) of " + fixed(stats.block_ms, 1) + "ms",
+				"voices " + std::to_string(stats.voices_mixed) + " mixed / " + std::to_string(stats.voices_playing) + " playing; peak " + fixed(peak_db, 1) + "dB",
+				std::to_string(stats.late_callbacks) + " late callbacks (longest gap " + fixed(stats.worst_interval_ms, 1) + "ms)",
+			};
+			for (uint32_t t = 0; t < 3; ++t) {
+				lines.draw_text(text[t],
+					glm::vec3(min.x, min.y - (t + 1) * 1.2f * H, 0.0f),
+					glm::vec3(H, 0.0f, 0.0f), glm::vec3(0.0f, H, 0.0f),
+					glm::u8vec4(0xff, 0xff, 0xff, 0x00));
+			}
+		}
 	}
 	GL_ERRORS();
 }
@@ -35,6 +35,9 @@ struct PlayMode : Mode {
 
 	bool attached_to_walkmesh = true;
 
+	//show the audio thread's statistics (toggled with F1):
+	bool show_audio_stats = false;
+
 	//input tracking:
 	struct Button {
 		uint8_t downs = 0;
@@ -43,6 +46,13 @@ struct PlayMode : Mode {
 
 	//local copy of the game scene (so code can change it during gameplay):
 	Scene scene;
+	Scene const *scene_source = nullptr; //the loaded scene it was copied from
+	//copy the loaded scene and find the transforms used below (throws if any are missing):
+	void reset_scene();
+
+	//walkmesh the player walks on (and the loaded walkmeshes it was found in):
+	WalkMeshes const *walkmeshes = nullptr;
+	WalkMesh const *walkmesh = nullptr;
 
 	//player info:
 	struct Player {
@@ -1,11 +1,13 @@
 #include "Scene.hpp"
 
 #include "gl_errors.hpp"
-#include "read_write_chunk.hpp"
+#include "ChunkFile.hpp"
+#include "vfs.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 
-#include <fstream>
+#include <algorithm>
+#include <cmath>
 
 //-------------------------
 
@@ -80,14 +82,112 @@ glm::mat4 Scene::Camera::make_projection() const {
 //-------------------------
 
 
+void Scene::gather_visible_clusters(Mesh const &mesh, glm::mat4 const &object_to_clip, bool cull_back_facing, std::vector< GLint > *firsts_, std::vector< GLsizei > *counts_) {
+	assert(mesh.clusters && mesh.cluster_count);
+	assert(firsts_ && counts_);
+	auto &firsts = *firsts_;
+	auto &counts = *counts_;
+
+	//object-space frustum planes (Gribb/Hartmann) as (normal, offset), with normal lengths for distance scaling:
+	// (no far plane since cameras use infinite perspective)
+	glm::mat4 rows = glm::transpose(object_to_clip);
+	glm::vec4 planes[5] = {
+		rows[3] + rows[0], rows[3] - rows[0],
+		rows[3] + rows[1], rows[3] - rows[1],
+		rows[3] + rows[2]
+	};
+	float plane_lengths[5];
+	for (uint32_t p = 0; p < 5; ++p) {
+		plane_lengths[p] = glm::length(glm::vec3(planes[p]));
+	}
+
+	//camera position in object space is the point that projects to clip (0,0,z,0):
+	// (will have w == 0 for orthographic projections, in which case back-face tests are skipped)
+	glm::vec4 eye_h = glm::inverse(object_to_clip) * glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
+	if (std::abs(eye_h.w) < 1e-6f) cull_back_facing = false;
+	glm::vec3 eye = glm::vec3(eye_h) / (cull_back_facing ? eye_h.w : 1.0f);
+
+	firsts.clear();
+	counts.clear();
+
+	for (uint32_t c = 0; c < mesh.cluster_count; ++c) {
+		MeshCluster const &cluster = mesh.clusters[c];
+
+		bool visible = true;
+		for (uint32_t p = 0; p < 5; ++p) {
+			if (glm::dot(glm::vec3(planes[p]), cluster.center) + planes[p].w < -cluster.radius * plane_lengths[p]) {
+				visible = false;
+				break;
+			}
+		}
+		if (visible && cull_back_facing) {
+			glm::vec3 to = cluster.center - eye;
+			if (glm::dot(to, cluster.cone_axis) >= cluster.cone_cutoff * glm::length(to) + cluster.radius) {
+				visible = false;
+			}
+		}
+		if (!visible) continue;
+
+		if (!counts.empty() && firsts.back() + counts.back() == GLint(cluster.start)) {
+			counts.back() += GLsizei(cluster.count);
+		} else {
+			firsts.emplace_back(GLint(cluster.start));
+			counts.emplace_back(GLsizei(cluster.count));
+		}
+	}
+}
+
+//helper: draw the clusters of 'mesh' that are inside the view frustum (and, optionally, not back-facing):
+static void draw_visible_clusters(Mesh const &mesh, GLenum type, glm::mat4 const &object_to_clip, bool cull_back_facing) {
+	//(kept between calls so drawing doesn't allocate)
+	static std::vector< GLint > firsts;
+	static std::vector< GLsizei > counts;
+	Scene::gather_visible_clusters(mesh, object_to_clip, cull_back_facing, &firsts, &counts);
+
+	if (counts.size() == 1) {
+		glDrawArrays(type, firsts[0], counts[0]);
+	} else if (!counts.empty()) {
+		glMultiDrawArrays(type, firsts.data(), counts.data(), GLsizei(counts.size()));
+	}
+}
+
+uint32_t Scene::select_lod(Mesh const &mesh, glm::mat4x3 const &object_to_world, glm::vec3 const &eye, Camera const &camera) {
+	if (mesh.lod_count == 0 || mesh.radius < 0.0f) return 0;
+
+	//world-space bounding sphere (scaled by the largest axis scale, to stay conservative):
+	float scale = std::max(glm::length(object_to_world[0]), std::max(glm::length(object_to_world[1]), glm::length(object_to_world[2])));
+	glm::vec3 center = object_to_world * glm::vec4(mesh.center, 1.0f);
+	float radius = mesh.radius * scale;
+
+	//closest possible distance to the camera; use full detail if the camera is inside the sphere:
+	float distance = glm::length(center - eye) - radius;
+	if (distance <= 0.0f) return 0;
+
+	//fraction of the viewport height covered by one world unit at that distance:
+	float per_unit = 1.0f / (2.0f * distance * std::tan(0.5f * camera.fovy));
+
+	//levels are ordered by increasing error, so take the last one that is acceptable:
+	uint32_t level = 0;
+	while (level < mesh.lod_count && mesh.lods[level].error * scale * per_unit <= camera.lod_error) {
+		++level;
+	}
+	return level;
+}
+
 void Scene::draw(Camera const &camera) const {
 	assert(camera.transform);
 	glm::mat4 world_to_clip = camera.make_projection() * glm::mat4(camera.transform->make_world_to_local());
 	glm::mat4x3 world_to_light = glm::mat4x3(1.0f);
-	draw(world_to_clip, world_to_light);
+	draw(world_to_clip, world_to_light, &camera);
 }
 
-void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light) const {
+void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light, Camera const *lod_camera) const {
+	//camera position is needed for level-of-detail selection:
+	glm::vec3 eye = glm::vec3(0.0f);
+	if (lod_camera) {
+		assert(lod_camera->transform);
+		eye = lod_camera->transform->make_local_to_world()[3];
+	}
 
 	//Iterate through all drawables, sending each one to OpenGL:
 	for (auto const &drawable : drawables) {
@@ -115,8 +215,8 @@ void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_lig
 		glm::mat4x3 object_to_world = drawable.transform->make_local_to_world();
 
 		//OBJECT_TO_CLIP takes vertices from object space to clip space:
+		glm::mat4 object_to_clip = world_to_clip * glm::mat4(object_to_world);
 		if (pipeline.OBJECT_TO_CLIP_mat4 != -1U) {
-			glm::mat4 object_to_clip = world_to_clip * glm::mat4(object_to_world);
 			glUniformMatrix4fv(pipeline.OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(object_to_clip));
 		}
 
@@ -146,7 +246,21 @@ void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_lig
 		}
 
 		//draw the object:
-		glDrawArrays(pipeline.type, pipeline.start, pipeline.count);
+		bool whole_mesh = (pipeline.mesh && pipeline.mesh->start == pipeline.start && pipeline.mesh->count == pipeline.count);
+		uint32_t level = 0;
+		if (whole_mesh && lod_camera) {
+			level = select_lod(*pipeline.mesh, object_to_world, eye, *lod_camera);
+		}
+		if (level != 0) {
+			//...as a simplified version:
+			MeshLod const &lod = pipeline.mesh->lods[level-1];
+			glDrawArrays(pipeline.type, lod.start, lod.count);
+		} else if (whole_mesh && pipeline.mesh->cluster_count != 0) {
+			//...one cluster at a time:
+			draw_visible_clusters(*pipeline.mesh, pipeline.type, object_to_clip, pipeline.cull_back_facing_clusters);
+		} else {
+			glDrawArrays(pipeline.type, pipeline.start, pipeline.count);
+		}
 
 		//un-bind textures:
 		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
@@ -169,10 +283,13 @@ void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_lig
 void Scene::load(std::string const &filename,
 	std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable) {
 
-	std::ifstream file(filename, std::ios::binary);
+	//chunks are read in place from the mapped file (or pack):
+	std::shared_ptr< DataFile const > contents = vfs_read(filename);
+	ChunkFile file(contents->data, contents->size, contents);
+	file.validate();
 
-	std::vector< char > names;
-	read_chunk(file, "str0", &names);
+	ChunkView< char > names;
+	file.read("str0", &names);
 
 	struct HierarchyEntry {
 		uint32_t parent;
@@ -183,8 +300,8 @@ void Scene::load(std::string const &filename,
 		glm::vec3 scale;
 	};
 	static_assert(sizeof(HierarchyEntry) == 4 + 4 + 4 + 4*3 + 4*4 + 4*3, "HierarchyEntry is packed.");
-	std::vector< HierarchyEntry > hierarchy;
-	read_chunk(file, "xfh0", &hierarchy);
+	ChunkView< HierarchyEntry > hierarchy;
+	file.read("xfh0", &hierarchy);
 
 	struct MeshEntry {
 		uint32_t transform;
@@ -192,8 +309,8 @@ void Scene::load(std::string const &filename,
 		uint32_t name_end;
 	};
 	static_assert(sizeof(MeshEntry) == 4 + 4 + 4, "MeshEntry is packed.");
-	std::vector< MeshEntry > meshes;
-	read_chunk(file, "msh0", &meshes);
+	ChunkView< MeshEntry > meshes;
+	file.read("msh0", &meshes);
 
 	struct CameraEntry {
 		uint32_t transform;
@@ -202,8 +319,8 @@ void Scene::load(std::string const &filename,
 		float clip_near, clip_far;
 	};
 	static_assert(sizeof(CameraEntry) == 4 + 4 + 4 + 4 + 4, "CameraEntry is packed.");
-	std::vector< CameraEntry > cameras;
-	read_chunk(file, "cam0", &cameras);
+	ChunkView< CameraEntry > cameras;
+	file.read_optional("cam0", &cameras);
 
 	struct LightEntry {
 		uint32_t transform;
@@ -214,8 +331,8 @@ void Scene::load(std::string const &filename,
 		float fov;
 	};
 	static_assert(sizeof(LightEntry) == 4 + 1 + 3 + 4 + 4 + 4, "LightEntry is packed.");
-	std::vector< LightEntry > lights;
-	read_chunk(file, "lmp0", &lights);
+	ChunkView< LightEntry > lights;
+	file.read_optional("lmp0", &lights);
 
 
 	//--------------------------------
@@ -304,7 +421,7 @@ void Scene::load(std::string const &filename,
 	//load any extra that a subclass wants:
 	load_extra(file, names, hierarchy_transforms);
 
-	if (file.peek() != EOF) {
+	if (file.trailing != 0) {
 		std::cerr << "WARNING: trailing data in scene file '" << filename << "'" << std::endl;
 	}
 
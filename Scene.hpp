@@ -11,6 +11,7 @@
  */
 
 #include "GL.hpp"
+#include "Mesh.hpp"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
@@ -22,6 +23,10 @@
 #include <vector>
 #include <unordered_map>
 
+//(see ChunkFile.hpp and read_write_chunk.hpp)
+struct ChunkFile;
+template< typename T > struct ChunkView;
+
 struct Scene {
 	struct Transform {
 		//Transform names are useful for debugging and looking up locations in a loaded scene:
@@ -65,6 +70,13 @@ struct Scene {
 			GLuint start = 0; //first vertex to draw; passed to glDrawArrays
 			GLuint count = 0; //number of vertices to draw; passed to glDrawArrays
 
+			//(optional) mesh being drawn; if it has clusters, only clusters inside the view frustum are drawn;
+			// if it has levels of detail, a simplified version may be drawn when it is small on screen:
+			Mesh const *mesh = nullptr;
+			//also skip clusters that face entirely away from the camera:
+			// (only safe if GL_CULL_FACE is enabled or the mesh is closed)
+			bool cull_back_facing_clusters = false;
+
 			//uniforms:
 			GLuint OBJECT_TO_CLIP_mat4 = -1U; //uniform location for object to clip space matrix
 			GLuint OBJECT_TO_LIGHT_mat4x3 = -1U; //uniform location for object to light space (== world space) matrix
@@ -91,6 +103,10 @@ struct Scene {
 		float fovy = glm::radians(60.0f); //vertical fov (in radians)
 		float aspect = 1.0f; //x / y
 		float near = 0.01f; //near plane
+
+		//largest acceptable level-of-detail error, as a fraction of the viewport height:
+		// (default is about one pixel at 720p)
+		float lod_error = 1.0f / 720.0f;
 		//computed from the above:
 		glm::mat4 make_projection() const;
 	};
@@ -126,7 +142,15 @@ struct Scene {
 	void draw(Camera const &camera) const;
 
 	//..sometimes, you want to draw with a custom projection matrix and/or light space:
-	void draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light = glm::mat4x3(1.0f)) const;
+	// (levels of detail are only used if 'lod_camera' is given)
+	void draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light = glm::mat4x3(1.0f), Camera const *lod_camera = nullptr) const;
+
+	//the choices draw() makes for each mesh (these don't touch OpenGL, so bench-lods can time them):
+	//pick a level of detail for 'mesh' (0 is the mesh itself, i > 0 is mesh.lods[i-1]):
+	static uint32_t select_lod(Mesh const &mesh, glm::mat4x3 const &object_to_world, glm::vec3 const &eye, Camera const &camera);
+	//find the vertex ranges of the clusters of 'mesh' that are inside the view frustum (and, optionally, not back-facing),
+	// merging clusters that are adjacent in the buffer:
+	static void gather_visible_clusters(Mesh const &mesh, glm::mat4 const &object_to_clip, bool cull_back_facing, std::vector< GLint > *firsts, std::vector< GLsizei > *counts);
 
 	//add transforms/objects/cameras from a scene file to this scene:
 	// the 'on_drawable' callback gives your code a chance to look up mesh data and make Drawables:
@@ -137,7 +161,8 @@ struct Scene {
 
 	//this function is called to read extra chunks from the scene file after the main chunks are read:
 	// this is useful if you, e.g., subclassing scene to represent a game level/area
-	virtual void load_extra(std::istream &from, std::vector< char > const &str0, std::vector< Transform * > const &xfh0) { }
+	// (look chunks up by magic number with from.read() or from.read_optional(); see ChunkFile.hpp)
+	virtual void load_extra(ChunkFile const &from, ChunkView< char > const &str0, std::vector< Transform * > const &xfh0) { }
 
 	//empty scene:
 	Scene() = default;
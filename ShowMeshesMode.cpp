@@ -31,7 +31,7 @@ ShowMeshesMode::ShowMeshesMode(MeshBuffer const &buffer_) : buffer(buffer_) {
 	}
 
 	//select first mesh in buffer:
-	select_prev_mesh();
+	select_mesh(0);
 }
 
 ShowMeshesMode::~ShowMeshesMode() {
@@ -148,52 +148,42 @@ void ShowMeshesMode::draw(glm::uvec2 const &drawable_size) {
 			0.15f * glm::vec3(0.0f, 1.0f, 0.0f),
 			glm::u8vec4(0xff, 0xff, 0xff, 0xff)
 		);
+
+		//mesh statistics:
+		draw_lines.draw_text(current_mesh_stats,
+			current_mesh_min + glm::vec3(0.0f, -0.35f, 0.0f),
+			0.1f * glm::vec3(1.0f, 0.0f, 0.0f),
+			0.1f * glm::vec3(0.0f, 1.0f, 0.0f),
+			glm::u8vec4(0xdd, 0xdd, 0xdd, 0xff)
+		);
 	}
 }
 
 void ShowMeshesMode::select_prev_mesh() {
-	auto f = buffer.meshes.find(current_mesh_name);
-	if (f != buffer.meshes.end()) --f;
-	if (f == buffer.meshes.end()) f = buffer.meshes.begin();
-
-	if (f != buffer.meshes.end()) {
-		current_mesh_name = f->first;
-		scene_drawable->pipeline.type = f->second.type;
-		scene_drawable->pipeline.start = f->second.start;
-		scene_drawable->pipeline.count = f->second.count;
-		current_mesh_min = f->second.min;
-		current_mesh_max = f->second.max;
-	} else {
-		current_mesh_name = "";
-		scene_drawable->pipeline.type = GL_TRIANGLES;
-		scene_drawable->pipeline.start = 0;
-		scene_drawable->pipeline.count = 0;
-		current_mesh_min = glm::vec3(0.0f);
-		current_mesh_max = glm::vec3(0.0f);
-	}
+	select_mesh(current_mesh_index > 0 ? current_mesh_index - 1 : 0);
 }
 
 void ShowMeshesMode::select_next_mesh() {
-	auto f = buffer.meshes.find(current_mesh_name);
-	if (f != buffer.meshes.end()) ++f;
-	if (f == buffer.meshes.end()) {
-		auto temp = buffer.meshes.rbegin();
-		if (temp != buffer.meshes.rend()) {
-			++temp;
-			f = temp.base();
-			assert(f != buffer.meshes.end());
-		}
-	}
+	select_mesh(current_mesh_index + 1 < buffer.names.size() ? current_mesh_index + 1 : current_mesh_index);
+}
 
-	if (f != buffer.meshes.end()) {
-		current_mesh_name = f->first;
-		scene_drawable->pipeline.type = f->second.type;
-		scene_drawable->pipeline.start = f->second.start;
-		scene_drawable->pipeline.count = f->second.count;
-		current_mesh_min = f->second.min;
-		current_mesh_max = f->second.max;
+void ShowMeshesMode::select_mesh(uint32_t index) {
+	if (index < buffer.names.size()) {
+		MeshBuffer::Name const &name = buffer.names[index];
+		Mesh const &mesh = buffer.get(name.handle);
+		current_mesh_index = index;
+		current_mesh_name = std::string(name.name);
+		current_mesh_stats = std::to_string(mesh.count / 3) + " triangles, area " + std::to_string(mesh.area);
+		if (mesh.degenerate_count) current_mesh_stats += ", " + std::to_string(mesh.degenerate_count) + " degenerate";
+		scene_drawable->pipeline.type = mesh.type;
+		scene_drawable->pipeline.start = mesh.start;
+		scene_drawable->pipeline.count = mesh.count;
+		current_mesh_min = mesh.min;
+		current_mesh_max = mesh.max;
 	} else {
+		current_mesh_index = 0;
 		current_mesh_name = "";
+		current_mesh_stats = "";
 		scene_drawable->pipeline.type = GL_TRIANGLES;
 		scene_drawable->pipeline.start = 0;
 		scene_drawable->pipeline.count = 0;
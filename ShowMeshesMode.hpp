@@ -30,12 +30,15 @@ struct ShowMeshesMode : Mode {
 	//MeshBuffer being viewed:
 	MeshBuffer const &buffer;
 
-	//currently selected mesh:
+	//currently selected mesh (as a position in buffer.names, which is sorted by name):
+	uint32_t current_mesh_index = 0;
 	std::string current_mesh_name = "";
+	std::string current_mesh_stats = ""; //triangle count, area, etc.
 	glm::vec3 current_mesh_min = glm::vec3(0.0f);
 	glm::vec3 current_mesh_max = glm::vec3(0.0f);
 	void select_prev_mesh();
 	void select_next_mesh();
+	void select_mesh(uint32_t index);
 	
 	//Vertex array object used to bind mesh buffer for drawing:
 	GLuint vao = 0;
@@ -1,28 +1,326 @@
 #include "Sound.hpp"
 #include "load_wav.hpp"
 #include "load_opus.hpp"
+#include "audio_cache.hpp"
+#include "resample.hpp"
+#include "audio_effects.hpp"
 
 #include <SDL.h>
 
-#include <list>
 #include <cassert>
 #include <exception>
 #include <iostream>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SOUND_USE_SSE
+#endif
 
 //local (to this file) data used by the audio system:
 namespace {
 
 	//handy constants:
 	constexpr uint32_t const AUDIO_RATE = 48000; //sampling rate
-	constexpr uint32_t const MIX_SAMPLES = 1024; //number of samples to mix per call of mix_audio callback; n.b. SDL requires this to be a power of two
+	constexpr uint32_t const MAX_MIX_SAMPLES = 2048; //largest block (see Sound::init())
+	uint32_t mix_samples = Sound::DefaultBlockFrames; //number of samples to mix per call of mix_audio callback; n.b. SDL requires this to be a power of two
 
 	//The audio device:
 	SDL_AudioDeviceID device = 0;
 
-	//list of all currently playing samples:
-	std::list< std::shared_ptr< Sound::PlayingSample > > playing_samples;
+	//when there is no device, render_offline() mixes a block at a time into this buffer
+	// and hands it out as requested:
+	float offline_block[MAX_MIX_SAMPLES * 2];
+	uint32_t offline_used = Sound::DefaultBlockFrames; //frames of offline_block already handed out (all of it when equal to mix_samples)
+	//with NullDevice::callbacks set, offline blocks are timed as callbacks, and render_offline() holds this while mixing:
+	bool offline_callbacks = false;
+	std::mutex offline_mutex;
+
+	//fixed number of voices available for playing samples:
+	constexpr uint32_t const MAX_VOICES = 4096;
+
+	//at most this many voices are mixed per block (by default; see Sound::set_voice_budget()):
+	// the rest are 'virtual' -- their playback advances, but they aren't heard.
+	constexpr uint32_t const DEFAULT_VOICE_BUDGET = 64;
+
+	//fixed number of buses (including "master") and of reverb units they can use:
+	constexpr uint32_t const MAX_BUSES = 16;
+	constexpr uint32_t const MAX_REVERBS = 4;
+
+	//length of each voice's interaural delay line (enough for the longest head_delay, plus interpolation):
+	constexpr uint32_t const ITD_HISTORY = 48;
+
+	//A 'Voice' holds the playback state of one playing sample:
+	struct Voice {
+		//incremented (by the audio thread) whenever the voice finishes playing:
+		std::atomic< uint32_t > generation{0};
+
+		//everything else is written by the game thread while the voice is free,
+		// and then belongs to the audio thread once the 'Play' command is sent:
+		float const *data = nullptr; //sample data being played (or nullptr if playing a stream)
+		uint32_t size = 0; //number of values in 'data'
+		OpusStream *stream = nullptr; //stream being played (or nullptr if playing sample data)
+		uint32_t i = 0; //next data value to read
+		float fraction = 0.0f; //...plus this fraction of a value (when playing at a rate other than one)
+		Interpolation interpolation = Interpolation::Cubic; //how values between samples are read
+		bool loop = false; //should playback loop after data runs out?
+		bool stopping = false; //is playing stopping?
+		bool in_3D = false; //panned by 'position' (3D) rather than 'pan' (2D)?
+		Voice *next = nullptr; //next voice in the list of voices being mixed
+		bool audible = true; //mixed this block? (set by prioritize_voices(); otherwise, voice is virtual)
+		bool was_audible = true; //mixed last block? (if not, fades in when mixed again)
+		uint32_t bus = 0; //bus this voice is mixed into (index into 'buses')
+
+		Sound::Ramp< float > volume = Sound::Ramp< float >(1.0f);
+
+		//data values to advance per output value:
+		Sound::Ramp< float > rate = Sound::Ramp< float >(1.0f);
+
+		//2D playback panning control:
+		Sound::Ramp< float > pan = Sound::Ramp< float >(0.0f);
+
+		//3D playback panning control:
+		Sound::Ramp< glm::vec3 > position = Sound::Ramp< glm::vec3 >(0.0f);
+		Sound::Ramp< float > half_volume_radius = Sound::Ramp< float >(1.0f);
+
+		//3D spatialization (see Sound::Spatialization), for this block (set by spatialize_voices()):
+		float itd_start = 0.0f, itd_end = 0.0f; //interaural delay, in samples (positive delays the left ear, negative the right)
+		float air_start = 1.0f, air_end = 1.0f; //air absorption low-pass coefficient (1 = no filtering)
+		float doppler_start = 1.0f, doppler_end = 1.0f; //Doppler shift (playback rate multiplier)
+		//...and state carried between blocks:
+		float air_state = 0.0f; //low-pass filter output
+		float history[ITD_HISTORY]; //the most recent mono values mixed (read by the interaural delay)
+	};
+	Voice voices[MAX_VOICES];
+
+	//A 'Bus' collects the output of voices (and of child buses), applies effects and gain, and mixes the result into its parent:
+	// (only touched by the audio thread; set up by commands from the game thread)
+	struct Bus {
+		uint32_t parent = 0; //index into 'buses' (always less than this bus's index; unused by "master")
+		Sound::Ramp< float > gain = Sound::Ramp< float >(1.0f);
+
+		LowPass low_pass;
 
+		Reverb *reverb = nullptr; //reverb unit from 'reverbs' (if reverb is on)
+		float reverb_wet = 0.0f;
+
+		//ducking by the level of another bus:
+		uint32_t sidechain = -1U; //index into 'buses' (or -1U if ducking is off)
+		float duck_threshold = 0.0f;
+		float duck_depth = 1.0f;
+		float duck_attack = 0.0f;
+		float duck_release = 0.0f;
+		float duck = 1.0f; //current ducking gain
+
+		float level = 0.0f; //RMS level of the most recent block (after gain; used by buses that duck with this one)
+
+		//audio mixed into this bus during the current block (unused by "master", which mixes directly into the output):
+		alignas(16) float buffer[MAX_MIX_SAMPLES * 2];
+	};
+	Bus buses[MAX_BUSES];
+	uint32_t bus_count = 1; //buses in use (only touched by the audio thread; bus 0 is "master")
+
+	Reverb reverbs[MAX_REVERBS];
+
+	//Single-producer, single-consumer lock-free ring buffer:
+	template< typename T, uint32_t Size >
+	struct SPSCQueue {
+		static_assert((Size & (Size-1)) == 0, "Size must be a power of two");
+		T slots[Size];
+		alignas(64) std::atomic< uint32_t > head{0}; //next slot to write (only advanced by producer)
+		alignas(64) std::atomic< uint32_t > tail{0}; //next slot to read (only advanced by consumer)
+
+		//returns false if the queue is full:
+		bool push(T const &value) {
+			uint32_t h = head.load(std::memory_order_relaxed);
+			if (h - tail.load(std::memory_order_acquire) == Size) return false;
+			slots[h & (Size-1)] = value;
+			head.store(h + 1, std::memory_order_release);
+			return true;
+		}
+
+		//returns nullptr if the queue is empty; call pop() once done with the value:
+		T const *peek() {
+			uint32_t t = tail.load(std::memory_order_relaxed);
+			if (t == head.load(std::memory_order_acquire)) return nullptr;
+			return &slots[t & (Size-1)];
+		}
+		void pop() {
+			tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		}
+	};
+
+	//Changes requested by the game thread, applied by the audio thread at the start of each mix_audio block:
+	struct Command {
+		enum Type : uint8_t {
+			Play, //start mixing 'voice'
+			SetVolume, SetPan, SetPosition, SetHalfVolumeRadius, SetRate, SetInterpolation, SetBus, Stop, //change 'voice'
+			AddBus, SetBusGain, SetBusLowPass, SetBusReverb, SetBusDucking, //change 'bus'
+			StopAll, SetGlobalVolume, SetListener, SetVoiceBudget, SetSpatialization //change global state
+		} type = Play;
+		uint32_t voice = -1U;
+		uint32_t bus = 0;
+		uint32_t generation = 0; //command is ignored if the voice has since finished
+		glm::vec3 value = glm::vec3(0.0f); //(scalar values use value.x; spatialization uses all three)
+		glm::vec3 value2 = glm::vec3(0.0f); //(listener right direction; extra bus parameters)
+		float ramp = 0.0f;
+	};
+	SPSCQueue< Command, 16384 > commands; //game thread -> audio thread
+
+	//voices that have finished playing, handed back to the game thread for re-use:
+	// (can't overflow, since each voice is in here at most once)
+	SPSCQueue< uint32_t, MAX_VOICES > finished_voices; //audio thread -> game thread
+
+	//voices not currently in use (only touched by the game thread):
+	std::vector< uint32_t > &get_free_voices() {
+		static std::vector< uint32_t > free_voices = [](){
+			std::vector< uint32_t > ret;
+			ret.reserve(MAX_VOICES);
+			for (uint32_t v = 0; v < MAX_VOICES; ++v) {
+				ret.emplace_back(MAX_VOICES - 1 - v);
+			}
+			return ret;
+		}();
+		return free_voices;
+	}
+
+	//the game thread's view of the buses (only touched by the game thread; same order as 'buses'):
+	struct BusSetup {
+		std::string name;
+		uint32_t reverb = -1U; //index into 'reverbs' of the unit this bus uses (or -1U if none)
+	};
+	std::vector< BusSetup > &get_bus_setups() {
+		static std::vector< BusSetup > bus_setups = [](){
+			std::vector< BusSetup > ret;
+			ret.reserve(MAX_BUSES);
+			ret.emplace_back(BusSetup{"master"});
+			return ret;
+		}();
+		return bus_setups;
+	}
+
+	//index of the bus named 'name' (or -1U, after printing a warning, if there is no such bus):
+	uint32_t find_bus(std::string const &name) {
+		std::vector< BusSetup > const &bus_setups = get_bus_setups();
+		for (uint32_t b = 0; b < bus_setups.size(); ++b) {
+			if (bus_setups[b].name == name) return b;
+		}
+		std::cerr << "WARNING: no audio bus named '" << name << "'." << std::endl;
+		return -1U;
+	}
+
+	//list of voices being mixed, linked through Voice::next (only touched by the audio thread):
+	Voice *mixing_voices = nullptr;
+
+	//maximum number of voices actually mixed per block (only touched by the audio thread):
+	uint32_t voice_budget = DEFAULT_VOICE_BUDGET;
+
+	//3D voice settings (only touched by the audio thread):
+	Sound::Spatialization spatialization;
+
+	//statistics written by the audio thread (and read, without locking, by Sound::get_stats()):
+	constexpr uint32_t const STATS_BUCKETS = uint32_t(std::tuple_size< decltype(Sound::Stats::mix_histogram) >::value);
+	constexpr uint32_t const STATS_HISTORY = uint32_t(std::tuple_size< decltype(Sound::Stats::mix_ms) >::value);
+	struct AudioStats {
+		std::atomic< uint32_t > mix_histogram[STATS_BUCKETS];
+		std::atomic< float > mix_ms[STATS_HISTORY];
+		std::atomic< float > worst_mix_ms{0.0f};
+		std::atomic< uint64_t > blocks{0}; //(also the next slot to write in mix_ms, modulo its size)
+		std::atomic< uint32_t > voices_playing{0};
+		std::atomic< uint32_t > voices_mixed{0};
+		std::atomic< float > peak{0.0f}; //(reset by get_stats())
+		std::atomic< uint32_t > late_callbacks{0};
+		std::atomic< float > worst_interval_ms{0.0f};
+
+		//only used by the audio thread:
+		std::chrono::steady_clock::time_point last_callback;
+		bool have_last_callback = false;
+
+		AudioStats() {
+			for (auto &count : mix_histogram) count.store(0, std::memory_order_relaxed);
+			for (auto &ms : mix_ms) ms.store(0.0f, std::memory_order_relaxed);
+		}
+	} stats;
+
+	//apply a command to audio state (on the audio thread, or on the game thread if there is no audio thread):
+	void apply(Command const &command);
+
+	//send a command to the audio thread:
+	void send(Command const &command) {
+		if (device == 0) {
+			//no audio thread, so apply immediately:
+			apply(command);
+			return;
+		}
+		while (!commands.push(command)) {
+			//queue is full (audio thread stalled?); wait for it to drain:
+			SDL_Delay(1);
+		}
+	}
+
+	//grab a free voice, set it up to play 'sample' (or 'stream'), and send it to the audio thread:
+	Sound::PlayingSample start_playing(Sound::Sample const *sample, OpusStream *stream, float volume, float pan, glm::vec3 const &position, float half_volume_radius, bool in_3D, bool loop) {
+		std::vector< uint32_t > &free_voices = get_free_voices();
+
+		//reclaim voices that have finished:
+		while (uint32_t const *v = finished_voices.peek()) {
+			free_voices.emplace_back(*v);
+			finished_voices.pop();
+		}
+
+		Sound::PlayingSample handle;
+		if (free_voices.empty() || (sample && sample->size() == 0)) return handle;
+
+		handle.voice = free_voices.back();
+		free_voices.pop_back();
+
+		Voice &voice = voices[handle.voice];
+		handle.generation = voice.generation.load(std::memory_order_relaxed);
+		voice.data = sample ? sample->samples() : nullptr;
+		voice.size = sample ? uint32_t(sample->size()) : 0;
+		voice.stream = stream;
+		voice.i = 0;
+		voice.fraction = 0.0f;
+		voice.interpolation = Interpolation::Cubic;
+		voice.loop = loop;
+		voice.stopping = false;
+		voice.in_3D = in_3D;
+		voice.next = nullptr;
+		voice.audible = voice.was_audible = true;
+		voice.bus = 0;
+		voice.doppler_end = 1.0f;
+		voice.air_state = 0.0f;
+		std::fill(voice.history, voice.history + ITD_HISTORY, 0.0f);
+		voice.volume = Sound::Ramp< float >(volume);
+		voice.rate = Sound::Ramp< float >(1.0f);
+		voice.pan = Sound::Ramp< float >(pan);
+		voice.position = Sound::Ramp< glm::vec3 >(position);
+		voice.half_volume_radius = Sound::Ramp< float >(half_volume_radius);
+
+		Command command;
+		command.type = Command::Play;
+		command.voice = handle.voice;
+		command.generation = handle.generation;
+		send(command);
+
+		return handle;
+	}
+
+	void send_voice_command(Command::Type type, Sound::PlayingSample const &handle, glm::vec3 const &value, float ramp) {
+		if (handle.voice >= MAX_VOICES) return;
+		Command command;
+		command.type = type;
+		command.voice = handle.voice;
+		command.generation = handle.generation;
+		command.value = value;
+		command.ramp = ramp;
+		send(command);
+	}
 }
 
 //public-facing data:
@@ -42,7 +340,15 @@ Sound::Sample::Sample(std::string const &filename) {
 	if (filename.size() >= 4 && filename.substr(filename.size()-4) == ".wav") {
 		load_wav(filename, &data);
 	} else if (filename.size() >= 5 && filename.substr(filename.size()-5) == ".opus") {
-		load_opus(filename, &data);
+		CachedAudio cached;
+		if (find_cached_audio(filename, &cached)) {
+			mapped = cached.file;
+			mapped_samples = cached.samples;
+			mapped_count = cached.count;
+		} else {
+			load_opus(filename, &data);
+			store_cached_audio(filename, data);
+		}
 	} else {
 		throw std::runtime_error("Sample '" + filename + "' doesn't end in either \".png\" or \".opus\" -- unsure how to load.");
 	}
@@ -51,9 +357,31 @@ Sound::Sample::Sample(std::string const &filename) {
 Sound::Sample::Sample(std::vector< float > const &data_) : data(data_) {
 }
 
+Sound::Stream::Stream(std::string const &filename) {
+	if (filename.size() >= 5 && filename.substr(filename.size()-5) == ".opus") {
+		opus.reset(new OpusStream(filename));
+	} else {
+		throw std::runtime_error("Stream '" + filename + "' doesn't end in \".opus\" -- unsure how to stream.");
+	}
+}
+
+Sound::Stream::~Stream() {
+}
+
 
 
-void Sound::init() {
+//helper: check (and set) the block size:
+static void set_block_frames(uint32_t block_frames) {
+	if (block_frames < 64 || block_frames > MAX_MIX_SAMPLES || (block_frames & (block_frames - 1)) != 0) {
+		throw std::runtime_error("Sound: block size of " + std::to_string(block_frames) + " frames is not a power of two from 64 to " + std::to_string(MAX_MIX_SAMPLES) + ".");
+	}
+	mix_samples = block_frames;
+	offline_used = mix_samples;
+}
+
+void Sound::init(uint32_t block_frames) {
+	set_block_frames(block_frames);
+
 	if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) {
 		std::cerr << "Failed to initialize SDL audio subsytem:\n" << SDL_GetError() << std::endl;
 		std::cerr << "  (Will continue without audio.)\n" << std::endl;
@@ -66,7 +394,7 @@ void Sound::init() {
 	want.freq = AUDIO_RATE;
 	want.format = AUDIO_F32SYS;
 	want.channels = 2;
-	want.samples = MIX_SAMPLES;
+	want.samples = uint16_t(mix_samples);
 	want.callback = mix_audio;
 
 	device = SDL_OpenAudioDevice(nullptr, 0, &want, &have, 0);
@@ -76,10 +404,47 @@ void Sound::init() {
 	} else {
 		//start audio playback:
 		SDL_PauseAudioDevice(device, 0);
-		std::cout << "Audio output initialized." << std::endl;
+		std::cout << "Audio output initialized (" << mix_samples << "-frame blocks)." << std::endl;
+	}
+}
+
+
+void Sound::init(NullDevice null_device, uint32_t block_frames) {
+	if (device != 0) {
+		throw std::runtime_error("Sound::init(NullDevice) called while an audio device is open.");
 	}
+	set_block_frames(block_frames);
+	offline_callbacks = null_device.callbacks;
+	stats.have_last_callback = false;
+	std::cout << "Audio initialized without an output device (offline rendering only; " << mix_samples << "-frame blocks)." << std::endl;
 }
 
+void Sound::render_offline(float *out, uint32_t frames) {
+	if (device != 0) {
+		throw std::runtime_error("Sound::render_offline() can't be used while an audio device is open.");
+	}
+	std::unique_lock< std::mutex > guard(offline_mutex, std::defer_lock);
+	if (offline_callbacks) guard.lock();
+	while (frames > 0) {
+		if (offline_used == mix_samples && frames >= mix_samples) {
+			//mix whole blocks directly into the output:
+			mix_audio(nullptr, reinterpret_cast< Uint8 * >(out), mix_samples * 2 * sizeof(float));
+			out += mix_samples * 2;
+			frames -= mix_samples;
+			continue;
+		}
+		if (offline_used == mix_samples) {
+			mix_audio(nullptr, reinterpret_cast< Uint8 * >(offline_block), mix_samples * 2 * sizeof(float));
+			offline_used = 0;
+		}
+		//hand out (part of) the leftover block:
+		uint32_t count = std::min(frames, mix_samples - offline_used);
+		std::copy(offline_block + offline_used * 2, offline_block + (offline_used + count) * 2, out);
+		offline_used += count;
+		out += count * 2;
+		frames -= count;
+	}
+}
 
 void Sound::shutdown() {
 	if (device != 0) {
@@ -93,116 +458,265 @@ void Sound::shutdown() {
 
 void Sound::lock() {
 	if (device) SDL_LockAudioDevice(device);
+	else if (offline_callbacks) offline_mutex.lock();
 }
 
 void Sound::unlock() {
 	if (device) SDL_UnlockAudioDevice(device);
+	else if (offline_callbacks) offline_mutex.unlock();
 }
 
-std::shared_ptr< Sound::PlayingSample > Sound::play(Sample const &sample, float volume, float pan) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, volume, pan, false);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
-	return playing_sample;
+Sound::PlayingSample Sound::play(Sample const &sample, float volume, float pan) {
+	return start_playing(&sample, nullptr, volume, pan, glm::vec3(0.0f), 1.0f, false, false);
 }
 
-std::shared_ptr< Sound::PlayingSample > Sound::play_3D(Sample const &sample, float volume, glm::vec3 const &position, float half_volume_radius) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, volume, position, half_volume_radius, false);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
-	return playing_sample;
+Sound::PlayingSample Sound::play_3D(Sample const &sample, float volume, glm::vec3 const &position, float half_volume_radius) {
+	return start_playing(&sample, nullptr, volume, 0.0f, position, half_volume_radius, true, false);
 }
 
-std::shared_ptr< Sound::PlayingSample > Sound::loop(Sample const &sample, float volume, float pan) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, volume, pan, true);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
-	return playing_sample;
+Sound::PlayingSample Sound::loop(Sample const &sample, float volume, float pan) {
+	return start_playing(&sample, nullptr, volume, pan, glm::vec3(0.0f), 1.0f, false, true);
 }
 
 
 
-std::shared_ptr< Sound::PlayingSample > Sound::loop_3D(Sample const &sample, float volume, glm::vec3 const &position, float half_volume_radius) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, volume, position, half_volume_radius, true);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
-	return playing_sample;
+Sound::PlayingSample Sound::loop_3D(Sample const &sample, float volume, glm::vec3 const &position, float half_volume_radius) {
+	return start_playing(&sample, nullptr, volume, 0.0f, position, half_volume_radius, true, true);
 }
 
 
-void Sound::stop_all_samples() {
-	lock();
-	for (auto &s : playing_samples) {
-		s->stop();
+namespace {
+	Sound::PlayingSample start_streaming(Sound::Stream &stream, float volume, float pan, bool loop) {
+		if (!stream.playing.stopped()) {
+			std::cerr << "WARNING: Stream is already playing; it can't be played again until playback stops." << std::endl;
+			return Sound::PlayingSample();
+		}
+		//(decoder can be reset, since the audio thread is done reading from it)
+		stream.opus->restart(loop);
+		stream.playing = start_playing(nullptr, stream.opus.get(), volume, pan, glm::vec3(0.0f), 1.0f, false, loop);
+		return stream.playing;
 	}
-	unlock();
+}
+
+Sound::PlayingSample Sound::play(Stream &stream, float volume, float pan) {
+	return start_streaming(stream, volume, pan, false);
+}
+
+Sound::PlayingSample Sound::loop(Stream &stream, float volume, float pan) {
+	return start_streaming(stream, volume, pan, true);
+}
+
+void Sound::stop_all_samples() {
+	Command command;
+	command.type = Command::StopAll;
+	command.ramp = 1.0f / 60.0f;
+	send(command);
 }
 
 void Sound::set_volume(float new_volume, float ramp) {
-	lock();
-	volume.set(new_volume, ramp);
-	unlock();
+	Command command;
+	command.type = Command::SetGlobalVolume;
+	command.value.x = new_volume;
+	command.ramp = ramp;
+	send(command);
+}
+
+Sound::Stats Sound::get_stats() {
+	Stats ret;
+	ret.block_ms = 1000.0f * float(mix_samples) / float(AUDIO_RATE);
+	for (uint32_t b = 0; b < STATS_BUCKETS; ++b) {
+		ret.mix_histogram[b] = stats.mix_histogram[b].load(std::memory_order_relaxed);
+	}
+	//(the audio thread may write a new time while these are copied, so the oldest could be newer than expected; fine for a graph)
+	ret.blocks = stats.blocks.load(std::memory_order_acquire);
+	for (uint32_t i = 0; i < STATS_HISTORY; ++i) {
+		ret.mix_ms[i] = stats.mix_ms[(ret.blocks + i) % STATS_HISTORY].load(std::memory_order_relaxed);
+	}
+	ret.worst_mix_ms = stats.worst_mix_ms.load(std::memory_order_relaxed);
+	ret.voices_playing = stats.voices_playing.load(std::memory_order_relaxed);
+	ret.voices_mixed = stats.voices_mixed.load(std::memory_order_relaxed);
+	ret.peak = stats.peak.exchange(0.0f, std::memory_order_relaxed);
+	ret.late_callbacks = stats.late_callbacks.load(std::memory_order_relaxed);
+	ret.worst_interval_ms = stats.worst_interval_ms.load(std::memory_order_relaxed);
+	return ret;
+}
+
+uint32_t Sound::mix_histogram_bucket(float fraction) {
+	if (!(fraction > 0.0f)) return 0;
+	if (fraction >= 1.0f) return STATS_BUCKETS - 1;
+	//(bucket b starts at 2^(b-15) of the deadline)
+	int exponent = 0;
+	std::frexp(fraction, &exponent); //fraction = m * 2^exponent, with m in [0.5, 1)
+	return uint32_t(std::max(0, std::min(int(STATS_BUCKETS) - 2, exponent - 1 + int(STATS_BUCKETS) - 1)));
+}
+
+void Sound::set_spatialization(Spatialization const &spatialization_) {
+	Command command;
+	command.type = Command::SetSpatialization;
+	command.value = glm::vec3(spatialization_.head_delay, spatialization_.air_absorption, spatialization_.speed_of_sound);
+	send(command);
+}
+
+void Sound::set_voice_budget(uint32_t voices) {
+	Command command;
+	command.type = Command::SetVoiceBudget;
+	command.value.x = float(std::min(voices, MAX_VOICES));
+	send(command);
 }
 
 //------------------
 
-void Sound::PlayingSample::set_volume(float new_volume, float ramp) {
-	Sound::lock();
-	if (!stopping) {
-		volume.set(new_volume, ramp);
+bool Sound::add_bus(std::string const &name, std::string const &parent) {
+	std::vector< BusSetup > &bus_setups = get_bus_setups();
+	for (auto const &setup : bus_setups) {
+		if (setup.name == name) {
+			std::cerr << "WARNING: audio bus '" << name << "' already exists." << std::endl;
+			return false;
+		}
 	}
-	Sound::unlock();
+	uint32_t p = find_bus(parent);
+	if (p == -1U) return false;
+	if (bus_setups.size() == MAX_BUSES) {
+		std::cerr << "WARNING: can't add audio bus '" << name << "'; all " << MAX_BUSES << " buses are in use." << std::endl;
+		return false;
+	}
+	bus_setups.emplace_back(BusSetup{name});
+
+	Command command;
+	command.type = Command::AddBus;
+	command.bus = uint32_t(bus_setups.size() - 1);
+	command.value.x = float(p);
+	send(command);
+	return true;
 }
 
-void Sound::PlayingSample::set_pan(float new_pan, float ramp) {
-	if (!(pan.value == pan.value)) return; //ignore if not in '2D' mode
-	Sound::lock();
-	pan.set(new_pan, ramp);
-	Sound::unlock();
+void Sound::set_bus_gain(std::string const &name, float gain, float ramp) {
+	Command command;
+	command.type = Command::SetBusGain;
+	command.bus = find_bus(name);
+	if (command.bus == -1U) return;
+	command.value.x = gain;
+	command.ramp = ramp;
+	send(command);
 }
 
-void Sound::PlayingSample::set_position(glm::vec3 const &new_position, float ramp) {
-	if (pan.value == pan.value) return; //ignore if not in '3D' mode
-	Sound::lock();
-	position.set(new_position, ramp);
-	Sound::unlock();
+void Sound::set_bus_low_pass(std::string const &name, float cutoff_hz) {
+	Command command;
+	command.type = Command::SetBusLowPass;
+	command.bus = find_bus(name);
+	if (command.bus == -1U) return;
+	command.value.x = cutoff_hz;
+	send(command);
 }
 
-void Sound::PlayingSample::set_half_volume_radius(float new_radius, float ramp) {
-	if (pan.value == pan.value) return; //ignore if not in '3D' mode
-	Sound::lock();
-	half_volume_radius.set(new_radius, ramp);
-	Sound::unlock();
+bool Sound::set_bus_reverb(std::string const &name, float wet, float decay, float damping) {
+	uint32_t b = find_bus(name);
+	if (b == -1U) return false;
+	std::vector< BusSetup > &bus_setups = get_bus_setups();
+
+	//reverb units are handed out and returned here, on the game thread;
+	// the audio thread stops using a unit before it sees any later command that reuses it:
+	uint32_t &reverb = bus_setups[b].reverb;
+	if (wet <= 0.0f) {
+		reverb = -1U;
+	} else if (reverb == -1U) {
+		for (uint32_t r = 0; r < MAX_REVERBS && reverb == -1U; ++r) {
+			bool used = false;
+			for (auto const &setup : bus_setups) {
+				if (setup.reverb == r) used = true;
+			}
+			if (!used) reverb = r;
+		}
+		if (reverb == -1U) {
+			std::cerr << "WARNING: can't add reverb to audio bus '" << name << "'; all " << MAX_REVERBS << " reverb units are in use." << std::endl;
+			return false;
+		}
+	}
+
+	Command command;
+	command.type = Command::SetBusReverb;
+	command.bus = b;
+	command.value = glm::vec3(std::max(0.0f, wet), decay, damping);
+	command.value2.x = float(int32_t(reverb));
+	send(command);
+	return true;
 }
 
-void Sound::PlayingSample::stop(float ramp) {
-	Sound::lock();
-	if (!(stopping || stopped)) {
-		stopping = true;
-		volume.target = 0.0f;
-		volume.ramp = ramp;
-	} else {
-		volume.ramp = std::min(volume.ramp, ramp);
+void Sound::set_bus_ducking(std::string const &name, std::string const &sidechain, float threshold, float depth, float attack, float release) {
+	Command command;
+	command.type = Command::SetBusDucking;
+	command.bus = find_bus(name);
+	if (command.bus == -1U) return;
+	int32_t s = -1;
+	if (!sidechain.empty()) {
+		uint32_t b = find_bus(sidechain);
+		if (b == -1U) return;
+		if (b == command.bus) {
+			std::cerr << "WARNING: audio bus '" << name << "' can't duck itself." << std::endl;
+			return;
+		}
+		s = int32_t(b);
 	}
-	Sound::unlock();
+	command.value = glm::vec3(threshold, depth, attack);
+	command.value2 = glm::vec3(release, float(s), 0.0f);
+	send(command);
+}
+
+//------------------
+
+void Sound::PlayingSample::set_volume(float new_volume, float ramp) const {
+	send_voice_command(Command::SetVolume, *this, glm::vec3(new_volume, 0.0f, 0.0f), ramp);
+}
+
+void Sound::PlayingSample::set_pan(float new_pan, float ramp) const {
+	send_voice_command(Command::SetPan, *this, glm::vec3(new_pan, 0.0f, 0.0f), ramp);
+}
+
+void Sound::PlayingSample::set_position(glm::vec3 const &new_position, float ramp) const {
+	send_voice_command(Command::SetPosition, *this, new_position, ramp);
+}
+
+void Sound::PlayingSample::set_half_volume_radius(float new_radius, float ramp) const {
+	send_voice_command(Command::SetHalfVolumeRadius, *this, glm::vec3(new_radius, 0.0f, 0.0f), ramp);
+}
+
+void Sound::PlayingSample::set_rate(float new_rate, float ramp) const {
+	send_voice_command(Command::SetRate, *this, glm::vec3(std::max(0.0f, new_rate), 0.0f, 0.0f), ramp);
+}
+
+void Sound::PlayingSample::set_interpolation(Interpolation interpolation) const {
+	send_voice_command(Command::SetInterpolation, *this, glm::vec3(float(interpolation), 0.0f, 0.0f), 0.0f);
+}
+
+void Sound::PlayingSample::set_bus(std::string const &bus) const {
+	uint32_t b = find_bus(bus);
+	if (b == -1U) return;
+	send_voice_command(Command::SetBus, *this, glm::vec3(float(b), 0.0f, 0.0f), 0.0f);
+}
+
+void Sound::PlayingSample::stop(float ramp) const {
+	send_voice_command(Command::Stop, *this, glm::vec3(0.0f), ramp);
+}
+
+bool Sound::PlayingSample::stopped() const {
+	if (voice >= MAX_VOICES) return true;
+	return voices[voice].generation.load(std::memory_order_acquire) != generation;
 }
 
 //------------------
 
 void Sound::Listener::set_position_right(glm::vec3 const &new_position, glm::vec3 const &new_right, float ramp) {
-	Sound::lock();
-	position.set(new_position, ramp);
+	Command command;
+	command.type = Command::SetListener;
+	command.value = new_position;
 	//some extra code to make sure right is always a unit vector:
 	if (new_right == glm::vec3(0.0f)) {
-		right.set(glm::vec3(1.0f, 0.0f, 0.0f), ramp);
+		command.value2 = glm::vec3(1.0f, 0.0f, 0.0f);
 	} else {
-		right.set(glm::normalize(new_right), ramp);
+		command.value2 = glm::normalize(new_right);
 	}
-	Sound::unlock();
+	command.ramp = ramp;
+	send(command);
 }
 
 //------------------------ internals --------------------------------
@@ -252,33 +766,40 @@ void compute_pan_from_listener_and_position(
 }
 
 //helper: ramp updates...
-constexpr float const RAMP_STEP = float(MIX_SAMPLES) / float(AUDIO_RATE);
+// ramps advance a given number of frames at a time, and finish on a whole frame -- the one nearest their end time --
+// so the mixer can split a block where a ramp finishes and each ramp is exact whatever the block size:
+uint32_t ramp_frames(float seconds) { //frames left in a ramp
+	return (seconds > 0.0f ? uint32_t(std::min(std::round(seconds * float(AUDIO_RATE)), 4.0e9f)) : 0);
+}
 
 //helper: ...for single values:
-void step_value_ramp(Sound::Ramp< float > &ramp) {
-	if (ramp.ramp < RAMP_STEP) {
+void step_value_ramp(Sound::Ramp< float > &ramp, uint32_t frames) {
+	uint32_t left = ramp_frames(ramp.ramp);
+	if (left <= frames) {
 		ramp.value = ramp.target;
 		ramp.ramp = 0.0f;
 	} else {
-		ramp.value += (RAMP_STEP / ramp.ramp) * (ramp.target - ramp.value);
-		ramp.ramp -= RAMP_STEP;
+		ramp.value += (float(frames) / float(left)) * (ramp.target - ramp.value);
+		ramp.ramp -= float(frames) / float(AUDIO_RATE);
 	}
 }
 
 //helper: ...for 3D positions:
-void step_position_ramp(Sound::Ramp< glm::vec3 > &ramp) {
-	if (ramp.ramp < RAMP_STEP) {
+void step_position_ramp(Sound::Ramp< glm::vec3 > &ramp, uint32_t frames) {
+	uint32_t left = ramp_frames(ramp.ramp);
+	if (left <= frames) {
 		ramp.value = ramp.target;
 		ramp.ramp = 0.0f;
 	} else {
-		ramp.value = glm::mix(ramp.value, ramp.target, RAMP_STEP / ramp.ramp);
-		ramp.ramp -= RAMP_STEP;
+		ramp.value = glm::mix(ramp.value, ramp.target, float(frames) / float(left));
+		ramp.ramp -= float(frames) / float(AUDIO_RATE);
 	}
 }
 
 //helper: ...for 3D directions:
-void step_direction_ramp(Sound::Ramp< glm::vec3 > &ramp) {
-	if (ramp.ramp < RAMP_STEP) {
+void step_direction_ramp(Sound::Ramp< glm::vec3 > &ramp, uint32_t frames) {
+	uint32_t left = ramp_frames(ramp.ramp);
+	if (left <= frames) {
 		ramp.value = ramp.target;
 		ramp.ramp = 0.0f;
 	} else {
@@ -302,15 +823,440 @@ void step_direction_ramp(Sound::Ramp< glm::vec3 > &ramp) {
 		float angle = std::acos(glm::clamp(glm::dot(ramp.value, ramp.target), -1.0f, 1.0f));
 
 		//figure out new target value by moving angle toward target:
-		angle *= (ramp.ramp - RAMP_STEP) / ramp.ramp;
+		angle *= float(left - frames) / float(left);
 
 		ramp.value = ramp.target * std::cos(angle) + perp * std::sin(angle);
-		ramp.ramp -= RAMP_STEP;
+		ramp.ramp -= float(frames) / float(AUDIO_RATE);
+	}
+}
+
+//helper: end of a run of frames starting at 'begin' -- 'end', or sooner if a ramp with 'seconds' left finishes first:
+uint32_t run_end(uint32_t begin, uint32_t end, float seconds) {
+	uint32_t left = ramp_frames(seconds);
+	return (left > 0 && left < end - begin ? begin + left : end);
+}
+
+namespace {
+
+//helper: stop a playing voice (fading out over 'ramp' seconds):
+void stop_voice(Voice &voice, float ramp) {
+	if (!voice.stopping) {
+		voice.stopping = true;
+		voice.volume.target = 0.0f;
+		voice.volume.ramp = ramp;
+	} else {
+		voice.volume.ramp = std::min(voice.volume.ramp, ramp);
+	}
+}
+
+void apply(Command const &command) {
+	Voice *voice = nullptr;
+	if (command.voice < MAX_VOICES) {
+		voice = &voices[command.voice];
+		//commands for voices that have since finished (and maybe been re-used) are ignored:
+		if (voice->generation.load(std::memory_order_relaxed) != command.generation) return;
+	}
+
+	if (command.type == Command::Play) {
+		assert(voice);
+		voice->next = mixing_voices;
+		mixing_voices = voice;
+	} else if (command.type == Command::SetVolume) {
+		if (!voice->stopping) {
+			voice->volume.set(command.value.x, command.ramp);
+		}
+	} else if (command.type == Command::SetPan) {
+		if (!voice->in_3D) voice->pan.set(command.value.x, command.ramp); //ignore if not in '2D' mode
+	} else if (command.type == Command::SetPosition) {
+		if (voice->in_3D) voice->position.set(command.value, command.ramp); //ignore if not in '3D' mode
+	} else if (command.type == Command::SetHalfVolumeRadius) {
+		if (voice->in_3D) voice->half_volume_radius.set(command.value.x, command.ramp); //ignore if not in '3D' mode
+	} else if (command.type == Command::SetRate) {
+		if (voice->data) voice->rate.set(command.value.x, command.ramp); //ignore if playing a stream
+	} else if (command.type == Command::SetInterpolation) {
+		voice->interpolation = Interpolation(uint8_t(command.value.x));
+	} else if (command.type == Command::SetBus) {
+		voice->bus = uint32_t(command.value.x);
+	} else if (command.type == Command::Stop) {
+		stop_voice(*voice, command.ramp);
+	} else if (command.type == Command::AddBus) {
+		assert(command.bus == bus_count && "buses are added in order");
+		buses[command.bus].parent = uint32_t(command.value.x);
+		bus_count += 1;
+	} else if (command.type == Command::SetBusGain) {
+		buses[command.bus].gain.set(command.value.x, command.ramp);
+	} else if (command.type == Command::SetBusLowPass) {
+		buses[command.bus].low_pass.set_cutoff(command.value.x, AUDIO_RATE);
+	} else if (command.type == Command::SetBusReverb) {
+		Bus &bus = buses[command.bus];
+		int32_t r = int32_t(command.value2.x);
+		Reverb *reverb = (r >= 0 ? &reverbs[r] : nullptr);
+		if (reverb && reverb != bus.reverb) reverb->clear(); //(newly attached, so clear any old tail)
+		bus.reverb = reverb;
+		bus.reverb_wet = command.value.x;
+		if (reverb) reverb->set(command.value.y, command.value.z, AUDIO_RATE);
+	} else if (command.type == Command::SetBusDucking) {
+		Bus &bus = buses[command.bus];
+		int32_t s = int32_t(command.value2.y);
+		bus.sidechain = (s >= 0 ? uint32_t(s) : -1U);
+		bus.duck_threshold = command.value.x;
+		bus.duck_depth = command.value.y;
+		bus.duck_attack = command.value.z;
+		bus.duck_release = command.value2.x;
+		if (bus.sidechain == -1U) bus.duck = 1.0f;
+	} else if (command.type == Command::StopAll) {
+		for (Voice *v = mixing_voices; v; v = v->next) {
+			stop_voice(*v, command.ramp);
+		}
+	} else if (command.type == Command::SetGlobalVolume) {
+		Sound::volume.set(command.value.x, command.ramp);
+	} else if (command.type == Command::SetVoiceBudget) {
+		voice_budget = uint32_t(command.value.x);
+	} else if (command.type == Command::SetSpatialization) {
+		//(head delay is limited by the length of the voices' delay lines)
+		spatialization.head_delay = std::max(0.0f, std::min(float(ITD_HISTORY - 2) / float(AUDIO_RATE), command.value.x));
+		spatialization.air_absorption = std::max(0.0f, command.value.y);
+		spatialization.speed_of_sound = std::max(0.0f, command.value.z);
+	} else if (command.type == Command::SetListener) {
+		Sound::listener.position.set(command.value, command.ramp);
+		Sound::listener.right.set(command.value2, command.ramp);
+	} else {
+		assert(0 && "unknown command type");
+	}
+}
+
+//helper: add 'count' mono samples from 'in' to stereo (interleaved left/right) 'out',
+// with gains starting at (l, r) and changing by (l_step, r_step) each sample:
+void mix_run(float *out, float const *in, uint32_t count, float l, float r, float l_step, float r_step) {
+	uint32_t i = 0;
+#ifdef SOUND_USE_SSE
+	//four samples per iteration; each register holds two (left, right) output pairs:
+	// (gains are computed from the run start rather than accumulated, so they don't drift)
+	__m128 const start = _mm_setr_ps(l, r, l, r);
+	__m128 const step = _mm_setr_ps(l_step, r_step, l_step, r_step);
+	__m128 index_lo = _mm_setr_ps(0.0f, 0.0f, 1.0f, 1.0f);
+	__m128 index_hi = _mm_setr_ps(2.0f, 2.0f, 3.0f, 3.0f);
+	__m128 const four = _mm_set1_ps(4.0f);
+	for (; i + 4 <= count; i += 4) {
+		__m128 x = _mm_loadu_ps(in + i); //(a, b, c, d)
+		__m128 x_lo = _mm_unpacklo_ps(x, x); //(a, a, b, b)
+		__m128 x_hi = _mm_unpackhi_ps(x, x); //(c, c, d, d)
+		__m128 gain_lo = _mm_add_ps(start, _mm_mul_ps(index_lo, step));
+		__m128 gain_hi = _mm_add_ps(start, _mm_mul_ps(index_hi, step));
+		float *o = out + 2 * i;
+		_mm_storeu_ps(o, _mm_add_ps(_mm_loadu_ps(o), _mm_mul_ps(x_lo, gain_lo)));
+		_mm_storeu_ps(o + 4, _mm_add_ps(_mm_loadu_ps(o + 4), _mm_mul_ps(x_hi, gain_hi)));
+		index_lo = _mm_add_ps(index_lo, four);
+		index_hi = _mm_add_ps(index_hi, four);
+	}
+#endif
+	//remaining samples (or all samples, without SSE):
+	l += float(i) * l_step;
+	r += float(i) * r_step;
+	for (; i < count; ++i) {
+		out[2 * i + 0] += l * in[i];
+		out[2 * i + 1] += r * in[i];
+		l += l_step;
+		r += r_step;
+	}
+}
+
+//helper: add 'count' mono samples from 'in' to stereo 'out' (as mix_run() does), with the left and right channels
+// read 'l_delay' and 'r_delay' samples earlier (fractional delays, read with linear interpolation), changing by 'l_delay_step' and 'r_delay_step' each sample:
+// reads in[-ITD_HISTORY] through in[count], so delays must stay between zero and ITD_HISTORY - 2:
+void mix_run_delayed(float *out, float const *in, uint32_t count, float l, float r, float l_step, float r_step, float l_delay, float r_delay, float l_delay_step, float r_delay_step) {
+	float const *base = in - ITD_HISTORY; //(positions are relative to this, so they are never negative)
+	uint32_t i = 0;
+#ifdef SOUND_USE_SSE
+	//four samples per iteration; positions are computed vector-wide, and values gathered with scalar loads:
+	__m128 index = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+	__m128 const four = _mm_set1_ps(4.0f);
+	__m128 const history = _mm_set1_ps(float(ITD_HISTORY));
+	bool const l_undelayed = (l_delay == 0.0f && l_delay_step == 0.0f);
+	bool const r_undelayed = (r_delay == 0.0f && r_delay_step == 0.0f);
+	for (; i + 4 <= count; i += 4) {
+		__m128 l_at = _mm_sub_ps(_mm_add_ps(index, history), _mm_add_ps(_mm_set1_ps(l_delay), _mm_mul_ps(index, _mm_set1_ps(l_delay_step))));
+		__m128 r_at = _mm_sub_ps(_mm_add_ps(index, history), _mm_add_ps(_mm_set1_ps(r_delay), _mm_mul_ps(index, _mm_set1_ps(r_delay_step))));
+		__m128i l_index = _mm_cvttps_epi32(l_at);
+		__m128i r_index = _mm_cvttps_epi32(r_at);
+		__m128 l_fraction = _mm_sub_ps(l_at, _mm_cvtepi32_ps(l_index));
+		__m128 r_fraction = _mm_sub_ps(r_at, _mm_cvtepi32_ps(r_index));
+		alignas(16) int32_t li[4], ri[4];
+		_mm_store_si128(reinterpret_cast< __m128i * >(li), l_index);
+		_mm_store_si128(reinterpret_cast< __m128i * >(ri), r_index);
+
+		//(usually only one ear is delayed, so the other is read directly)
+		__m128 l_value, r_value;
+		if (l_undelayed) {
+			l_value = _mm_loadu_ps(in + i);
+		} else {
+			__m128 l_a = _mm_setr_ps(base[li[0]], base[li[1]], base[li[2]], base[li[3]]);
+			__m128 l_b = _mm_setr_ps(base[li[0]+1], base[li[1]+1], base[li[2]+1], base[li[3]+1]);
+			l_value = _mm_add_ps(l_a, _mm_mul_ps(l_fraction, _mm_sub_ps(l_b, l_a)));
+		}
+		if (r_undelayed) {
+			r_value = _mm_loadu_ps(in + i);
+		} else {
+			__m128 r_a = _mm_setr_ps(base[ri[0]], base[ri[1]], base[ri[2]], base[ri[3]]);
+			__m128 r_b = _mm_setr_ps(base[ri[0]+1], base[ri[1]+1], base[ri[2]+1], base[ri[3]+1]);
+			r_value = _mm_add_ps(r_a, _mm_mul_ps(r_fraction, _mm_sub_ps(r_b, r_a)));
+		}
+
+		l_value = _mm_mul_ps(l_value, _mm_add_ps(_mm_set1_ps(l), _mm_mul_ps(index, _mm_set1_ps(l_step))));
+		r_value = _mm_mul_ps(r_value, _mm_add_ps(_mm_set1_ps(r), _mm_mul_ps(index, _mm_set1_ps(r_step))));
+		float *o = out + 2 * i;
+		_mm_storeu_ps(o, _mm_add_ps(_mm_loadu_ps(o), _mm_unpacklo_ps(l_value, r_value)));
+		_mm_storeu_ps(o + 4, _mm_add_ps(_mm_loadu_ps(o + 4), _mm_unpackhi_ps(l_value, r_value)));
+		index = _mm_add_ps(index, four);
+	}
+#endif
+	//remaining samples (or all samples, without SSE):
+	for (; i < count; ++i) {
+		float l_at = float(i + ITD_HISTORY) - (l_delay + float(i) * l_delay_step);
+		float r_at = float(i + ITD_HISTORY) - (r_delay + float(i) * r_delay_step);
+		int32_t li = int32_t(l_at);
+		int32_t ri = int32_t(r_at);
+		float l_value = base[li] + (l_at - float(li)) * (base[li+1] - base[li]);
+		float r_value = base[ri] + (r_at - float(ri)) * (base[ri+1] - base[ri]);
+		out[2 * i + 0] += (l + float(i) * l_step) * l_value;
+		out[2 * i + 1] += (r + float(i) * r_step) * r_value;
+	}
+}
+
+//helper: one-pole low-pass filter 'count' values of 'data' in place (y += a * (x - y)),
+// with coefficient 'a' changing by 'a_step' each value; *state holds the previous output:
+void low_pass_run(float *data, uint32_t count, float a, float a_step, float *state) {
+	float y = *state;
+	uint32_t i = 0;
+#ifdef SOUND_USE_SSE
+	//four values per iteration, as a scan (the coefficient is held for each group of four):
+	// y[k] = b^(k+1) * y[-1] + sum over j <= k of b^(k-j) * a * x[j], where b = 1 - a
+	__m128 previous = _mm_set1_ps(y);
+	for (; i + 4 <= count; i += 4) {
+		float ai = a + (float(i) + 1.5f) * a_step;
+		float b = 1.0f - ai;
+		float b2 = b * b;
+		__m128 u = _mm_mul_ps(_mm_set1_ps(ai), _mm_loadu_ps(data + i));
+		//add b times the value one back, then b^2 times the (new) value two back:
+		u = _mm_add_ps(u, _mm_mul_ps(_mm_set1_ps(b), _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(u), 4))));
+		u = _mm_add_ps(u, _mm_mul_ps(_mm_set1_ps(b2), _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(u), 8))));
+		__m128 values = _mm_add_ps(u, _mm_mul_ps(_mm_setr_ps(b, b2, b2 * b, b2 * b2), previous));
+		_mm_storeu_ps(data + i, values);
+		previous = _mm_shuffle_ps(values, values, _MM_SHUFFLE(3, 3, 3, 3));
+	}
+	y = _mm_cvtss_f32(previous);
+#endif
+	//remaining values (or all values, without SSE):
+	for (; i < count; ++i) {
+		y += (a + float(i) * a_step) * (data[i] - y);
+		data[i] = y;
+	}
+	*state = y;
+}
+
+//helper: read 'frames' of a mixed voice's mono values into 'out', reading sample data at a rate
+// ramping from 'start_rate' to 'end_rate' (streams always play at their own rate); returns true if the voice ran out of data:
+// (the same reads the mixing code in mix_audio() does, but into a buffer, so the values can be processed before mixing)
+bool read_voice(Voice &voice, float start_rate, float end_rate, uint32_t frames, float *out) {
+	bool finished = false;
+	uint32_t s = 0;
+	if (voice.data && (start_rate != 1.0f || end_rate != 1.0f || voice.fraction != 0.0f)) {
+		resample_run(voice.interpolation, voice.data, voice.size, voice.loop, &voice.i, &voice.fraction, start_rate, (end_rate - start_rate) / frames, frames, out);
+		s = frames;
+		if (!voice.loop && voice.i >= voice.size) finished = true;
+	} else if (voice.data) {
+		assert(voice.i < voice.size);
+		while (s < frames) {
+			uint32_t count = std::min(frames - s, voice.size - voice.i);
+			std::copy(voice.data + voice.i, voice.data + voice.i + count, out + s);
+			s += count;
+			voice.i += count;
+			if (voice.i == voice.size) {
+				if (voice.loop) {
+					voice.i = 0;
+				} else {
+					finished = true;
+					break;
+				}
+			}
+		}
+	} else {
+		OpusStream &stream = *voice.stream;
+		while (s < frames) {
+			float const *data = nullptr;
+			uint32_t count = stream.peek(&data, frames - s);
+			if (count == 0) {
+				if (stream.finished()) {
+					finished = true;
+				} else if (device == 0) {
+					std::this_thread::yield();
+					continue;
+				} else {
+					stream.underruns.fetch_add(1, std::memory_order_relaxed);
+				}
+				break;
+			}
+			std::copy(data, data + count, out + s);
+			stream.consume(count);
+			s += count;
+		}
+	}
+	std::fill(out + s, out + frames, 0.0f);
+	return finished;
+}
+
+//voices quieter than this (-80dB) are never mixed:
+constexpr float const INAUDIBLE = 1e-4f;
+
+//voices that were mixed last block count as this much louder when ranking,
+// so that voices near the cutoff don't switch between mixed and virtual every block:
+constexpr float const MIXED_BONUS = 1.5f;
+
+//voice manager: mark the 'voice_budget' loudest voices as audible, and the rest as virtual:
+void prioritize_voices(glm::vec3 const &listener_position) {
+	//(static so that ranking doesn't allocate on the audio thread)
+	struct Ranked {
+		float loudness;
+		Voice *voice;
+	};
+	static Ranked ranked[MAX_VOICES];
+	uint32_t count = 0;
+
+	for (Voice *v = mixing_voices; v; v = v->next) {
+		//estimated loudness is volume times the distance attenuation from compute_pan_from_listener_and_position():
+		// (uses the volume being ramped to, so voices fading in aren't held back)
+		float loudness = (v->stopping ? v->volume.value : std::max(v->volume.value, v->volume.target));
+		if (v->in_3D) {
+			float distance = glm::length(v->position.value - listener_position);
+			loudness /= 1.0f + (distance / v->half_volume_radius.value);
+		}
+
+		v->audible = (loudness >= INAUDIBLE);
+		if (!v->audible) continue;
+		if (v->was_audible) loudness *= MIXED_BONUS;
+		ranked[count++] = Ranked{ loudness, v };
+	}
+
+	if (count > voice_budget) {
+		std::nth_element(ranked, ranked + voice_budget, ranked + count, [](Ranked const &a, Ranked const &b){
+			return a.loudness > b.loudness;
+		});
+		for (uint32_t r = voice_budget; r < count; ++r) {
+			ranked[r].voice->audible = false;
+		}
+	}
+}
+
+//are any of the 3D spatialization effects on?
+bool spatialization_enabled() {
+	return spatialization.head_delay > 0.0f || spatialization.air_absorption > 0.0f || spatialization.speed_of_sound > 0.0f;
+}
+
+//3D spatialization: set the interaural delays, air absorption, and Doppler shifts of all audible 3D voices for this block:
+// (voices' positions are gathered into arrays so the math runs four voices at a time)
+void spatialize_voices(glm::vec3 const &start_position, glm::vec3 const &start_right, glm::vec3 const &end_position, glm::vec3 const &end_right) {
+	//(static so that nothing is allocated on the audio thread)
+	static Voice *batch[MAX_VOICES];
+	struct Arrays {
+		//inputs: offset from listener to voice at the start and end of the block:
+		alignas(16) float start_x[MAX_VOICES], start_y[MAX_VOICES], start_z[MAX_VOICES];
+		alignas(16) float end_x[MAX_VOICES], end_y[MAX_VOICES], end_z[MAX_VOICES];
+		//outputs:
+		alignas(16) float itd_start[MAX_VOICES], itd_end[MAX_VOICES];
+		alignas(16) float air_start[MAX_VOICES], air_end[MAX_VOICES];
+		alignas(16) float doppler[MAX_VOICES];
+	};
+	static Arrays arrays;
+	uint32_t count = 0;
+
+	for (Voice *v = mixing_voices; v; v = v->next) {
+		if (!v->audible || !v->in_3D) continue;
+		if (!v->was_audible) {
+			//was virtual, so delay line and filter hold old values:
+			std::fill(v->history, v->history + ITD_HISTORY, 0.0f);
+			v->air_state = 0.0f;
+		}
+		//(position at the end of the block, as the mixer will step it)
+		Sound::Ramp< glm::vec3 > end = std::as_const(v->position);
+		step_position_ramp(end, mix_samples);
+		glm::vec3 to_start = v->position.value - start_position;
+		glm::vec3 to_end = end.value - end_position;
+		arrays.start_x[count] = to_start.x; arrays.start_y[count] = to_start.y; arrays.start_z[count] = to_start.z;
+		arrays.end_x[count] = to_end.x; arrays.end_y[count] = to_end.y; arrays.end_z[count] = to_end.z;
+		batch[count++] = v;
+	}
+	//pad to a whole group of four:
+	for (uint32_t c = count; c % 4 != 0; ++c) {
+		arrays.start_x[c] = arrays.start_y[c] = arrays.start_z[c] = 0.0f;
+		arrays.end_x[c] = arrays.end_y[c] = arrays.end_z[c] = 0.0f;
+	}
+
+	//interaural delay is proportional to how far to the side the sound is: (sinusoidal head model)
+	float const itd_scale = spatialization.head_delay * float(AUDIO_RATE);
+	//air absorption coefficient is 1 / (1 + distance / air_absorption): (the cutoff of a one-pole low-pass with coefficient a is about a / (1 - a) * rate / tau)
+	float const inverse_air = (spatialization.air_absorption > 0.0f ? 1.0f / spatialization.air_absorption : 0.0f);
+	//Doppler shift is c / (c + v), where v is the speed away from the listener:
+	float const c = spatialization.speed_of_sound;
+	float const inverse_step = float(AUDIO_RATE) / float(mix_samples); //(per second of block)
+
+	uint32_t i = 0;
+#ifdef SOUND_USE_SSE
+	__m128 const one = _mm_set1_ps(1.0f);
+	__m128 const tiny = _mm_set1_ps(1e-12f);
+	for (; i < count; i += 4) {
+		__m128 sx = _mm_load_ps(arrays.start_x + i), sy = _mm_load_ps(arrays.start_y + i), sz = _mm_load_ps(arrays.start_z + i);
+		__m128 ex = _mm_load_ps(arrays.end_x + i), ey = _mm_load_ps(arrays.end_y + i), ez = _mm_load_ps(arrays.end_z + i);
+		__m128 start_distance = _mm_sqrt_ps(_mm_max_ps(tiny, _mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, sx), _mm_mul_ps(sy, sy)), _mm_mul_ps(sz, sz))));
+		__m128 end_distance = _mm_sqrt_ps(_mm_max_ps(tiny, _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, ex), _mm_mul_ps(ey, ey)), _mm_mul_ps(ez, ez))));
+
+		__m128 start_side = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(start_right.x), sx), _mm_mul_ps(_mm_set1_ps(start_right.y), sy)), _mm_mul_ps(_mm_set1_ps(start_right.z), sz));
+		__m128 end_side = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(end_right.x), ex), _mm_mul_ps(_mm_set1_ps(end_right.y), ey)), _mm_mul_ps(_mm_set1_ps(end_right.z), ez));
+		_mm_store_ps(arrays.itd_start + i, _mm_mul_ps(_mm_set1_ps(itd_scale), _mm_div_ps(start_side, start_distance)));
+		_mm_store_ps(arrays.itd_end + i, _mm_mul_ps(_mm_set1_ps(itd_scale), _mm_div_ps(end_side, end_distance)));
+
+		_mm_store_ps(arrays.air_start + i, _mm_div_ps(one, _mm_add_ps(one, _mm_mul_ps(start_distance, _mm_set1_ps(inverse_air)))));
+		_mm_store_ps(arrays.air_end + i, _mm_div_ps(one, _mm_add_ps(one, _mm_mul_ps(end_distance, _mm_set1_ps(inverse_air)))));
+
+		//(denominator is kept above c/2 and result above 1/2, limiting the shift to an octave either way)
+		__m128 speed = _mm_mul_ps(_mm_sub_ps(end_distance, start_distance), _mm_set1_ps(inverse_step));
+		__m128 cs = _mm_set1_ps(c);
+		__m128 doppler = _mm_div_ps(cs, _mm_max_ps(_mm_add_ps(cs, speed), _mm_mul_ps(cs, _mm_set1_ps(0.5f))));
+		_mm_store_ps(arrays.doppler + i, _mm_max_ps(_mm_set1_ps(0.5f), doppler));
+	}
+#endif
+	//remaining voices (or all voices, without SSE):
+	for (; i < count; ++i) {
+		float start_distance = std::sqrt(std::max(1e-12f, arrays.start_x[i] * arrays.start_x[i] + arrays.start_y[i] * arrays.start_y[i] + arrays.start_z[i] * arrays.start_z[i]));
+		float end_distance = std::sqrt(std::max(1e-12f, arrays.end_x[i] * arrays.end_x[i] + arrays.end_y[i] * arrays.end_y[i] + arrays.end_z[i] * arrays.end_z[i]));
+		float start_side = start_right.x * arrays.start_x[i] + start_right.y * arrays.start_y[i] + start_right.z * arrays.start_z[i];
+		float end_side = end_right.x * arrays.end_x[i] + end_right.y * arrays.end_y[i] + end_right.z * arrays.end_z[i];
+		arrays.itd_start[i] = itd_scale * (start_side / start_distance);
+		arrays.itd_end[i] = itd_scale * (end_side / end_distance);
+		arrays.air_start[i] = 1.0f / (1.0f + start_distance * inverse_air);
+		arrays.air_end[i] = 1.0f / (1.0f + end_distance * inverse_air);
+		float speed = (end_distance - start_distance) * inverse_step;
+		arrays.doppler[i] = std::max(0.5f, c / std::max(c + speed, 0.5f * c));
+	}
+
+	for (uint32_t b = 0; b < count; ++b) {
+		Voice &v = *batch[b];
+		v.itd_start = arrays.itd_start[b];
+		v.itd_end = arrays.itd_end[b];
+		v.air_start = arrays.air_start[b];
+		v.air_end = arrays.air_end[b];
+		//(Doppler shift ramps from the previous block's value, since speed is only known per block)
+		if (c > 0.0f && v.data) {
+			v.doppler_start = (v.was_audible ? v.doppler_end : arrays.doppler[b]);
+			v.doppler_end = arrays.doppler[b];
+		} else {
+			v.doppler_start = v.doppler_end = 1.0f;
+		}
 	}
 }
 
+} //namespace
 
-//The audio callback -- invoked by SDL when it needs more sound to play:
+//The audio callback -- invoked by SDL when it needs more sound to play (or by render_offline() when there is no device):
 void mix_audio(void *, Uint8 *buffer_, int len) {
 	assert(buffer_); //should always have some audio buffer
 
@@ -319,119 +1265,373 @@ void mix_audio(void *, Uint8 *buffer_, int len) {
 		float r;
 	};
 	static_assert(sizeof(LR) == 8, "Sample is packed");
-	assert(len == MIX_SAMPLES * sizeof(LR)); //should always have the expected number of samples
+	assert(len == int(mix_samples * sizeof(LR))); //should always have the expected number of samples
 	LR *buffer = reinterpret_cast< LR * >(buffer_);
 
+	//for statistics, time the mix and the interval since the previous callback:
+	auto mix_start = std::chrono::steady_clock::now();
+	if (device != 0 || offline_callbacks) {
+		if (stats.have_last_callback) {
+			float interval_ms = std::chrono::duration< float, std::milli >(mix_start - stats.last_callback).count();
+			if (interval_ms > 1.5f * 1000.0f * float(mix_samples) / float(AUDIO_RATE)) {
+				stats.late_callbacks.fetch_add(1, std::memory_order_relaxed);
+			}
+			if (interval_ms > stats.worst_interval_ms.load(std::memory_order_relaxed)) {
+				stats.worst_interval_ms.store(interval_ms, std::memory_order_relaxed);
+			}
+		}
+		stats.last_callback = mix_start;
+		stats.have_last_callback = true;
+	}
+
 	//zero the output buffer:
-	for (uint32_t s = 0; s < MIX_SAMPLES; ++s) {
+	for (uint32_t s = 0; s < mix_samples; ++s) {
 		buffer[s].l = 0.0f;
 		buffer[s].r = 0.0f;
 	}
 
+	//apply any changes requested since the last block:
+	while (Command const *command = commands.peek()) {
+		apply(*command);
+		commands.pop();
+	}
+
 	//update global values:
+	// (keeping their ramps as of the start of the block, so values part-way through can be found)
+	Sound::Ramp< float > const volume_ramp = std::as_const(Sound::volume);
+	Sound::Ramp< glm::vec3 > const position_ramp = std::as_const(Sound::listener.position);
+	Sound::Ramp< glm::vec3 > const right_ramp = std::as_const(Sound::listener.right);
+
 	float start_volume = Sound::volume.value;
 	glm::vec3 start_position =  Sound::listener.position.value;
 	glm::vec3 start_right =  Sound::listener.right.value;
 
-	step_value_ramp(Sound::volume);
-	step_position_ramp( Sound::listener.position);
-	step_direction_ramp( Sound::listener.right);
+	step_value_ramp(Sound::volume, mix_samples);
+	step_position_ramp( Sound::listener.position, mix_samples);
+	step_direction_ramp( Sound::listener.right, mix_samples);
 
 	float end_volume = Sound::volume.value;
 	glm::vec3 end_position =  Sound::listener.position.value;
 	glm::vec3 end_right =  Sound::listener.right.value;
 
-	//add audio from each playing sample into the buffer:
-	for (auto si = playing_samples.begin(); si != playing_samples.end(); /* later */) {
-		Sound::PlayingSample &playing_sample = **si; //much more convenient than writing ** everywhere.
-
-		//Figure out sample panning/volume at start...
-		LR start_pan;
-		if (!(playing_sample.pan.value == playing_sample.pan.value)) {
-			//3D panning
-			compute_pan_from_listener_and_position(
-				start_position, start_right,
-				playing_sample.position.value,
-				playing_sample.half_volume_radius.value,
-				&start_pan.l, &start_pan.r);
-
-			step_position_ramp(playing_sample.position);
-			step_value_ramp(playing_sample.half_volume_radius);
-		} else {
-			//2D panning
-			compute_pan_weights(playing_sample.pan.value, &start_pan.l, &start_pan.r);
-
-			step_value_ramp(playing_sample.pan);
+	struct Globals {
+		float volume;
+		glm::vec3 position;
+		glm::vec3 right;
+	};
+	//global values 'frame' frames into the block:
+	auto globals_at = [&](uint32_t frame) -> Globals {
+		if (frame == 0) return Globals{ start_volume, start_position, start_right };
+		if (frame == mix_samples) return Globals{ end_volume, end_position, end_right };
+		Sound::Ramp< float > volume = volume_ramp;
+		Sound::Ramp< glm::vec3 > position = position_ramp;
+		Sound::Ramp< glm::vec3 > right = right_ramp;
+		step_value_ramp(volume, frame);
+		step_position_ramp(position, frame);
+		step_direction_ramp(right, frame);
+		return Globals{ volume.value, position.value, right.value };
+	};
+	//end of a run starting at frame 'begin' -- the end of the block, or sooner if a global ramp finishes first:
+	uint32_t const global_ends[3] = { ramp_frames(volume_ramp.ramp), ramp_frames(position_ramp.ramp), ramp_frames(right_ramp.ramp) };
+	auto global_run_end = [&](uint32_t begin) {
+		uint32_t end = mix_samples;
+		for (uint32_t e : global_ends) {
+			if (e > begin && e < end) end = e;
 		}
-		start_pan.l *= start_volume * playing_sample.volume.value;
-		start_pan.r *= start_volume * playing_sample.volume.value;
-
-		step_value_ramp(playing_sample.volume);
+		return end;
+	};
 
-		//..and end of the mix period:
-		LR end_pan;
-		if (!(playing_sample.pan.value == playing_sample.pan.value)) {
+	//a voice's gains (panning and volume) given the global values:
+	auto voice_gains = [](Voice const &voice, Globals const &globals, LR *gains) {
+		if (voice.in_3D) {
 			//3D panning
 			compute_pan_from_listener_and_position(
-				end_position, end_right,
-				playing_sample.position.value,
-				playing_sample.half_volume_radius.value,
-				&end_pan.l, &end_pan.r);
+				globals.position, globals.right,
+				voice.position.value,
+				voice.half_volume_radius.value,
+				&gains->l, &gains->r);
 		} else {
 			//2D panning
-			compute_pan_weights(playing_sample.pan.value, &end_pan.l, &end_pan.r);
+			compute_pan_weights(voice.pan.value, &gains->l, &gains->r);
 		}
+		gains->l *= globals.volume * voice.volume.value;
+		gains->r *= globals.volume * voice.volume.value;
+	};
 
-		end_pan.l *= end_volume * playing_sample.volume.value;
-		end_pan.r *= end_volume * playing_sample.volume.value;
+	//pick the voices to mix:
+	prioritize_voices(start_position);
 
-		//figure out a step to add at each sample so that pan will move smoothly from start to end:
-		LR pan = start_pan;
-		LR pan_step;
-		pan_step.l = (end_pan.l - start_pan.l) / MIX_SAMPLES;
-		pan_step.r = (end_pan.r - start_pan.r) / MIX_SAMPLES;
+	//compute 3D effects for the voices being mixed:
+	bool const spatialized = spatialization_enabled();
+	if (spatialized) spatialize_voices(start_position, start_right, end_position, end_right);
 
-		assert(playing_sample.i < playing_sample.data.size());
+	//clear the buses' buffers for this block ("master" mixes directly into the output):
+	for (uint32_t b = 1; b < bus_count; ++b) {
+		std::fill(buses[b].buffer, buses[b].buffer + mix_samples * 2, 0.0f);
+	}
 
-		for (uint32_t i = 0; i < MIX_SAMPLES; ++i) {
-			//mix one sample based on current pan values:
-			buffer[i].l += pan.l * playing_sample.data[playing_sample.i];
-			buffer[i].r += pan.r * playing_sample.data[playing_sample.i];
+	//add audio from each playing sample into its bus:
+	uint32_t playing = 0;
+	uint32_t mixed = 0;
+	for (Voice **vp = &mixing_voices; *vp; /* later */) {
+		Voice &voice = **vp; //much more convenient than writing ** everywhere.
+		bool finished = false; //ran out of data?
+		playing += 1;
+		if (voice.audible) mixed += 1;
+
+		if (!voice.audible) {
+			//virtual voice: advance ramps and playback just as if it were mixed, but skip the mixing:
+			if (voice.in_3D) {
+				step_position_ramp(voice.position, mix_samples);
+				step_value_ramp(voice.half_volume_radius, mix_samples);
+			} else {
+				step_value_ramp(voice.pan, mix_samples);
+			}
+			step_value_ramp(voice.volume, mix_samples);
+
+			if (voice.data) {
+				//(split where the rate's ramp finishes, as when mixed)
+				for (uint32_t begin = 0; begin < mix_samples; /* later */) {
+					uint32_t end = run_end(begin, mix_samples, voice.rate.ramp);
+					float start_rate = voice.rate.value;
+					step_value_ramp(voice.rate, end - begin);
+					float end_rate = voice.rate.value;
+					resample_skip(voice.size, voice.loop, &voice.i, &voice.fraction, start_rate, (end_rate - start_rate) / (end - begin), end - begin);
+					begin = end;
+				}
+				if (!voice.loop && voice.i >= voice.size) finished = true;
+			} else {
+				step_value_ramp(voice.rate, mix_samples);
+				//(streams are skipped through a block at a time, as when mixed)
+				OpusStream &stream = *voice.stream;
+				for (uint32_t s = 0; s < mix_samples; /* later */) {
+					float const *data = nullptr;
+					uint32_t count = stream.peek(&data, mix_samples - s);
+					if (count == 0) {
+						if (stream.finished()) {
+							finished = true;
+						} else if (device == 0) {
+							std::this_thread::yield();
+							continue;
+						}
+						break;
+					}
+					stream.consume(count);
+					s += count;
+				}
+			}
+			voice.was_audible = false;
+		} else {
+			float *out = (voice.bus == 0 ? &buffer[0].l : buses[voice.bus].buffer);
+
+			//mix in runs that end wherever one of the voice's ramps (or a global ramp) finishes,
+			// so gains and rates follow their ramps exactly, whatever the block size:
+			LR start_pan, end_pan;
+			for (uint32_t begin = 0; begin < mix_samples && !finished; /* later */) {
+				uint32_t end = global_run_end(begin);
+				end = run_end(begin, end, voice.volume.ramp);
+				end = run_end(begin, end, voice.rate.ramp);
+				if (voice.in_3D) {
+					end = run_end(begin, end, voice.position.ramp);
+					end = run_end(begin, end, voice.half_volume_radius.ramp);
+				} else {
+					end = run_end(begin, end, voice.pan.ramp);
+				}
+				uint32_t const frames = end - begin;
+				float *run_out = out + 2 * begin;
+
+				//Figure out sample panning/volume at start...
+				if (begin == 0) {
+					voice_gains(voice, globals_at(0), &start_pan);
+					if (!voice.was_audible) {
+						//was virtual, so fade in rather than starting mid-waveform:
+						start_pan.l = start_pan.r = 0.0f;
+					}
+					voice.was_audible = true;
+				} else {
+					start_pan = end_pan; //(where the previous run left off)
+				}
+				float start_rate = voice.rate.value;
 
-			//update position in sample:
-			playing_sample.i += 1;
-			if (playing_sample.i == playing_sample.data.size()) {
-				if (playing_sample.loop) {
-					playing_sample.i = 0;
+				//..and end of the run:
+				if (voice.in_3D) {
+					step_position_ramp(voice.position, frames);
+					step_value_ramp(voice.half_volume_radius, frames);
 				} else {
-					break;
+					step_value_ramp(voice.pan, frames);
+				}
+				step_value_ramp(voice.volume, frames);
+				step_value_ramp(voice.rate, frames);
+				voice_gains(voice, globals_at(end), &end_pan);
+				float end_rate = voice.rate.value;
+
+				//figure out a step to add at each sample so that pan will move smoothly from start to end:
+				LR pan_step;
+				pan_step.l = (end_pan.l - start_pan.l) / frames;
+				pan_step.r = (end_pan.r - start_pan.r) / frames;
+
+				//mix in contiguous runs of source data:
+
+				if (voice.in_3D && spatialized) {
+					//spatialized 3D voice: read its values (with Doppler shift), filter them, then mix them through the interaural delay line:
+					// (3D effects are computed for the whole block, so are interpolated to this run)
+					float const t0 = float(begin) / float(mix_samples);
+					float const t1 = float(end) / float(mix_samples);
+					float const itd_start = voice.itd_start + t0 * (voice.itd_end - voice.itd_start);
+					float const itd_end = voice.itd_start + t1 * (voice.itd_end - voice.itd_start);
+					float const air_start = voice.air_start + t0 * (voice.air_end - voice.air_start);
+					float const air_end = voice.air_start + t1 * (voice.air_end - voice.air_start);
+					float const doppler_start = voice.doppler_start + t0 * (voice.doppler_end - voice.doppler_start);
+					float const doppler_end = voice.doppler_start + t1 * (voice.doppler_end - voice.doppler_start);
+
+					alignas(16) float source[ITD_HISTORY + MAX_MIX_SAMPLES + 1];
+					float *mono = source + ITD_HISTORY;
+					finished = read_voice(voice, start_rate * doppler_start, end_rate * doppler_end, frames, mono);
+					mono[frames] = 0.0f; //(read by interpolation at zero delay, with weight zero)
+
+					if (air_start < 1.0f || air_end < 1.0f) {
+						low_pass_run(mono, frames, air_start, (air_end - air_start) / frames, &voice.air_state);
+					} else {
+						voice.air_state = mono[frames - 1];
+					}
+
+					//positive delays are to the listener's right, so delay the left ear:
+					std::copy(voice.history, voice.history + ITD_HISTORY, source);
+					float l_delay = std::max(0.0f, itd_start), l_delay_end = std::max(0.0f, itd_end);
+					float r_delay = std::max(0.0f, -itd_start), r_delay_end = std::max(0.0f, -itd_end);
+					if (l_delay == 0.0f && l_delay_end == 0.0f && r_delay == 0.0f && r_delay_end == 0.0f) {
+						mix_run(run_out, mono, frames, start_pan.l, start_pan.r, pan_step.l, pan_step.r);
+					} else {
+						mix_run_delayed(run_out, mono, frames, start_pan.l, start_pan.r, pan_step.l, pan_step.r,
+							l_delay, r_delay, (l_delay_end - l_delay) / frames, (r_delay_end - r_delay) / frames);
+					}
+					//(history is the last values of source, which may reach back before this run)
+					std::copy(source + frames, source + frames + ITD_HISTORY, voice.history);
+				} else if (voice.data && (start_rate != 1.0f || end_rate != 1.0f || voice.fraction != 0.0f)) {
+					//sample data played at another rate is interpolated (the resampler handles looping, and reads zeros past the end):
+					float resampled[MAX_MIX_SAMPLES];
+					resample_run(voice.interpolation, voice.data, voice.size, voice.loop, &voice.i, &voice.fraction, start_rate, (end_rate - start_rate) / frames, frames, resampled);
+					mix_run(run_out, resampled, frames, start_pan.l, start_pan.r, pan_step.l, pan_step.r);
+					if (!voice.loop && voice.i >= voice.size) finished = true;
+				} else if (voice.data) {
+					//sample data is split at its end (where playback loops or ends):
+					assert(voice.i < voice.size);
+					for (uint32_t s = 0; s < frames; /* later */) {
+						uint32_t count = std::min(frames - s, voice.size - voice.i);
+						mix_run(run_out + 2 * s, voice.data + voice.i, count, start_pan.l + float(s) * pan_step.l, start_pan.r + float(s) * pan_step.r, pan_step.l, pan_step.r);
+
+						s += count;
+						voice.i += count;
+						if (voice.i == voice.size) {
+							if (voice.loop) {
+								voice.i = 0;
+							} else {
+								finished = true;
+								break;
+							}
+						}
+					}
+				} else {
+					//stream data is split where the decoder's ring buffer wraps around:
+					// (the decoder loops the stream itself, if needed)
+					OpusStream &stream = *voice.stream;
+					for (uint32_t s = 0; s < frames; /* later */) {
+						float const *data = nullptr;
+						uint32_t count = stream.peek(&data, frames - s);
+						if (count == 0) {
+							if (stream.finished()) {
+								finished = true;
+							} else if (device == 0) {
+								//rendering offline (not on an audio thread), so wait for the decoder to keep output repeatable:
+								std::this_thread::yield();
+								continue;
+							} else {
+								//decoder has fallen behind; the rest of the run will be silent:
+								stream.underruns.fetch_add(1, std::memory_order_relaxed);
+							}
+							break;
+						}
+						mix_run(run_out + 2 * s, data, count, start_pan.l + float(s) * pan_step.l, start_pan.r + float(s) * pan_step.r, pan_step.l, pan_step.r);
+						stream.consume(count);
+						s += count;
+					}
 				}
+				begin = end;
 			}
-
-			//update pan values:
-			pan.l += pan_step.l;
-			pan.r += pan_step.r;
 		}
 
-		if (playing_sample.i >= playing_sample.data.size()
-		 || (playing_sample.stopping && playing_sample.volume.value == 0.0f)) { //sample has finished
-		 	playing_sample.stopped = true;
-			//erase from list:
-			auto old = si;
-			++si;
-			playing_samples.erase(old);
+		if (finished
+		 || (voice.stopping && voice.volume.value == 0.0f)) { //sample has finished
+			//remove from list:
+			*vp = voice.next;
+			voice.next = nullptr;
+			//mark handles to this voice as stopped, and give the voice back to the game thread:
+			voice.generation.fetch_add(1, std::memory_order_release);
+			bool pushed = finished_voices.push(uint32_t(&voice - voices));
+			assert(pushed && "finished_voices can hold every voice");
+			(void)pushed;
 		} else {
-			++si;
+			vp = &voice.next;
+		}
+	}
+
+	//process buses, children before parents (a bus's index is always larger than its parent's):
+	for (uint32_t b = bus_count - 1; b < bus_count; --b) {
+		Bus &bus = buses[b];
+		float *samples = (b == 0 ? &buffer[0].l : bus.buffer);
+
+		bus.low_pass.process(samples, mix_samples);
+		if (bus.reverb) bus.reverb->process(samples, samples, mix_samples, bus.reverb_wet);
+
+		//ducking follows the sidechain's level, so moves once per block:
+		float start_duck = bus.duck;
+		if (bus.sidechain != -1U) {
+			float target = (buses[bus.sidechain].level > bus.duck_threshold ? bus.duck_depth : 1.0f);
+			float time = (target < bus.duck ? bus.duck_attack : bus.duck_release);
+			bus.duck += (target - bus.duck) * (1.0f - std::exp(-(float(mix_samples) / float(AUDIO_RATE)) / std::max(time, 1e-4f)));
+		}
+		float end_duck = bus.duck;
+
+		//gain (and ducking), in runs split where the gain's ramp finishes:
+		for (uint32_t begin = 0; begin < mix_samples; /* later */) {
+			uint32_t end = run_end(begin, mix_samples, bus.gain.ramp);
+			float start_gain = bus.gain.value * (start_duck + (end_duck - start_duck) * (float(begin) / float(mix_samples)));
+			step_value_ramp(bus.gain, end - begin);
+			float end_gain = bus.gain.value * (start_duck + (end_duck - start_duck) * (float(end) / float(mix_samples)));
+			if (start_gain != 1.0f || end_gain != 1.0f) {
+				scale_stereo(samples + 2 * begin, end - begin, start_gain, (end_gain - start_gain) / (end - begin));
+			}
+			begin = end;
+		}
+		bus.level = rms_stereo(samples, mix_samples);
+
+		if (b != 0) {
+			float *parent = (bus.parent == 0 ? &buffer[0].l : buses[bus.parent].buffer);
+			mix_stereo(parent, samples, mix_samples, 1.0f, 0.0f);
 		}
 	}
 
-	/*//DEBUG: report output power:
-	float max_power = 0.0f;
-	for (uint32_t s = 0; s < MIX_SAMPLES; ++s) {
-		max_power = std::max(max_power, (buffer[s].l * buffer[s].l + buffer[s].r * buffer[s].r));
+	//update statistics:
+	float peak = 0.0f;
+	for (uint32_t s = 0; s < mix_samples; ++s) {
+		peak = std::max(peak, std::max(std::abs(buffer[s].l), std::abs(buffer[s].r)));
+	}
+	//(get_stats() resets 'peak', so compare-and-swap rather than load-then-store)
+	float old_peak = stats.peak.load(std::memory_order_relaxed);
+	while (peak > old_peak && !stats.peak.compare_exchange_weak(old_peak, peak, std::memory_order_relaxed)) { }
+
+	stats.voices_playing.store(playing, std::memory_order_relaxed);
+	stats.voices_mixed.store(mixed, std::memory_order_relaxed);
+
+	float mix_ms = std::chrono::duration< float, std::milli >(std::chrono::steady_clock::now() - mix_start).count();
+	float fraction = mix_ms / (1000.0f * float(mix_samples) / float(AUDIO_RATE)); //of the deadline
+	stats.mix_histogram[Sound::mix_histogram_bucket(fraction)].fetch_add(1, std::memory_order_relaxed);
+	if (mix_ms > stats.worst_mix_ms.load(std::memory_order_relaxed)) {
+		stats.worst_mix_ms.store(mix_ms, std::memory_order_relaxed);
 	}
-	std::cout << "Max Power: " << std::sqrt(max_power) << "; playing samples: " << playing_samples.size() << std::endl; //DEBUG
-	*/
+	uint64_t block = stats.blocks.load(std::memory_order_relaxed);
+	stats.mix_ms[block % STATS_HISTORY].store(mix_ms, std::memory_order_relaxed);
+	stats.blocks.store(block + 1, std::memory_order_release);
 
 }
 
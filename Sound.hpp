@@ -1,7 +1,10 @@
 #pragma once
 
+#include "resample.hpp"
+
 #include <glm/glm.hpp>
 
+#include <array>
 #include <memory>
 #include <vector>
 #include <string>
@@ -10,12 +13,16 @@
 //Game audio system. Simplified from f18-base3.
 //Uses 48kHz sampling rate.
 
+struct OpusStream; //(defined in load_opus.hpp)
+struct MappedFile; //(defined in MappedFile.hpp)
+
 namespace Sound {
 
 //Sample objects hold mono (one-channel) audio.
 struct Sample {
 	//Load from a '.wav' or '.opus' file.
-	//  will warn and convert if sound is not already 48kHz mono:
+	//  will warn and convert if sound is not already 48kHz mono.
+	//  decoded '.opus' files are cached on disk, and later loaded from the cache:
 	Sample(std::string const &filename);
 	
 	//Directly supply an audio buffer:
@@ -23,6 +30,16 @@ struct Sample {
 
 	//sample data is stored as 48kHz, mono, floating-point:
 	std::vector< float > data;
+
+	//...except for '.opus' samples loaded from the decoded-audio cache (see audio_cache.hpp),
+	//  which are memory-mapped (leaving 'data' empty):
+	std::shared_ptr< MappedFile const > mapped;
+	float const *mapped_samples = nullptr;
+	size_t mapped_count = 0;
+
+	//sample data, wherever it is stored:
+	float const *samples() const { return mapped ? mapped_samples : data.data(); }
+	size_t size() const { return mapped ? mapped_count : data.size(); }
 };
 
 //Ramp<> manages values that should be smoothly interpolated
@@ -48,60 +65,93 @@ struct Ramp {
 	float ramp = 0.0f;
 };
 
-// 'PlayingSample' objects book-keep samples that are currently playing:
+// 'PlayingSample' handles refer to samples that are (or were) playing:
+//  handles are small values, cheap to copy, and stay safe to use after the sample stops
+//  (at which point the set_* and stop functions have no effect).
 struct PlayingSample {
-	//change the panning or volume of a playing sample (and do proper locking);
+	//change the panning or volume of a playing sample;
 	// value will change over 'ramp' seconds to avoid creating audible artifacts:
-	void set_volume(float new_volume, float ramp = 1.0f / 60.0f);
+	void set_volume(float new_volume, float ramp = 1.0f / 60.0f) const;
 	//set the panning of a sample (use only on samples in "2D" mode; no effect on "3D" samples):
-	void set_pan(float new_pan, float ramp = 1.0f / 60.0f);
+	void set_pan(float new_pan, float ramp = 1.0f / 60.0f) const;
 	//set the position of a sample (use only on samples in "3D" mode; no effect on "2D" samples):
-	void set_position(glm::vec3 const &new_position, float ramp = 1.0f / 60.0f);
+	void set_position(glm::vec3 const &new_position, float ramp = 1.0f / 60.0f) const;
 	//set the half-volume radius (use only on "3D" playing sounds):
-	void set_half_volume_radius(float new_radius, float ramp = 1.0f / 60.0f);
+	void set_half_volume_radius(float new_radius, float ramp = 1.0f / 60.0f) const;
+	//set the playback rate (2.0f == twice as fast and an octave higher; no effect on Streams):
+	void set_rate(float new_rate, float ramp = 1.0f / 60.0f) const;
+	//set how values are read between samples when not playing at rate 1 (default is Interpolation::Cubic):
+	void set_interpolation(Interpolation interpolation) const;
+	//mix into the named bus instead of "master" (see add_bus(), below):
+	void set_bus(std::string const &bus) const;
 
 	//'stop' will fade sample out over 'ramp' seconds and then remove it from the active samples:
-	void stop(float ramp = 1.0f / 60.0f);
+	void stop(float ramp = 1.0f / 60.0f) const;
+
+	//was playback stopped (either by running out of sample, or by stop())?
+	// (also true for default-constructed handles and for samples that couldn't get a voice)
+	bool stopped() const;
 
 	//internals:
-	//NOTE: PlayingSample is used in a separate thread; so setting these values directly
-	// may result in bad results. Instead, use the functions above, which perform locking!
-	std::vector< float > const &data; //reference to sample data being played
-	uint32_t i = 0; //next data value to read
-	bool loop = false; //should playback loop after data runs out?
-	bool stopping = false; //is playing stopping?
-	bool stopped = false; //was playback stopped (either by running out of sample, or by stop())?
-
-	Ramp< float > volume = Ramp< float >(1.0f);
-
-	//2D playback panning control: ('NaN' if sound played in 3D mode)
-	Ramp< float > pan = Ramp< float >(std::numeric_limits< float >::quiet_NaN());
-
-	//3D playback panning control: ('NaN' if sound played in 2D mode)
-	Ramp< glm::vec3 > position = Ramp< glm::vec3 >(std::numeric_limits< float >::quiet_NaN());
-	Ramp< float > half_volume_radius = std::numeric_limits< float >::quiet_NaN();
-
-	PlayingSample(Sample const &sample_, float volume_, float pan_, bool loop_)
-		: data(sample_.data), loop(loop_), volume(volume_), pan(pan_) { }
-	PlayingSample(Sample const &sample_, float volume_, glm::vec3 const &position_, float half_volume_radius_, bool loop_)
-		: data(sample_.data), loop(loop_), volume(volume_), position(position_), half_volume_radius(half_volume_radius_) { }
+	//samples are mixed by a fixed pool of voices (see Sound.cpp); each voice's generation
+	// is incremented when it finishes, so stale handles can be detected:
+	uint32_t voice = -1U; //index into the voice pool
+	uint32_t generation = 0; //voice's generation when playback started
+};
+
+//Stream objects play mono audio from an '.opus' file, decoding it during playback
+//  (on a background thread) rather than all at once when loaded like Sample does.
+//  Good for long music tracks, which would otherwise take lots of memory and loading time.
+//  A Stream can only be playing once at a time, and must outlive its playback.
+struct Stream {
+	Stream(std::string const &filename);
+	~Stream();
+
+	//internals:
+	std::unique_ptr< OpusStream > opus; //the decoder (see load_opus.hpp)
+	PlayingSample playing; //handle to the most recent playback
 };
 
 // ------- global functions -------
 
-void init(); //call Sound::init() from main.cpp before using any member functions
+//audio is mixed 'block_frames' frames at a time (a power of two from 64 to 2048; throws otherwise).
+//  changes (play(), set_volume(), ...) take effect at the start of the next block, and the device holds
+//  about a block more, so smaller blocks mean less delay before a sound is heard -- at the cost of more
+//  callbacks, each with its own fixed overhead. (ramps are exact to the frame at any block size)
+constexpr uint32_t DefaultBlockFrames = 1024; //~21ms at 48kHz
+constexpr uint32_t LowLatencyBlockFrames = 256; //~5ms at 48kHz
+
+//call Sound::init() from main.cpp before using any member functions:
+void init(uint32_t block_frames = DefaultBlockFrames);
+
+//call Sound::init(Sound::NullDevice()) instead to run without audio hardware;
+// nothing is mixed except by calls to render_offline() (handy for tests and benchmarks):
+// (may be called again -- with no device open -- to change the block size; any partly handed-out block is dropped)
+struct NullDevice {
+	//treat each block render_offline() mixes as a device callback, for the callback statistics in Stats,
+	// and make lock() and unlock() hold off render_offline() (so a program can stand in for a device -- see bench-mixer):
+	bool callbacks = false;
+};
+void init(NullDevice, uint32_t block_frames = DefaultBlockFrames);
+
+//mix the next 'frames' frames of audio into 'out' (2 * frames floats, interleaved left/right):
+// note: will throw if an audio device is open (i.e., only use with init(NullDevice()))
+// note: output depends only on the sequence of calls made, so is repeatable run-to-run
+//  (playing Streams are waited for, rather than running out of decoded audio)
+void render_offline(float *out, uint32_t frames);
 
 void shutdown(); //call Sound::shutdown() from main.cpp to gracefully(-ish) exit
 
 //Call 'Sound::play' to play a sample once.
 //  if you hang on to the return value, you can change the panning, volume, or stop playback early.
-std::shared_ptr< PlayingSample > play(
+//  if all voices are in use, the sample won't play (and the returned handle will already be stopped).
+PlayingSample play(
 	Sample const &sample,
 	float volume = 1.0f,
 	float pan = 0.0f //-1.0f == hard left, 1.0f == hard right
 );
 //The play_3D version will play a sample in '3D' mode (that is, panning determined by listener position):
-std::shared_ptr< PlayingSample > play_3D(
+PlayingSample play_3D(
 	Sample const &sample,
 	float volume,
 	glm::vec3 const &position,
@@ -110,19 +160,32 @@ std::shared_ptr< PlayingSample > play_3D(
 
 //Call 'Sound::loop' to play a sample ~forever~.
 //  if you hang on to the return value, you can change the panning, volume, or stop playback.
-std::shared_ptr< PlayingSample > loop(
+PlayingSample loop(
 	Sample const &sample,
 	float volume = 1.0f,
 	float pan = 0.0f //-1.0f == hard left, 1.0f == hard right
 );
 //The loop_3D version will loop a sample in '3D' mode (that is, panning determined by listener position):
-std::shared_ptr< PlayingSample > loop_3D(
+PlayingSample loop_3D(
 	Sample const &sample,
 	float volume,
 	glm::vec3 const &position,
 	float half_volume_radius = std::numeric_limits< float >::infinity()
 );
 
+//Call 'Sound::play' or 'Sound::loop' with a Stream to play it from the start in '2D' mode.
+//  if the stream is still playing (even if fading out after stop()), it won't restart (and the returned handle will already be stopped).
+PlayingSample play(
+	Stream &stream,
+	float volume = 1.0f,
+	float pan = 0.0f //-1.0f == hard left, 1.0f == hard right
+);
+PlayingSample loop(
+	Stream &stream,
+	float volume = 1.0f,
+	float pan = 0.0f //-1.0f == hard left, 1.0f == hard right
+);
+
 //Listener controls the panning of "3D" samples (ones played using the "position" version of the play functions):
 struct Listener {
 	void set_position_right(glm::vec3 const &new_position, glm::vec3 const &new_right, float ramp = 1.0f / 60.0f);
@@ -140,9 +203,86 @@ void stop_all_samples();
 void set_volume(float new_volume, float ramp = 1.0f / 60.0f);
 extern Ramp< float > volume;
 
-//the audio callback doesn't run between Sound::lock() and Sound::unlock()
-// the set_*/stop/play/... functions already use these helpers, so you shouldn't need
-// to call them unless your code is modifying values directly:
+//set the most voices that are mixed at once (default 64):
+//  if more are playing, the quietest (by volume and distance) are 'virtual' --
+//  they keep playing silently and are mixed again (fading in) once they are among the loudest.
+void set_voice_budget(uint32_t voices);
+
+//"3D" samples are panned and attenuated by their direction and distance from the listener, and (by default) also get:
+//  - an interaural time delay: the ear farther from the sound hears it up to 'head_delay' seconds later;
+//  - air absorption: a low-pass filter whose cutoff drops with distance (to about 7.5kHz at 'air_absorption' units
+//    away, and roughly in inverse proportion to distance beyond that), so far-off sounds are duller;
+//  - Doppler shift: playback rate changes with the speed the sound moves toward or away from the listener
+//    (at 'speed_of_sound' units per second; changes are clamped to an octave up or down; not applied to Streams).
+//  Setting a value to zero turns that effect off.
+//  Cost: parameters for all 3D voices are computed together (four at a time, with SSE) once per block.
+//   Mixing a moving, spatialized voice takes about 7us per 1024-frame block in bench-mixer (vs. about 1us for a
+//   plain voice and 4us for a pitched one) -- about 0.03% of the block's duration, so the default voice budget
+//   of 64 spatialized voices stays near 2% of the audio thread's time.
+struct Spatialization {
+	float head_delay = 0.00066f; //seconds (about the delay for an average head; at most ~0.95ms)
+	float air_absorption = 100.0f; //world units
+	float speed_of_sound = 343.0f; //world units per second
+};
+void set_spatialization(Spatialization const &spatialization);
+
+// ------- buses -------
+//Voices are mixed into 'buses', each of which applies its gain and effects and then mixes into its parent bus.
+//  The "master" bus always exists and is the output; voices play into it unless PlayingSample::set_bus() says otherwise.
+//  Buses are referred to by name; as with the other functions here, changes are queued for the audio thread.
+//  (buses are processed children-first, so a bus's parent must already exist when it is added)
+
+//add a bus (prints a warning and returns false if the name is taken, the parent doesn't exist, or all buses are in use):
+bool add_bus(std::string const &name, std::string const &parent = "master");
+
+//change a bus's gain:
+void set_bus_gain(std::string const &name, float gain, float ramp = 1.0f / 60.0f);
+
+//filter a bus with a one-pole low-pass (e.g., for occluded or distant sounds); a cutoff of zero turns the filter off:
+void set_bus_low_pass(std::string const &name, float cutoff_hz);
+
+//add feedback-delay-network reverb to a bus, at 'wet' times the level of the bus; wet of zero turns the reverb off.
+//  'decay' is how long (in seconds) the tail takes to fall by 60dB; 'damping' (0-1) is how much faster high frequencies decay.
+//  (there are only a few reverb units; prints a warning and returns false if they are all in use)
+bool set_bus_reverb(std::string const &name, float wet, float decay = 1.5f, float damping = 0.3f);
+
+//duck a bus (e.g., music under dialog): when the level of bus 'sidechain' is over 'threshold', this bus's gain moves
+//  toward 'depth' over about 'attack' seconds, and back once the sidechain is quiet over about 'release' seconds.
+//  (an empty sidechain name turns ducking off; if the sidechain bus is processed after this one, its level lags by a block)
+void set_bus_ducking(std::string const &name, std::string const &sidechain, float threshold = 0.02f, float depth = 0.3f, float attack = 0.05f, float release = 0.5f);
+
+//audio thread statistics (for profiling overlays; see PlayMode::draw for an example):
+struct Stats {
+	float block_ms = 0.0f; //duration of the audio in one block, which is also the deadline for mixing it
+
+	//how long mixing took, as a histogram: bucket b counts blocks whose mix took between
+	// 2^(b-15) and 2^(b-14) of block_ms (bucket 0 includes anything faster); the last bucket counts blocks over the deadline:
+	std::array< uint32_t, 16 > mix_histogram;
+
+	//the most recent blocks' mix times (in milliseconds; oldest first):
+	std::array< float, 128 > mix_ms;
+	float worst_mix_ms = 0.0f; //slowest mix since init()
+
+	uint64_t blocks = 0; //blocks mixed since init()
+	uint32_t voices_playing = 0; //voices playing during the most recent block...
+	uint32_t voices_mixed = 0; //...and how many of those were mixed (rather than virtual)
+
+	float peak = 0.0f; //largest output sample magnitude since the previous get_stats() call
+
+	//callbacks that came more than 1.5 * block_ms after the previous one, since init();
+	// these mean the device probably ran out of audio (always zero when rendering offline, unless NullDevice::callbacks is set):
+	uint32_t late_callbacks = 0;
+	float worst_interval_ms = 0.0f; //longest time between callbacks since init()
+};
+//get a copy of the current statistics (lock-free; safe to call every frame):
+Stats get_stats();
+
+//the Stats::mix_histogram bucket for a mix that took 'fraction' of block_ms:
+uint32_t mix_histogram_bucket(float fraction);
+
+//the audio callback (or, with NullDevice::callbacks, render_offline()) doesn't run between Sound::lock() and Sound::unlock()
+// the set_*/stop/play/... functions don't need these (they queue changes for the audio
+// thread instead), so you shouldn't need to call them unless your code is modifying values directly:
 void lock();
 void unlock();
 
@@ -0,0 +1,47 @@
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(uint32_t threads) {
+	if (threads == 0) {
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+	workers.reserve(threads);
+	for (uint32_t t = 0; t < threads; ++t) {
+		workers.emplace_back([this](){
+			std::unique_lock< std::mutex > lock(mutex);
+			while (true) {
+				wake.wait(lock, [this](){ return quit || !jobs.empty(); });
+				if (jobs.empty()) break; //(only happens once quitting)
+				std::packaged_task< void() > job = std::move(jobs.front());
+				jobs.pop_front();
+
+				lock.unlock();
+				job(); //(any exception is stored in the job's future)
+				lock.lock();
+			}
+		});
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard< std::mutex > lock(mutex);
+		quit = true;
+	}
+	wake.notify_all();
+	for (auto &worker : workers) {
+		worker.join();
+	}
+}
+
+std::future< void > ThreadPool::run(std::function< void() > const &job) {
+	std::packaged_task< void() > task(job);
+	std::future< void > done = task.get_future();
+	{
+		std::lock_guard< std::mutex > lock(mutex);
+		jobs.emplace_back(std::move(task));
+	}
+	wake.notify_one();
+	return done;
+}
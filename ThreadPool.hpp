@@ -0,0 +1,48 @@
+#pragma once
+
+/*
+ * A ThreadPool runs jobs on a fixed set of worker threads.
+ *
+ * This is useful for spreading independent, CPU-heavy work (e.g., decoding
+ *  audio files while loading) across cores:
+ *
+ * ThreadPool pool;
+ * std::future< void > done = pool.run([](){ expensive_work(); });
+ * //...do other things...
+ * done.get(); //waits for the job (and re-throws any exception it threw)
+ *
+ * Jobs are started in the order they were queued.
+ *
+ */
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct ThreadPool {
+	//start 'threads' worker threads (or one per hardware thread, if 'threads' is zero):
+	ThreadPool(uint32_t threads = 0);
+	//finishes any queued jobs, then stops the workers:
+	~ThreadPool();
+
+	ThreadPool(ThreadPool const &) = delete;
+	ThreadPool &operator=(ThreadPool const &) = delete;
+
+	//queue 'job' to run on a worker thread:
+	// the returned future becomes ready once the job is done (and re-throws any exception it threw)
+	std::future< void > run(std::function< void() > const &job);
+
+	uint32_t size() const { return uint32_t(workers.size()); }
+
+	//internals:
+	std::mutex mutex; //protects 'jobs' and 'quit'
+	std::condition_variable wake; //notified when a job is queued or the pool is stopping
+	std::deque< std::packaged_task< void() > > jobs;
+	bool quit = false;
+
+	std::vector< std::thread > workers;
+};
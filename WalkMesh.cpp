@@ -1,13 +1,13 @@
 #include "WalkMesh.hpp"
 
-#include "read_write_chunk.hpp"
+#include "ChunkFile.hpp"
+#include "vfs.hpp"
 
 #include <glm/gtx/norm.hpp>
 #include <glm/gtx/string_cast.hpp>
 #include <glm/gtx/quaternion.hpp>
 
 #include <iostream>
-#include <fstream>
 #include <algorithm>
 #include <string>
 
@@ -233,19 +233,22 @@ bool WalkMesh::cross_edge(WalkPoint const &start, WalkPoint *end_, glm::quat *ro
 
 
 WalkMeshes::WalkMeshes(std::string const &filename) {
-	std::ifstream file(filename, std::ios::binary);
+	//chunks are read in place from the mapped file (or pack):
+	std::shared_ptr< DataFile const > contents = vfs_read(filename);
+	ChunkFile file(contents->data, contents->size, contents);
+	file.validate();
 
-	std::vector< glm::vec3 > vertices;
-	read_chunk(file, "p...", &vertices);
+	ChunkView< glm::vec3 > vertices;
+	file.read("p...", &vertices);
 
-	std::vector< glm::vec3 > normals;
-	read_chunk(file, "n...", &normals);
+	ChunkView< glm::vec3 > normals;
+	file.read("n...", &normals);
 
-	std::vector< glm::uvec3 > triangles;
-	read_chunk(file, "tri0", &triangles);
+	ChunkView< glm::uvec3 > triangles;
+	file.read("tri0", &triangles);
 
-	std::vector< char > names;
-	read_chunk(file, "str0", &names);
+	ChunkView< char > names;
+	file.read("str0", &names);
 
 	struct IndexEntry {
 		uint32_t name_begin, name_end;
@@ -253,10 +256,10 @@ WalkMeshes::WalkMeshes(std::string const &filename) {
 		uint32_t triangle_begin, triangle_end;
 	};
 
-	std::vector< IndexEntry > index;
-	read_chunk(file, "idxA", &index);
+	ChunkView< IndexEntry > index;
+	file.read("idxA", &index);
 
-	if (file.peek() != EOF) {
+	if (file.trailing != 0) {
 		std::cerr << "WARNING: trailing data in walkmesh file '" << filename << "'" << std::endl;
 	}
 
@@ -0,0 +1,142 @@
+#include "audio_cache.hpp"
+
+#include "MappedFile.hpp"
+#include "data_path.hpp"
+
+#include <atomic>
+#include <cassert>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <thread>
+
+namespace {
+	//cache entries are an AudioCacheHeader followed by 'sample_count' floats:
+	struct AudioCacheHeader {
+		char magic[4] = {'a', 'u', 'd', '0'};
+		uint32_t version = 1; //(increase to invalidate entries written by older code, e.g. if decoding changes)
+		uint64_t sample_count = 0;
+		uint64_t source_size = 0;
+		int64_t source_mtime = 0; //(in filesystem clock ticks)
+		uint64_t source_hash = 0; //hash of source file contents
+		uint8_t reserved[24] = {0}; //(pads the samples to a 64-byte boundary)
+	};
+	static_assert(sizeof(AudioCacheHeader) == 64, "AudioCacheHeader is packed.");
+
+	//64-bit FNV-1a hash:
+	constexpr uint64_t HashStart = 0xcbf29ce484222325ULL;
+	uint64_t hash_bytes(uint64_t hash, char const *bytes, size_t count) {
+		for (size_t i = 0; i < count; ++i) {
+			hash = (hash ^ uint8_t(bytes[i])) * 0x100000001b3ULL;
+		}
+		return hash;
+	}
+
+	//hash a file's contents (returns false if it can't be read):
+	bool hash_file(std::string const &filename, uint64_t *hash) {
+		std::ifstream file(filename, std::ios::binary);
+		if (!file) return false;
+		std::vector< char > buffer(1 << 16);
+		*hash = HashStart;
+		while (file) {
+			file.read(buffer.data(), buffer.size());
+			*hash = hash_bytes(*hash, buffer.data(), size_t(file.gcount()));
+		}
+		return file.eof();
+	}
+
+	//get source size and modification time (returns false if the file doesn't exist):
+	bool stat_source(std::string const &filename, uint64_t *size, int64_t *mtime) {
+		std::error_code ec;
+		*size = std::filesystem::file_size(filename, ec);
+		if (ec) return false;
+		*mtime = int64_t(std::filesystem::last_write_time(filename, ec).time_since_epoch().count());
+		if (ec) return false;
+		return true;
+	}
+
+	//cache entries are named by a hash of the source path:
+	std::string cache_filename(std::string const &filename) {
+		std::ostringstream name;
+		name << std::hex << std::setw(16) << std::setfill('0') << hash_bytes(HashStart, filename.data(), filename.size()) << ".f32";
+		return data_path("cache/" + name.str());
+	}
+}
+
+bool find_cached_audio(std::string const &filename, CachedAudio *cached) {
+	assert(cached);
+
+	uint64_t source_size = 0;
+	int64_t source_mtime = 0;
+	if (!stat_source(filename, &source_size, &source_mtime)) return false;
+
+	std::string entry = cache_filename(filename);
+	if (!std::filesystem::exists(entry)) return false;
+
+	std::shared_ptr< MappedFile const > file;
+	try {
+		file = std::make_shared< MappedFile >(entry);
+	} catch (std::exception &e) {
+		std::cerr << "WARNING: failed to read decoded-audio cache entry for '" << filename << "':\n  " << e.what() << std::endl;
+		return false;
+	}
+
+	//check that the entry is well-formed:
+	AudioCacheHeader header;
+	AudioCacheHeader const expected;
+	if (file->size < sizeof(header)) return false;
+	std::memcpy(&header, file->data, sizeof(header));
+	if (std::memcmp(header.magic, expected.magic, 4) != 0 || header.version != expected.version) return false;
+	if (file->size != sizeof(header) + header.sample_count * sizeof(float)) return false;
+
+	//check that the entry matches the source file:
+	if (header.source_size != source_size) return false;
+	if (header.source_mtime != source_mtime) {
+		uint64_t source_hash = 0;
+		if (!hash_file(filename, &source_hash) || source_hash != header.source_hash) return false;
+	}
+
+	cached->file = file;
+	cached->samples = reinterpret_cast< float const * >(file->data + sizeof(header));
+	cached->count = size_t(header.sample_count);
+	return true;
+}
+
+void store_cached_audio(std::string const &filename, std::vector< float > const &data) {
+	AudioCacheHeader header;
+	header.sample_count = data.size();
+	if (!stat_source(filename, &header.source_size, &header.source_mtime)
+	 || !hash_file(filename, &header.source_hash)) {
+		std::cerr << "WARNING: failed to read '" << filename << "' to add it to the decoded-audio cache." << std::endl;
+		return;
+	}
+
+	std::string entry = cache_filename(filename);
+
+	//write to a temporary file and then rename it, so a partly-written entry is never read:
+	static std::atomic< uint32_t > temp_counter{0};
+	std::ostringstream temp;
+	temp << entry << ".tmp" << std::this_thread::get_id() << "-" << temp_counter.fetch_add(1);
+
+	std::error_code ec;
+	std::filesystem::create_directories(data_path("cache"), ec);
+	{
+		std::ofstream out(temp.str(), std::ios::binary);
+		out.write(reinterpret_cast< char const * >(&header), sizeof(header));
+		out.write(reinterpret_cast< char const * >(data.data()), data.size() * sizeof(float));
+		if (!out) {
+			std::cerr << "WARNING: failed to write decoded-audio cache entry '" << temp.str() << "' for '" << filename << "'." << std::endl;
+			out.close();
+			std::filesystem::remove(temp.str(), ec);
+			return;
+		}
+	}
+	std::filesystem::rename(temp.str(), entry, ec);
+	if (ec) {
+		std::cerr << "WARNING: failed to move decoded-audio cache entry into place for '" << filename << "': " << ec.message() << std::endl;
+		std::filesystem::remove(temp.str(), ec);
+	}
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+/*
+ * The decoded-audio cache keeps copies of decoded audio files on disk (as
+ *  48kHz mono floats, in data_path("cache/")) so that later runs can
+ *  memory-map them instead of decoding again.
+ *
+ * Each entry is named by a hash of its source file's path, and records the
+ *  source's size, modification time, and a hash of its contents.
+ * An entry is used if the source's size and modification time match; if
+ *  only the modification time differs (e.g., after a fresh checkout), the
+ *  source's contents are hashed and the entry is used if those match.
+ *
+ * The cache is only an optimization: if it can't be read or written, a
+ *  warning is printed and files are just decoded as usual.
+ * (it is safe to delete the cache directory at any time the game isn't running)
+ *
+ */
+
+#include <memory>
+#include <string>
+#include <vector>
+
+struct MappedFile;
+
+//Decoded audio mapped from the cache:
+struct CachedAudio {
+	std::shared_ptr< MappedFile const > file; //keeps 'samples' mapped
+	float const *samples = nullptr;
+	size_t count = 0;
+};
+
+//look up decoded audio for 'filename'; returns false if there is no up-to-date entry:
+bool find_cached_audio(std::string const &filename, CachedAudio *cached);
+
+//store decoded audio for 'filename' (safe to call from several threads at once):
+void store_cached_audio(std::string const &filename, std::vector< float > const &data);
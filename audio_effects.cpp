@@ -0,0 +1,222 @@
+#include "audio_effects.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define EFFECTS_USE_SSE
+#endif
+
+void mix_stereo(float *out, float const *in, uint32_t frames, float gain, float gain_step) {
+	uint32_t i = 0;
+#ifdef EFFECTS_USE_SSE
+	//two frames per iteration (gains computed from the start, as in Sound.cpp's mix_run):
+	__m128 const start = _mm_set1_ps(gain);
+	__m128 const step = _mm_set1_ps(gain_step);
+	__m128 index = _mm_setr_ps(0.0f, 0.0f, 1.0f, 1.0f);
+	__m128 const two = _mm_set1_ps(2.0f);
+	for (; i + 2 <= frames; i += 2) {
+		__m128 g = _mm_add_ps(start, _mm_mul_ps(index, step));
+		_mm_storeu_ps(out + 2 * i, _mm_add_ps(_mm_loadu_ps(out + 2 * i), _mm_mul_ps(_mm_loadu_ps(in + 2 * i), g)));
+		index = _mm_add_ps(index, two);
+	}
+#endif
+	gain += float(i) * gain_step;
+	for (; i < frames; ++i) {
+		out[2 * i + 0] += gain * in[2 * i + 0];
+		out[2 * i + 1] += gain * in[2 * i + 1];
+		gain += gain_step;
+	}
+}
+
+void scale_stereo(float *buffer, uint32_t frames, float gain, float gain_step) {
+	uint32_t i = 0;
+#ifdef EFFECTS_USE_SSE
+	__m128 const start = _mm_set1_ps(gain);
+	__m128 const step = _mm_set1_ps(gain_step);
+	__m128 index = _mm_setr_ps(0.0f, 0.0f, 1.0f, 1.0f);
+	__m128 const two = _mm_set1_ps(2.0f);
+	for (; i + 2 <= frames; i += 2) {
+		__m128 g = _mm_add_ps(start, _mm_mul_ps(index, step));
+		_mm_storeu_ps(buffer + 2 * i, _mm_mul_ps(_mm_loadu_ps(buffer + 2 * i), g));
+		index = _mm_add_ps(index, two);
+	}
+#endif
+	gain += float(i) * gain_step;
+	for (; i < frames; ++i) {
+		buffer[2 * i + 0] *= gain;
+		buffer[2 * i + 1] *= gain;
+		gain += gain_step;
+	}
+}
+
+float rms_stereo(float const *buffer, uint32_t frames) {
+	if (frames == 0) return 0.0f;
+	uint32_t i = 0;
+	float sum = 0.0f;
+#ifdef EFFECTS_USE_SSE
+	__m128 sums = _mm_setzero_ps();
+	for (; i + 2 <= frames; i += 2) {
+		__m128 x = _mm_loadu_ps(buffer + 2 * i);
+		sums = _mm_add_ps(sums, _mm_mul_ps(x, x));
+	}
+	float lanes[4];
+	_mm_storeu_ps(lanes, sums);
+	sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#endif
+	for (; i < frames; ++i) {
+		sum += buffer[2 * i + 0] * buffer[2 * i + 0] + buffer[2 * i + 1] * buffer[2 * i + 1];
+	}
+	return std::sqrt(sum / float(2 * frames));
+}
+
+//------------------------------------------------
+
+void LowPass::set_cutoff(float cutoff, uint32_t rate) {
+	if (!(cutoff > 0.0f) || cutoff >= 0.5f * float(rate)) {
+		coefficient = 1.0f;
+	} else {
+		//(matches an analog one-pole filter's time constant)
+		coefficient = 1.0f - std::exp(-6.28318530718f * cutoff / float(rate));
+	}
+}
+
+void LowPass::process(float *buffer, uint32_t frames) {
+	if (!enabled()) return;
+#ifdef EFFECTS_USE_SSE
+	//left and right filtered together in the low two lanes:
+	__m128 const a = _mm_set1_ps(coefficient);
+	__m128 y = _mm_setr_ps(state[0], state[1], 0.0f, 0.0f);
+	for (uint32_t i = 0; i < frames; ++i) {
+		double *frame = reinterpret_cast< double * >(buffer + 2 * i);
+		__m128 x = _mm_castpd_ps(_mm_load_sd(frame));
+		y = _mm_add_ps(y, _mm_mul_ps(a, _mm_sub_ps(x, y)));
+		_mm_store_sd(frame, _mm_castps_pd(y));
+	}
+	float lanes[4];
+	_mm_storeu_ps(lanes, y);
+	state[0] = lanes[0];
+	state[1] = lanes[1];
+#else
+	float l = state[0];
+	float r = state[1];
+	for (uint32_t i = 0; i < frames; ++i) {
+		l += coefficient * (buffer[2 * i + 0] - l);
+		r += coefficient * (buffer[2 * i + 1] - r);
+		buffer[2 * i + 0] = l;
+		buffer[2 * i + 1] = r;
+	}
+	state[0] = l;
+	state[1] = r;
+#endif
+}
+
+//------------------------------------------------
+
+void Reverb::set(float decay, float damping_, uint32_t rate) {
+	//mutually prime delays (at 48kHz) between ~21 and ~39ms, so echoes don't pile up on the same samples:
+	static constexpr uint32_t Lengths[Lines] = { 1031, 1153, 1277, 1399, 1511, 1637, 1753, 1873 };
+	decay = std::max(decay, 0.01f);
+	for (uint32_t l = 0; l < Lines; ++l) {
+		length[l] = std::max(1U, std::min(MaxLength, uint32_t(uint64_t(Lengths[l]) * rate / 48000)));
+		position[l] %= length[l];
+		//each trip around a line should lose (60dB * length / (decay * rate)):
+		gain[l] = std::pow(10.0f, -3.0f * float(length[l]) / (decay * float(rate)));
+	}
+	damping = std::max(0.0f, std::min(0.95f, damping_));
+}
+
+void Reverb::clear() {
+	for (uint32_t l = 0; l < Lines; ++l) {
+		std::fill(lines[l], lines[l] + MaxLength, 0.0f);
+		position[l] = 0;
+		damped[l] = 0.0f;
+	}
+}
+
+void Reverb::process(float const *in, float *out, uint32_t frames, float wet) {
+	static_assert(Lines == 8, "feedback and output taps below are written for eight lines");
+
+	//process in chunks no longer than the shortest line,
+	// so every value read in a chunk was written before the chunk began:
+	constexpr uint32_t Chunk = 128;
+	uint32_t chunk = Chunk;
+	for (uint32_t l = 0; l < Lines; ++l) chunk = std::min(chunk, length[l]);
+	if (chunk == 0) return; //(set() hasn't been called)
+
+	alignas(16) float input[Chunk];
+	alignas(16) float delayed[Lines][Chunk];
+	alignas(16) float left[Chunk];
+	alignas(16) float right[Chunk];
+
+	for (uint32_t begin = 0; begin < frames; begin += chunk) {
+		uint32_t count = std::min(chunk, frames - begin);
+
+		//mono input, spread over the lines:
+		for (uint32_t n = 0; n < count; ++n) {
+			input[n] = 0.25f * (in[2 * (begin + n) + 0] + in[2 * (begin + n) + 1]);
+		}
+
+		//read each line's output, damped and scaled by its feedback gain:
+		// (the damping filter is recursive, so runs along each line; everything after this is across lines)
+		for (uint32_t l = 0; l < Lines; ++l) {
+			float const *line = lines[l];
+			uint32_t p = position[l];
+			float d = damped[l];
+			for (uint32_t n = 0; n < count; ++n) {
+				d = line[p] + damping * (d - line[p]);
+				delayed[l][n] = gain[l] * d;
+				if (++p == length[l]) p = 0;
+			}
+			damped[l] = d;
+		}
+
+		//outputs and feedback (Householder matrix: x - (2/Lines) * sum(x)), four frames at a time:
+		uint32_t n = 0;
+#ifdef EFFECTS_USE_SSE
+		__m128 const quarter = _mm_set1_ps(2.0f / Lines);
+		__m128 const half = _mm_set1_ps(0.5f);
+		for (; n + 4 <= count; n += 4) {
+			__m128 x[Lines];
+			__m128 sum = _mm_setzero_ps();
+			for (uint32_t l = 0; l < Lines; ++l) {
+				x[l] = _mm_load_ps(&delayed[l][n]);
+				sum = _mm_add_ps(sum, x[l]);
+			}
+			__m128 l_out = _mm_add_ps(_mm_sub_ps(x[0], x[2]), _mm_sub_ps(x[4], x[6]));
+			__m128 r_out = _mm_add_ps(_mm_sub_ps(x[1], x[3]), _mm_sub_ps(x[5], x[7]));
+			_mm_store_ps(left + n, _mm_mul_ps(half, l_out));
+			_mm_store_ps(right + n, _mm_mul_ps(half, r_out));
+			__m128 feed = _mm_sub_ps(_mm_load_ps(input + n), _mm_mul_ps(quarter, sum));
+			for (uint32_t l = 0; l < Lines; ++l) {
+				_mm_store_ps(&delayed[l][n], _mm_add_ps(x[l], feed));
+			}
+		}
+#endif
+		for (; n < count; ++n) {
+			float sum = 0.0f;
+			for (uint32_t l = 0; l < Lines; ++l) sum += delayed[l][n];
+			left[n] = 0.5f * ((delayed[0][n] - delayed[2][n]) + (delayed[4][n] - delayed[6][n]));
+			right[n] = 0.5f * ((delayed[1][n] - delayed[3][n]) + (delayed[5][n] - delayed[7][n]));
+			float feed = input[n] - (2.0f / Lines) * sum;
+			for (uint32_t l = 0; l < Lines; ++l) delayed[l][n] += feed;
+		}
+
+		//write the fed-back values where the outputs were read:
+		for (uint32_t l = 0; l < Lines; ++l) {
+			float *line = lines[l];
+			uint32_t p = position[l];
+			for (uint32_t n = 0; n < count; ++n) {
+				line[p] = delayed[l][n];
+				if (++p == length[l]) p = 0;
+			}
+			position[l] = p;
+		}
+
+		for (uint32_t n = 0; n < count; ++n) {
+			out[2 * (begin + n) + 0] += wet * left[n];
+			out[2 * (begin + n) + 1] += wet * right[n];
+		}
+	}
+}
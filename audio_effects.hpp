@@ -0,0 +1,62 @@
+#pragma once
+
+/*
+ * Block-processed audio effects used by the mixer's buses (see Sound.hpp):
+ *  - LowPass: one-pole low-pass filter (e.g., for occluded or distant sounds);
+ *  - Reverb: eight-line feedback delay network with damped feedback;
+ *  - mix_stereo() / scale_stereo(): gain ramps applied to whole blocks.
+ *
+ * All buffers are interleaved stereo (left, right, left, right, ...).
+ * None of these allocate (state is fixed-size), so they are safe to run
+ *  in the audio callback.
+ *
+ */
+
+#include <cstdint>
+
+//add 'frames' stereo frames of 'in' to 'out', with gain starting at 'gain' and changing by 'gain_step' each frame:
+void mix_stereo(float *out, float const *in, uint32_t frames, float gain, float gain_step);
+
+//multiply 'frames' stereo frames of 'buffer' by a gain starting at 'gain' and changing by 'gain_step' each frame:
+void scale_stereo(float *buffer, uint32_t frames, float gain, float gain_step);
+
+//root-mean-square level of 'frames' stereo frames (over both channels):
+float rms_stereo(float const *buffer, uint32_t frames);
+
+//y[n] = y[n-1] + coefficient * (x[n] - y[n-1]), for each channel:
+struct LowPass {
+	//set the -3dB frequency (cutoff of zero -- or at or above half of 'rate' -- turns filtering off):
+	void set_cutoff(float cutoff, uint32_t rate);
+	bool enabled() const { return coefficient < 1.0f; }
+
+	//filter 'frames' stereo frames of 'buffer' in place:
+	void process(float *buffer, uint32_t frames);
+
+	float coefficient = 1.0f; //(1.0f passes input through unchanged)
+	float state[2] = {0.0f, 0.0f}; //previous output (left, right)
+};
+
+//Feedback delay network reverb: input is fed to eight delay lines whose outputs are
+// damped, scaled to give the requested decay time, mixed by a Householder matrix, and fed back;
+// the left output sums the even lines and the right the odd ones.
+struct Reverb {
+	static constexpr uint32_t Lines = 8;
+	static constexpr uint32_t MaxLength = 2048; //longest delay line, in samples
+
+	//set the time (in seconds) for the tail to fall by 60dB, and how much high frequencies are damped (0 = none, 1 = most):
+	void set(float decay, float damping, uint32_t rate);
+
+	//silence the delay lines:
+	void clear();
+
+	//add 'wet' times the reverb of 'frames' stereo frames of 'in' to 'out':
+	// ('out' may be the same buffer as 'in')
+	void process(float const *in, float *out, uint32_t frames, float wet);
+
+	uint32_t length[Lines] = {0}; //delay of each line, in samples (set by set())
+	uint32_t position[Lines] = {0}; //next value to read (and then overwrite) in each line
+	float gain[Lines] = {0.0f}; //feedback gain of each line (set from the decay time)
+	float damping = 0.0f; //one-pole low-pass coefficient for the feedback (0 = no damping)
+	float damped[Lines] = {0.0f}; //low-pass state of each line
+	float lines[Lines][MaxLength]; //delay line contents
+};
@@ -0,0 +1,259 @@
+/*
+ * bench-lods measures how much levels of detail and clusters (see Mesh.hpp)
+ *  cut the triangles Scene::draw submits, and what choosing them costs:
+ *  - a grid of drawables, all using one synthetic mesh -- a UV sphere split
+ *    into clusters of 64 triangles, with a chain of coarser spheres as its
+ *    levels of detail -- is viewed from a camera in the middle of the grid;
+ *  - for each way of drawing (whole meshes; clusters; levels of detail; both)
+ *    it reports the triangles draw() would submit, and the time spent per
+ *    frame making draw()'s choices;
+ *  - it also reports the time per call of Scene::select_lod and of
+ *    Scene::gather_visible_clusters (the part of drawing clusters that
+ *    doesn't involve OpenGL -- no OpenGL context is created).
+ *
+ */
+
+#include "Scene.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+//UV sphere of radius 1 with 'slices' x 'stacks' quads (two triangles each),
+// with clusters of 8 x 4 quads and 'levels' levels of detail (each with half the slices and stacks of the last):
+struct SphereMesh {
+	SphereMesh(uint32_t slices, uint32_t stacks, uint32_t levels);
+	Mesh mesh;
+	std::vector< MeshCluster > clusters;
+	std::vector< MeshLod > lods;
+};
+
+SphereMesh::SphereMesh(uint32_t slices, uint32_t stacks, uint32_t levels) {
+	constexpr uint32_t PatchSlices = 8;
+	constexpr uint32_t PatchStacks = 4;
+	assert(slices % PatchSlices == 0 && stacks % PatchStacks == 0);
+	assert((stacks >> levels) >= 2);
+
+	float const pi = 3.14159265f;
+	auto point = [&](uint32_t s, uint32_t t) {
+		float u = 2.0f * pi * float(s) / float(slices);
+		float v = pi * float(t) / float(stacks);
+		return glm::vec3(std::cos(u) * std::sin(v), std::sin(u) * std::sin(v), std::cos(v));
+	};
+
+	//clusters are the quads of each patch, one patch after another in the buffer:
+	GLuint start = 0;
+	for (uint32_t t0 = 0; t0 < stacks; t0 += PatchStacks) {
+		for (uint32_t s0 = 0; s0 < slices; s0 += PatchSlices) {
+			MeshCluster cluster;
+			cluster.start = start;
+			cluster.count = PatchSlices * PatchStacks * 6;
+			start += cluster.count;
+
+			glm::vec3 sum = glm::vec3(0.0f);
+			for (uint32_t t = t0; t <= t0 + PatchStacks; ++t) {
+				for (uint32_t s = s0; s <= s0 + PatchSlices; ++s) {
+					sum += point(s, t);
+				}
+			}
+			cluster.center = sum / float((PatchSlices + 1) * (PatchStacks + 1));
+			for (uint32_t t = t0; t <= t0 + PatchStacks; ++t) {
+				for (uint32_t s = s0; s <= s0 + PatchSlices; ++s) {
+					cluster.radius = std::max(cluster.radius, glm::length(point(s, t) - cluster.center));
+				}
+			}
+
+			//face normals of a sphere point away from its center, so use quad centers' directions (as make-clusters would):
+			glm::vec3 normal_sum = glm::vec3(0.0f);
+			std::vector< glm::vec3 > normals;
+			for (uint32_t t = t0; t < t0 + PatchStacks; ++t) {
+				for (uint32_t s = s0; s < s0 + PatchSlices; ++s) {
+					glm::vec3 n = glm::normalize(point(s, t) + point(s + 1, t) + point(s, t + 1) + point(s + 1, t + 1));
+					normals.emplace_back(n);
+					normal_sum += n;
+				}
+			}
+			cluster.cone_axis = glm::normalize(normal_sum);
+			float min_dot = 1.0f;
+			for (auto const &n : normals) {
+				min_dot = std::min(min_dot, glm::dot(n, cluster.cone_axis));
+			}
+			if (min_dot > 0.0f) {
+				cluster.cone_cutoff = std::sqrt(std::max(0.0f, 1.0f - min_dot * min_dot));
+			}
+			clusters.emplace_back(cluster);
+		}
+	}
+
+	mesh.start = 0;
+	mesh.count = start;
+	mesh.min = glm::vec3(-1.0f);
+	mesh.max = glm::vec3( 1.0f);
+	mesh.center = glm::vec3(0.0f);
+	mesh.radius = 1.0f;
+
+	//levels of detail follow the full mesh in the buffer:
+	for (uint32_t l = 1; l <= levels; ++l) {
+		MeshLod lod;
+		lod.start = start;
+		lod.count = (slices >> l) * (stacks >> l) * 6;
+		//(a conservative bound on the distance from a quad spanning this many radians to the sphere)
+		lod.error = 1.0f - std::cos(pi / float(stacks >> l));
+		start += lod.count;
+		lods.emplace_back(lod);
+	}
+
+	mesh.clusters = clusters.data();
+	mesh.cluster_count = uint32_t(clusters.size());
+	mesh.lods = lods.data();
+	mesh.lod_count = uint32_t(lods.size());
+}
+
+int main(int argc, char **argv) {
+	if (argc > 3) {
+		std::cerr << "Usage:\n\t" << argv[0] << " [grid=64] [frames=50]\n"
+			"Counts the triangles drawn, with and without levels of detail and clusters, for a grid x grid scene." << std::endl;
+		return 1;
+	}
+	uint32_t grid = (argc > 1 ? uint32_t(std::stoul(argv[1])) : 64);
+	uint32_t frames = (argc > 2 ? uint32_t(std::stoul(argv[2])) : 50);
+
+	SphereMesh sphere(128, 64, 4);
+
+	Scene scene;
+	constexpr float Spacing = 3.0f;
+	for (uint32_t y = 0; y < grid; ++y) {
+		for (uint32_t x = 0; x < grid; ++x) {
+			scene.transforms.emplace_back();
+			Scene::Transform *transform = &scene.transforms.back();
+			transform->position = glm::vec3(float(x) * Spacing, float(y) * Spacing, 0.0f);
+			scene.drawables.emplace_back(transform);
+			Scene::Drawable::Pipeline &pipeline = scene.drawables.back().pipeline;
+			pipeline.mesh = &sphere.mesh;
+			pipeline.start = sphere.mesh.start;
+			pipeline.count = sphere.mesh.count;
+			pipeline.cull_back_facing_clusters = true;
+		}
+	}
+
+	//camera in the middle of the grid, looking along it (and a little down):
+	scene.transforms.emplace_back();
+	Scene::Transform *camera_transform = &scene.transforms.back();
+	// (between drawables, so the nearest are close enough to be drawn in full detail)
+	camera_transform->position = glm::vec3((0.5f * float(grid) - 0.5f) * Spacing, (0.5f * float(grid) - 0.5f) * Spacing, 0.5f * Spacing);
+	camera_transform->rotation = glm::angleAxis(glm::radians(80.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+	scene.cameras.emplace_back(camera_transform);
+	Scene::Camera &camera = scene.cameras.back();
+	camera.aspect = 16.0f / 9.0f;
+
+	//(as in Scene::draw(camera))
+	glm::mat4 world_to_clip = camera.make_projection() * glm::mat4(camera.transform->make_world_to_local());
+	glm::vec3 eye = camera.transform->make_local_to_world()[3];
+
+	//matrices are computed once, so times are just those of the choices:
+	std::vector< glm::mat4x3 > object_to_world;
+	std::vector< glm::mat4 > object_to_clip;
+	for (auto const &drawable : scene.drawables) {
+		object_to_world.emplace_back(drawable.transform->make_local_to_world());
+		object_to_clip.emplace_back(world_to_clip * glm::mat4(object_to_world.back()));
+	}
+	uint32_t const count = uint32_t(object_to_world.size());
+
+	std::cout << count << " drawables of a " << sphere.mesh.count / 3 << "-triangle mesh ("
+		<< sphere.mesh.cluster_count << " clusters, " << sphere.mesh.lod_count << " levels of detail)." << std::endl;
+
+	std::vector< GLint > firsts;
+	std::vector< GLsizei > counts;
+
+	//make draw()'s choices for every drawable, returning the triangles that would be submitted:
+	struct Mode {
+		const char *name;
+		bool lods;
+		bool clusters;
+		bool cull_back_facing;
+	};
+	Mode const modes[] = {
+		{"whole meshes", false, false, false},
+		{"clusters (frustum)", false, true, false},
+		{"clusters (frustum + back-facing)", false, true, true},
+		{"levels of detail", true, false, false},
+		{"levels of detail + clusters", true, true, true},
+	};
+	auto choose = [&](Mode const &mode) -> uint64_t {
+		uint64_t triangles = 0;
+		uint32_t d = 0;
+		for (auto const &drawable : scene.drawables) {
+			Mesh const &mesh = *drawable.pipeline.mesh;
+			uint32_t level = (mode.lods ? Scene::select_lod(mesh, object_to_world[d], eye, camera) : 0);
+			if (level != 0) {
+				triangles += mesh.lods[level-1].count / 3;
+			} else if (mode.clusters) {
+				Scene::gather_visible_clusters(mesh, object_to_clip[d], mode.cull_back_facing, &firsts, &counts);
+				for (GLsizei c : counts) triangles += uint32_t(c) / 3;
+			} else {
+				triangles += mesh.count / 3;
+			}
+			++d;
+		}
+		return triangles;
+	};
+
+	std::cout << "  " << std::setw(34) << std::left << "drawn as" << std::right
+		<< std::setw(14) << "triangles" << std::setw(10) << "(of all)" << std::setw(14) << "us / frame" << '\n';
+	uint64_t all = 0;
+	for (auto const &mode : modes) {
+		uint64_t triangles = choose(mode);
+		if (all == 0) all = triangles;
+		auto before = std::chrono::high_resolution_clock::now();
+		for (uint32_t f = 0; f < frames; ++f) {
+			if (choose(mode) != triangles) {
+				std::cerr << "ERROR: '" << mode.name << "' chose differently from one frame to the next." << std::endl;
+				return 1;
+			}
+		}
+		auto after = std::chrono::high_resolution_clock::now();
+		double us = std::chrono::duration< double, std::micro >(after - before).count() / frames;
+		std::cout << "  " << std::setw(34) << std::left << mode.name << std::right
+			<< std::setw(14) << triangles
+			<< std::setw(9) << std::fixed << std::setprecision(1) << 100.0 * double(triangles) / double(all) << '%'
+			<< std::setw(14) << std::setprecision(1) << us << '\n';
+	}
+
+	//time each call on its own:
+	{
+		std::vector< uint64_t > levels(sphere.mesh.lod_count + 1, 0);
+		auto before = std::chrono::high_resolution_clock::now();
+		for (uint32_t f = 0; f < frames; ++f) {
+			for (uint32_t d = 0; d < count; ++d) {
+				levels[Scene::select_lod(sphere.mesh, object_to_world[d], eye, camera)] += 1;
+			}
+		}
+		auto after = std::chrono::high_resolution_clock::now();
+		double ns = std::chrono::duration< double, std::nano >(after - before).count() / (double(frames) * count);
+		std::cout << "select_lod: " << std::setprecision(1) << ns << " ns per call; drawables per level:";
+		for (auto const &drawables : levels) std::cout << ' ' << drawables / frames;
+		std::cout << std::endl;
+	}
+	for (bool cull_back_facing : {false, true}) {
+		uint64_t ranges = 0;
+		auto before = std::chrono::high_resolution_clock::now();
+		for (uint32_t f = 0; f < frames; ++f) {
+			for (uint32_t d = 0; d < count; ++d) {
+				Scene::gather_visible_clusters(sphere.mesh, object_to_clip[d], cull_back_facing, &firsts, &counts);
+				ranges += counts.size();
+			}
+		}
+		auto after = std::chrono::high_resolution_clock::now();
+		double ns = std::chrono::duration< double, std::nano >(after - before).count() / (double(frames) * count);
+		std::cout << "gather_visible_clusters (" << (cull_back_facing ? "frustum + back-facing" : "frustum") << "): "
+			<< std::setprecision(1) << ns << " ns per call (" << std::setprecision(2) << ns / sphere.mesh.cluster_count << " ns per cluster), "
+			<< std::setprecision(1) << double(ranges) / (double(frames) * count) << " draw ranges per drawable" << std::endl;
+	}
+
+	return 0;
+}
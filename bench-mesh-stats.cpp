@@ -0,0 +1,175 @@
+/*
+ * bench-mesh-stats times MeshBuffer::compute_stats (the bounds and statistics
+ *  MeshBuffer computes while loading a '.pnct' file) on a large synthetic file,
+ *  and checks that its SSE and multi-threaded versions agree with the plain one:
+ *  - bounding boxes and degenerate triangle counts must match exactly;
+ *  - areas, bounding sphere centers, and radii must match to within round-off;
+ *  - every mesh's bounding sphere must contain all of its vertices;
+ *  - results must not depend on the number of threads.
+ *
+ * Exits with a non-zero status if any check fails.
+ *
+ */
+
+#include "Mesh.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+//vertex format used by '.pnct' files (as in Mesh.cpp):
+struct Vertex {
+	glm::vec3 Position;
+	glm::vec3 Normal;
+	glm::u8vec4 Color;
+	glm::vec2 TexCoord;
+};
+static_assert(sizeof(Vertex) == 3*4+3*4+4*1+2*4, "Vertex is packed.");
+
+int main(int argc, char **argv) {
+	if (argc > 3) {
+		std::cerr << "Usage:\n\t" << argv[0] << " [vertices=10000000] [runs=5]\n"
+			"Times and checks mesh bounds and statistics for a file with this many vertices." << std::endl;
+		return 1;
+	}
+	uint32_t vertices = (argc > 1 ? uint32_t(std::stoul(argv[1])) : 10000000);
+	uint32_t runs = (argc > 2 ? uint32_t(std::stoul(argv[2])) : 5);
+
+	//meshes of assorted sizes (including some too small for a triangle, and some with leftover vertices),
+	// each a noisy blob at its own position and scale, with some repeated vertices making degenerate triangles:
+	std::vector< Vertex > data(vertices);
+	std::vector< Mesh > meshes;
+	{
+		std::mt19937 mt(0x6d657368);
+		std::uniform_real_distribution< float > unit(-1.0f, 1.0f);
+		for (uint32_t start = 0; start < vertices; /* later */) {
+			uint32_t sizes[] = {0, 1, 2, 3, 100, 1000, 12346, 250001, 1000000};
+			Mesh mesh;
+			mesh.start = start;
+			mesh.count = std::min(vertices - start, sizes[meshes.size() % 9]);
+			start += mesh.count;
+			meshes.emplace_back(mesh);
+
+			glm::vec3 offset = 100.0f * glm::vec3(unit(mt), unit(mt), unit(mt));
+			glm::vec3 scale = glm::vec3(1.0f + 9.0f * std::abs(unit(mt)), 1.0f + std::abs(unit(mt)), 0.1f + std::abs(unit(mt)));
+			for (uint32_t i = mesh.start; i < mesh.start + mesh.count; ++i) {
+				if (i % 293 == 2) {
+					data[i].Position = data[i-1].Position;
+				} else {
+					glm::vec3 p = glm::vec3(unit(mt), unit(mt), unit(mt));
+					data[i].Position = offset + scale * p * (1.0f + 0.1f * unit(mt));
+				}
+				data[i].Normal = glm::vec3(0.0f, 0.0f, 1.0f);
+			}
+		}
+	}
+	uint8_t const *pnct = reinterpret_cast< uint8_t const * >(data.data());
+
+	std::cout << vertices << " vertices in " << meshes.size() << " meshes; " << std::thread::hardware_concurrency() << " cores." << std::endl;
+
+	//run compute_stats and return the best time, in milliseconds:
+	auto time = [&](std::vector< Mesh > *result, uint32_t threads, bool vectorized) {
+		double best = 1e30;
+		for (uint32_t r = 0; r < runs; ++r) {
+			*result = meshes;
+			auto before = std::chrono::high_resolution_clock::now();
+			MeshBuffer::compute_stats(pnct, vertices, result, threads, vectorized);
+			auto after = std::chrono::high_resolution_clock::now();
+			best = std::min(best, std::chrono::duration< double, std::milli >(after - before).count());
+		}
+		return best;
+	};
+
+	uint32_t failures = 0;
+
+	//compare 'result' against 'expected' (exactly, or to within round-off):
+	auto check = [&](std::string const &name, std::vector< Mesh > const &result, std::string const &expected_name, std::vector< Mesh > const &expected, bool exact) {
+		uint32_t bad = 0;
+		for (uint32_t m = 0; m < meshes.size(); ++m) {
+			Mesh const &r = result[m];
+			Mesh const &e = expected[m];
+			bool same = (r.min == e.min && r.max == e.max && r.degenerate_count == e.degenerate_count);
+			if (exact) {
+				same = same && r.center == e.center && r.radius == e.radius && r.area == e.area;
+			} else {
+				//(the vector code sums dot products in a different order, so the incremental sphere may drift a little)
+				float size = glm::length(e.max - e.min);
+				same = same && glm::length(r.center - e.center) <= 1e-4f * size
+				             && std::abs(r.radius - e.radius) <= 1e-4f * size
+				             && std::abs(r.area - e.area) <= 1e-5f * e.area;
+			}
+			//the sphere must contain every vertex:
+			uint32_t outside = 0;
+			for (uint32_t i = r.start; i < r.start + r.count; ++i) {
+				if (glm::length(data[i].Position - r.center) > r.radius) ++outside;
+			}
+			if (outside || !same) {
+				if (bad == 0 && outside) {
+					std::cerr << "ERROR: " << name << " left " << outside << " vertices outside the bounding sphere of mesh " << m << " (" << r.count << " vertices)." << std::endl;
+				} else if (bad == 0) {
+					std::cerr << "ERROR: " << name << " differs from " << expected_name << " for mesh " << m << " (" << r.count << " vertices):"
+						<< " radius " << r.radius << " vs " << e.radius
+						<< ", area " << r.area << " vs " << e.area
+						<< ", degenerate " << r.degenerate_count << " vs " << e.degenerate_count << std::endl;
+				}
+				++bad;
+			}
+		}
+		if (bad) {
+			std::cerr << "ERROR: " << name << ": " << bad << " of " << meshes.size() << " meshes failed." << std::endl;
+			++failures;
+		}
+	};
+
+	auto report = [&](std::string const &name, double ms, double plain_ms) {
+		std::cout << "  " << std::setw(22) << std::left << name << std::right
+			<< std::setw(10) << std::fixed << std::setprecision(2) << ms << " ms"
+			<< std::setw(10) << std::setprecision(0) << double(vertices) / (ms * 1e3) << " Mvertex/s"
+			<< std::setw(8) << std::setprecision(2) << plain_ms / ms << "x" << std::endl;
+	};
+
+	//(at least four threads, so the parallel path is exercised even on machines with fewer cores)
+	uint32_t threads = std::max(4u, std::thread::hardware_concurrency());
+
+	std::vector< Mesh > plain, plain_parallel, vectorized, vectorized_parallel, automatic;
+	double plain_ms = time(&plain, 1, false);
+	report("plain", plain_ms, plain_ms);
+	for (auto const &mesh : plain) {
+		if (mesh.count != 0 && mesh.radius < 0.0f) {
+			std::cerr << "ERROR: plain version left a mesh without bounds." << std::endl;
+			++failures;
+			break;
+		}
+	}
+
+	double ms = time(&plain_parallel, threads, false);
+	report("plain, " + std::to_string(threads) + " threads", ms, plain_ms);
+	check("plain, " + std::to_string(threads) + " threads", plain_parallel, "plain", plain, true);
+
+	ms = time(&vectorized, 1, true);
+	report("vectorized", ms, plain_ms);
+	check("vectorized", vectorized, "plain", plain, false);
+
+	ms = time(&vectorized_parallel, threads, true);
+	report("vectorized, " + std::to_string(threads) + " threads", ms, plain_ms);
+	check("vectorized, " + std::to_string(threads) + " threads", vectorized_parallel, "vectorized", vectorized, true);
+	check("vectorized, " + std::to_string(threads) + " threads", vectorized_parallel, "plain", plain, false);
+
+	//as MeshBuffer::read_file calls it:
+	ms = time(&automatic, 0, true);
+	report("as loaded", ms, plain_ms);
+	check("as loaded", automatic, "vectorized", vectorized, true);
+
+	if (failures) {
+		std::cerr << failures << " checks failed." << std::endl;
+		return 1;
+	}
+	std::cout << "All checks passed." << std::endl;
+	return 0;
+}
@@ -0,0 +1,910 @@
+/*
+ * bench-mixer drives the Sound mixer without audio hardware (through
+ *  Sound::init(Sound::NullDevice()) and Sound::render_offline()) to:
+ *  - render a fixed script of plays, pans, moves, and stops, which can be
+ *    saved as (or compared against) a 'golden' output file;
+ *  - render a second script that routes voices through buses with
+ *    low-pass, reverb, and ducking effects (with its own golden file);
+ *  - check that volume ramps are exact to the frame at several block sizes;
+ *  - check that a voice made virtual by the voice budget (at rates 1 and 1.3)
+ *    matches an always-mixed render exactly once it is mixed again, and that
+ *    mixed voices are only displaced by voices 1.5x louder;
+ *  - check that clicks from several directions reach the two ears with the
+ *    interaural delay of the head model, and that a 1kHz tone moving at a
+ *    tenth of the speed of sound is heard at the Doppler-shifted frequency;
+ *  - check the statistics from Sound::get_stats() (histogram buckets, the
+ *    peak, and -- with render_offline() standing in for an audio device --
+ *    the late callbacks caused by holding Sound::lock() for 80ms);
+ *  - check that mixing never allocates memory (which could block the audio
+ *    thread), by counting calls to the global operator new and delete while
+ *    thousands of one-shots per second start, move, and finish;
+ *  - time the resampler's in-bounds fast path against its general path
+ *    (failing if it isn't faster);
+ *  - measure the mixer's CPU cost at several voice counts (at their original
+ *    pitch, pitched with the default interpolation, and as moving 3D voices
+ *    with spatialization effects; failing if pitched voices cost more than
+ *    1.3 times plain voices plus the resampling timed above, or more than
+ *    five times plain ones at every count from 64 up), with thousands
+ *    of 3D emitters (with and without a voice budget), and with bus effects; and
+ *  - measure, at several block sizes, the delay from a play() call to its first
+ *    output frame, and the cost of mixing in smaller blocks.
+ *
+ * Golden files are raw 48kHz interleaved-stereo 32-bit floats, kept next to
+ *  the program as 'mixer-golden.f32' and 'mixer-bus-golden.f32' (other files
+ *  can be given with --golden and --bus-golden). The rendered audio is compared
+ *  against them and the program exits with an error if they differ (beyond
+ *  floating-point rounding) or are missing.
+ * After a deliberate change to the mixer's output, run with --write-golden to
+ *  replace them with the new output.
+ *
+ */
+
+#include "Sound.hpp"
+#include "resample.hpp"
+#include "data_path.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <list>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+//every allocation and free in the program goes through these, so check_allocations() can count the ones made while mixing:
+// (only counted on a thread while its 'count_allocations' is set)
+static thread_local bool count_allocations = false;
+static std::atomic< uint64_t > allocations(0);
+
+void *operator new(std::size_t size) {
+	if (count_allocations) allocations.fetch_add(1, std::memory_order_relaxed);
+	if (void *p = std::malloc(size ? size : 1)) return p;
+	throw std::bad_alloc();
+}
+void operator delete(void *p) noexcept {
+	if (p && count_allocations) allocations.fetch_add(1, std::memory_order_relaxed);
+	std::free(p);
+}
+void operator delete(void *p, std::size_t) noexcept {
+	operator delete(p);
+}
+
+//synthesize a test tone (with a bit of harmonic content, so panning/ramps are audible):
+static std::vector< float > make_tone(float frequency, float seconds) {
+	constexpr float Tau = 6.28318530718f;
+	std::vector< float > data(size_t(seconds * 48000.0f));
+	for (size_t i = 0; i < data.size(); ++i) {
+		float t = float(i) / 48000.0f;
+		data[i] = 0.25f * std::sin(Tau * frequency * t)
+		        + 0.05f * std::sin(3.0f * Tau * frequency * t);
+	}
+	return data;
+}
+
+//the resampler's cost (fastest of many tries, in ms per voice) to read one block for a voice, at the rates the pitched
+// benchmark rows play voices with the mixer's default (cubic) interpolation -- on the in-bounds fast path, and on the
+// general path (reads starting just before the end of the looping data, so every run wraps and can't take the fast path):
+// (timed alternately, so both see the same interruptions)
+static void time_resampler(std::vector< float > const &data, uint32_t frames, double *fast, double *general) {
+	constexpr uint32_t Voices = 64;
+	std::vector< float > out(frames);
+	*fast = *general = std::numeric_limits< double >::infinity();
+	for (uint32_t tries = 0; tries < 400; ++tries) {
+		for (bool wrap : {false, true}) {
+			auto before = std::chrono::high_resolution_clock::now();
+			for (uint32_t v = 0; v < Voices; ++v) {
+				uint32_t index = (wrap ? uint32_t(data.size()) - frames / 2 : 1 + 97 * v);
+				float fraction = 0.25f;
+				resample_run(Interpolation::Cubic, data.data(), uint32_t(data.size()), true, &index, &fraction, 0.75f + 0.5f * float(v % 17) / 16.0f, 0.0f, frames, out.data());
+			}
+			auto after = std::chrono::high_resolution_clock::now();
+			double ms = std::chrono::duration< double, std::milli >(after - before).count() / Voices;
+			double &best = (wrap ? *general : *fast);
+			best = std::min(best, ms);
+		}
+	}
+}
+
+//render the fixed script used for golden-output comparisons:
+static std::vector< float > render_script() {
+	Sound::Sample low(make_tone(110.0f, 0.75f));
+	Sound::Sample high(make_tone(880.0f, 0.1f));
+
+	std::vector< float > out;
+	//render in oddly-sized pieces to exercise render_offline()'s partial-block handling:
+	auto render = [&](uint32_t frames) {
+		size_t at = out.size();
+		out.resize(at + frames * 2);
+		Sound::render_offline(out.data() + at, frames);
+	};
+
+	Sound::listener.set_position_right(glm::vec3(0.0f), glm::vec3(1.0f, 0.0f, 0.0f), 0.0f);
+
+	Sound::PlayingSample bed = Sound::loop(low, 0.5f, -0.5f);
+	render(1000);
+	Sound::play(high, 1.0f, 1.0f);
+	render(3000);
+	bed.set_pan(0.5f, 0.25f);
+	Sound::PlayingSample mover = Sound::loop_3D(high, 1.0f, glm::vec3(-4.0f, 1.0f, 0.0f), 2.0f);
+	for (uint32_t step = 0; step < 20; ++step) {
+		mover.set_position(glm::vec3(-4.0f + 0.4f * step, 1.0f, 0.0f), 1.0f / 60.0f);
+		render(777);
+	}
+	Sound::listener.set_position_right(glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f), 0.1f);
+	Sound::set_volume(0.5f, 0.1f);
+	render(10000);
+	mover.stop(0.05f);
+	bed.set_volume(0.0f, 0.2f);
+	render(12345);
+	Sound::stop_all_samples();
+	render(4096);
+
+	return out;
+}
+
+//render the fixed script of bus routing and effects:
+// (leaves the buses in place, with their effects turned off)
+static std::vector< float > render_bus_script() {
+	Sound::Sample music(make_tone(220.0f, 2.0f));
+	Sound::Sample line(make_tone(660.0f, 0.5f));
+	Sound::Sample click(make_tone(1760.0f, 0.05f));
+
+	std::vector< float > out;
+	auto render = [&](uint32_t frames) {
+		size_t at = out.size();
+		out.resize(at + frames * 2);
+		Sound::render_offline(out.data() + at, frames);
+	};
+
+	Sound::set_volume(1.0f, 0.0f);
+	Sound::add_bus("music");
+	Sound::add_bus("dialog");
+	Sound::add_bus("sfx");
+	Sound::add_bus("distant", "sfx");
+	Sound::set_bus_gain("music", 0.8f, 0.0f);
+	Sound::set_bus_ducking("music", "dialog", 0.02f, 0.25f, 0.05f, 0.3f);
+	Sound::set_bus_reverb("sfx", 0.5f, 1.2f, 0.3f);
+	Sound::set_bus_low_pass("distant", 800.0f);
+
+	Sound::PlayingSample bed = Sound::loop(music, 0.5f, 0.0f);
+	bed.set_bus("music");
+	render(9600);
+	//dialog ducks the music:
+	Sound::play(line, 1.0f, -0.25f).set_bus("dialog");
+	render(33333);
+	//a click in the room (with reverb), then a distant (filtered) one:
+	Sound::play(click, 1.0f, 0.5f).set_bus("sfx");
+	render(12000);
+	Sound::play(click, 1.0f, -0.5f).set_bus("distant");
+	render(12000);
+	Sound::set_bus_gain("music", 0.4f, 0.25f);
+	render(20000);
+	Sound::stop_all_samples();
+	render(48000); //(reverb tail)
+
+	Sound::set_bus_reverb("sfx", 0.0f);
+	Sound::set_bus_low_pass("distant", 0.0f);
+	Sound::set_bus_ducking("music", "");
+	Sound::set_bus_gain("music", 1.0f, 0.0f);
+	render(1024);
+
+	return out;
+}
+
+//write 'rendered' as golden file 'golden' (see --write-golden); returns false if the file couldn't be written:
+static bool write_golden(std::string const &golden, std::vector< float > const &rendered) {
+	std::ofstream file(golden, std::ios::binary);
+	file.write(reinterpret_cast< char const * >(rendered.data()), rendered.size() * sizeof(float));
+	if (!file) {
+		std::cerr << "Failed to write '" << golden << "'." << std::endl;
+		return false;
+	}
+	std::cout << "Wrote " << rendered.size() / 2 << " frames to '" << golden << "'." << std::endl;
+	return true;
+}
+
+//compare 'rendered' against golden file 'golden'; returns false if they differ or the file is missing:
+static bool check_golden(std::string const &golden, std::vector< float > const &rendered) {
+	std::ifstream in(golden, std::ios::binary);
+	if (!in) {
+		std::cerr << "Golden file '" << golden << "' is missing (run with --write-golden to create it)." << std::endl;
+		return false;
+	}
+	std::vector< float > expected(rendered.size() + 1);
+	in.read(reinterpret_cast< char * >(expected.data()), expected.size() * sizeof(float));
+	if (size_t(in.gcount()) != rendered.size() * sizeof(float)) {
+		std::cerr << "'" << golden << "' holds " << in.gcount() / (2 * sizeof(float)) << " frames, but " << rendered.size() / 2 << " were rendered." << std::endl;
+		return false;
+	}
+	float max_diff = 0.0f;
+	size_t max_at = 0;
+	for (size_t i = 0; i < rendered.size(); ++i) {
+		float diff = std::abs(rendered[i] - expected[i]);
+		if (!(diff <= max_diff)) { //(also catches NaNs)
+			max_diff = diff;
+			max_at = i;
+		}
+	}
+	//allow for rounding differences between (e.g.) SIMD and scalar mixing:
+	constexpr float Tolerance = 1e-4f;
+	if (!(max_diff <= Tolerance)) {
+		std::cerr << "Output differs from '" << golden << "' by " << max_diff << " at frame " << max_at / 2 << (max_at % 2 ? " (right)" : " (left)") << "." << std::endl;
+		return false;
+	}
+	std::cout << "Output matches '" << golden << "' (max difference " << max_diff << ")." << std::endl;
+	return true;
+}
+
+//check that voice and global volume ramps finish on the right frame (whatever the block size);
+// returns the largest difference from the exact ramps:
+// (leaves the global volume at 1)
+static float check_ramps(uint32_t block_frames) {
+	Sound::init(Sound::NullDevice(), block_frames);
+	Sound::Sample constant(std::vector< float >(4800, 0.5f));
+
+	std::vector< float > out;
+	auto render = [&](uint32_t frames) { //(always whole blocks, so commands apply on the first frame)
+		out.assign(frames * 2, 0.0f);
+		Sound::render_offline(out.data(), frames);
+	};
+	uint32_t const frames = std::max(2048U, block_frames);
+
+	Sound::set_volume(1.0f, 0.0f);
+	Sound::PlayingSample playing = Sound::loop(constant, 1.0f, 0.0f);
+	render(block_frames);
+	float const level = out[0]; //(left channel, at full volume)
+
+	float max_diff = 0.0f;
+	//global volume to 0.25 over 5ms (240 frames):
+	Sound::set_volume(0.25f, 0.005f);
+	render(frames);
+	for (uint32_t i = 0; i < frames; ++i) {
+		float expected = level * (1.0f - 0.75f * std::min(1.0f, float(i) / 240.0f));
+		max_diff = std::max(max_diff, std::abs(out[2 * i] - expected));
+	}
+	//voice volume to zero over 10ms (480 frames):
+	playing.set_volume(0.0f, 0.01f);
+	render(frames);
+	for (uint32_t i = 0; i < frames; ++i) {
+		float expected = 0.25f * level * std::max(0.0f, 1.0f - float(i) / 480.0f);
+		max_diff = std::max(max_diff, std::abs(out[2 * i] - expected));
+	}
+
+	playing.stop(0.0f);
+	Sound::set_volume(1.0f, 0.0f);
+	render(block_frames);
+	return max_diff;
+}
+
+//check that a voice made virtual by the voice budget keeps its place in its sample exactly, playing at 'rate':
+// a voice is held off by a louder rival (mixed to a bus with zero gain, so only the voice is heard) for ten blocks,
+// and once mixed again (after its fade-in block) must match -- exactly -- the same voice rendered with no rival;
+// also checks that the rival only takes over once it is MIXED_BONUS (1.5x) louder than the mixed voice.
+// returns false (and prints what went wrong) on failure:
+static bool check_virtualization(float rate) {
+	constexpr uint32_t Block = 1024;
+	Sound::init(Sound::NullDevice(), Block);
+	Sound::set_voice_budget(1);
+	Sound::set_volume(1.0f, 0.0f);
+	Sound::set_bus_gain("rival", 0.0f, 0.0f); //(see main())
+	Sound::Sample tone(make_tone(330.0f, 1.37f));
+	Sound::Sample other(make_tone(500.0f, 1.0f));
+
+	//render blocks of the same script, with or without the rival:
+	// (the voice's volume and rate ramps split its mixed runs differently from its virtual ones)
+	enum Phase : uint32_t { Held = 4, Virtual = Held + 10, FadeIn = Virtual + 1, End = FadeIn + 8 };
+	std::vector< float > scratch(Block * 2); //(for the block in which the voices stop)
+	auto render = [&](bool with_rival) {
+		std::vector< float > out(End * Block * 2);
+		Sound::PlayingSample voice = Sound::loop(tone, 0.5f, 0.25f);
+		voice.set_rate(rate, 0.0f);
+		Sound::PlayingSample rival;
+		if (with_rival) {
+			rival = Sound::loop(other, 0.3f, 0.0f);
+			rival.set_bus("rival");
+		}
+		for (uint32_t b = 0; b < End; ++b) {
+			if (b == 1 && with_rival) rival.set_volume(0.6f, 0.0f); //(under 1.5x the voice's 0.5, so the voice stays mixed)
+			if (b == Held && with_rival) rival.set_volume(1.0f, 0.0f); //(over 1.5x, so the rival takes the voice's place)
+			if (b == Held + 3) voice.set_volume(0.4f, 0.005f);
+			if (b == Held + 6) voice.set_pan(-0.25f, 0.01f);
+			if (b == Virtual && with_rival) rival.set_volume(0.2f, 0.0f); //(and now under the voice, even with the bonus)
+			if (b == FadeIn + 2) voice.set_volume(0.6f, 0.002f);
+			Sound::render_offline(out.data() + b * Block * 2, Block);
+		}
+		voice.stop(0.0f);
+		rival.stop(0.0f);
+		Sound::render_offline(scratch.data(), Block);
+		return out;
+	};
+	std::vector< float > expected = render(false);
+	std::vector< float > got = render(true);
+
+	bool ok = true;
+	auto check_blocks = [&](uint32_t begin, uint32_t end, char const *what, bool silent) {
+		for (uint32_t i = begin * Block * 2; i < end * Block * 2; ++i) {
+			if (got[i] != (silent ? 0.0f : expected[i])) {
+				std::cerr << "At rate " << rate << ", " << what << " (block " << i / (Block * 2) << ", frame " << (i / 2) % Block
+					<< ") output is " << got[i] << " rather than " << (silent ? 0.0f : expected[i]) << "." << std::endl;
+				ok = false;
+				return;
+			}
+		}
+	};
+	check_blocks(0, Held, "a voice held by the mixed bonus", false);
+	check_blocks(Held, Virtual, "a virtual voice", true);
+	check_blocks(FadeIn, End, "a voice mixed again after being virtual", false);
+
+	Sound::set_voice_budget(64);
+	return ok;
+}
+
+//check the 3D spatialization effects against their formulas (see Sound::Spatialization), to within the given tolerances:
+// - interaural delay: a click to the side reaches the far ear head_delay * side / distance later (measured between the
+//   ears' centroids, which linear interpolation of the delay line keeps exact), for voices all around the listener;
+// - Doppler shift: a 1kHz tone receding (or approaching) at a tenth of the speed of sound is heard at 1kHz * c / (c + v)
+//   (measured from zero crossings);
+// returns false (and prints what went wrong) on failure:
+static bool check_spatialization() {
+	constexpr float ItdTolerance = 0.02f; //samples
+	constexpr float DopplerTolerance = 0.2f; //Hz
+	bool ok = true;
+
+	Sound::init(Sound::NullDevice());
+	Sound::set_volume(1.0f, 0.0f);
+	Sound::listener.set_position_right(glm::vec3(0.0f), glm::vec3(1.0f, 0.0f, 0.0f), 0.0f);
+
+	//interaural delay only:
+	{
+		Sound::Spatialization spatialization;
+		spatialization.air_absorption = spatialization.speed_of_sound = 0.0f;
+		Sound::set_spatialization(spatialization);
+
+		//nine voices at once (so the four-at-a-time math and its leftovers are both used), each with a click at its own time:
+		// (from the third block on, so the delay lines have history)
+		float const angles[] = {10.0f, 30.0f, 60.0f, 89.0f, 90.0f, 135.0f, 170.0f, 250.0f, 300.0f}; //(not straight to the side: the far ear would hear nothing)
+		constexpr uint32_t FirstClick = 3000;
+		constexpr uint32_t Spacing = 300;
+		constexpr uint32_t Frames = FirstClick + 10 * Spacing;
+		std::list< Sound::Sample > samples;
+		std::vector< Sound::PlayingSample > playing;
+		for (uint32_t v = 0; v < 9; ++v) {
+			std::vector< float > click(Frames, 0.0f);
+			click[FirstClick + v * Spacing] = 1.0f;
+			samples.emplace_back(click);
+			float radians = glm::radians(angles[v]);
+			float distance = 5.0f + float(v);
+			playing.emplace_back(Sound::play_3D(samples.back(), 1.0f, distance * glm::vec3(std::cos(radians), std::sin(radians), 0.0f), 10.0f));
+		}
+		std::vector< float > out(2 * Frames);
+		Sound::render_offline(out.data(), Frames);
+
+		for (uint32_t v = 0; v < 9; ++v) {
+			double sum[2] = {0.0, 0.0}, moment[2] = {0.0, 0.0};
+			for (uint32_t i = FirstClick + v * Spacing - Spacing / 2; i < FirstClick + v * Spacing + Spacing / 2; ++i) {
+				for (uint32_t c = 0; c < 2; ++c) {
+					sum[c] += out[2 * i + c];
+					moment[c] += double(i) * out[2 * i + c];
+				}
+			}
+			//(positive delays are to the listener's right, so delay the left ear)
+			float expected = spatialization.head_delay * 48000.0f * std::cos(glm::radians(angles[v]));
+			float delay = float(moment[0] / sum[0] - moment[1] / sum[1]);
+			if (!(std::abs(delay - expected) <= ItdTolerance)) {
+				std::cerr << "A click at " << angles[v] << " degrees reached the left ear " << delay << " samples after the right (rather than " << expected << ")." << std::endl;
+				ok = false;
+			}
+		}
+	}
+
+	//Doppler shift only:
+	{
+		Sound::Spatialization spatialization;
+		spatialization.head_delay = spatialization.air_absorption = 0.0f;
+		Sound::set_spatialization(spatialization);
+		float const c = spatialization.speed_of_sound;
+
+		std::vector< float > sine(48000 * 3);
+		for (size_t i = 0; i < sine.size(); ++i) {
+			sine[i] = 0.5f * float(std::sin(6.28318530717958647692 * 1000.0 * double(i) / 48000.0));
+		}
+		Sound::Sample sample(sine);
+
+		for (float speed : {0.1f * c, -0.1f * c}) {
+			//straight ahead (so no panning changes), moving at 'speed' away from the listener for two seconds:
+			glm::vec3 start = glm::vec3(0.0f, 100.0f, 0.0f);
+			Sound::PlayingSample playing = Sound::play_3D(sample, 1.0f, start, 10.0f);
+			playing.set_position(start + glm::vec3(0.0f, 2.0f * speed, 0.0f), 2.0f);
+			std::vector< float > out(2 * 96000);
+			Sound::render_offline(out.data(), 96000);
+			playing.stop(0.0f);
+
+			//frequency from the (linearly interpolated) upward zero crossings of the left channel, after the first block:
+			double first = -1.0, last = -1.0;
+			uint32_t crossings = 0;
+			for (uint32_t i = 2048; i + 1 < 96000; ++i) {
+				float a = out[2 * i], b = out[2 * (i + 1)];
+				if (a < 0.0f && b >= 0.0f) {
+					double at = double(i) + double(a / (a - b));
+					if (first < 0.0) first = at;
+					last = at;
+					++crossings;
+				}
+			}
+			float frequency = float(double(crossings - 1) * 48000.0 / (last - first));
+			float expected = 1000.0f * c / (c + speed);
+			if (!(std::abs(frequency - expected) <= DopplerTolerance)) {
+				std::cerr << "A 1kHz tone " << (speed > 0.0f ? "receding" : "approaching") << " at " << std::abs(speed) << " units/s was heard at "
+					<< frequency << "Hz (rather than " << expected << "Hz)." << std::endl;
+				ok = false;
+			}
+		}
+	}
+
+	Sound::set_spatialization(Sound::Spatialization());
+	return ok;
+}
+
+//check the mixer's statistics (see Sound::Stats): the mix-time histogram's buckets, the peak (which get_stats() resets),
+// and -- with render_offline() standing in for a device's callbacks -- the histogram's counts and the late callbacks
+// counted while Sound::lock() is held for 80ms; returns false (and prints what went wrong) on failure:
+static bool check_stats() {
+	bool ok = true;
+	auto fail = [&ok](std::string const &what) {
+		std::cerr << "Stats: " << what << std::endl;
+		ok = false;
+	};
+
+	//bucket b counts mixes taking from 2^(b-15) to 2^(b-14) of the block (bucket 0 anything faster, the last anything slower than the block):
+	uint32_t const last = uint32_t(Sound::Stats().mix_histogram.size()) - 1;
+	std::vector< std::pair< float, uint32_t > > buckets = {
+		{-1.0f, 0}, {0.0f, 0}, {1e-9f, 0}, {std::ldexp(1.0f, -15), 0},
+		{1.0f, last}, {3.0f, last}, {std::numeric_limits< float >::infinity(), last},
+	};
+	for (uint32_t b = 1; b < last; ++b) {
+		buckets.emplace_back(std::ldexp(1.0f, int(b) - 15), b);
+		buckets.emplace_back(std::ldexp(0.999f, int(b) - 14), b);
+	}
+	for (auto const &bucket : buckets) {
+		if (Sound::mix_histogram_bucket(bucket.first) != bucket.second) {
+			fail("a mix taking " + std::to_string(bucket.first) + " of the block went in bucket " + std::to_string(Sound::mix_histogram_bucket(bucket.first))
+				+ " rather than " + std::to_string(bucket.second) + ".");
+		}
+	}
+
+	//the peak is the largest output value since the last get_stats():
+	{
+		Sound::init(Sound::NullDevice());
+		Sound::set_volume(1.0f, 0.0f);
+		Sound::Sample tone(make_tone(440.0f, 0.5f));
+		Sound::get_stats();
+		Sound::PlayingSample playing = Sound::loop(tone, 0.8f, 0.3f);
+		std::vector< float > out(4 * 1024 * 2);
+		Sound::render_offline(out.data(), 4 * 1024);
+		float expected = 0.0f;
+		for (float value : out) expected = std::max(expected, std::abs(value));
+		float peak = Sound::get_stats().peak;
+		if (peak != expected) fail("peak is " + std::to_string(peak) + " rather than " + std::to_string(expected) + ".");
+		peak = Sound::get_stats().peak;
+		if (peak != 0.0f) fail("peak is " + std::to_string(peak) + " (rather than zero) right after get_stats().");
+		playing.stop(0.0f);
+		Sound::render_offline(out.data(), 1024);
+		Sound::get_stats();
+		Sound::render_offline(out.data(), 1024);
+		peak = Sound::get_stats().peak;
+		if (peak != 0.0f) fail("peak is " + std::to_string(peak) + " (rather than zero) after a silent block.");
+	}
+
+	//a thread renders a block per block of time, as a device's callbacks would, while this thread holds the lock for 80ms:
+	// (up to three times, if callbacks other than the one the lock delays come late)
+	constexpr uint32_t Attempts = 3;
+	for (uint32_t attempt = 1; ; ++attempt) {
+		Sound::NullDevice device;
+		device.callbacks = true;
+		Sound::init(device);
+		Sound::Sample tone(make_tone(440.0f, 0.5f));
+		Sound::PlayingSample playing = Sound::loop(tone, 0.5f, 0.0f);
+		Sound::Stats const before = Sound::get_stats();
+
+		constexpr uint32_t Blocks = 40;
+		auto const block = std::chrono::duration< double, std::milli >(before.block_ms);
+		std::vector< float > out(Sound::DefaultBlockFrames * 2);
+		std::thread callbacks([&]() {
+			auto next = std::chrono::steady_clock::now();
+			for (uint32_t b = 0; b < Blocks; ++b) {
+				Sound::render_offline(out.data(), Sound::DefaultBlockFrames);
+				//(after a late block, catch up -- as a device with an emptied buffer would)
+				next += std::chrono::duration_cast< std::chrono::steady_clock::duration >(block);
+				std::this_thread::sleep_until(next);
+			}
+		});
+		std::this_thread::sleep_for(10.5 * block);
+		Sound::lock();
+		std::this_thread::sleep_for(std::chrono::milliseconds(80));
+		Sound::unlock();
+		callbacks.join();
+		Sound::Stats const after = Sound::get_stats();
+
+		uint32_t late = after.late_callbacks - before.late_callbacks;
+		//on a busy machine the callback thread may also be scheduled late on its own, so try again (only a missed lock fails):
+		if (late > 1 && attempt < Attempts) {
+			playing.stop(0.0f);
+			Sound::init(Sound::NullDevice());
+			continue;
+		}
+		if (late != 1) {
+			fail(std::to_string(late) + " late callbacks counted (rather than one) while locked for 80ms.");
+		}
+		if (!(after.worst_interval_ms >= 80.0f)) {
+			fail("longest interval between callbacks was " + std::to_string(after.worst_interval_ms) + "ms while locked for 80ms.");
+		}
+		//every block is counted once, in the bucket for the mix time it recorded:
+		if (after.blocks - before.blocks != Blocks) {
+			fail(std::to_string(after.blocks - before.blocks) + " blocks counted rather than " + std::to_string(Blocks) + ".");
+		}
+		std::vector< uint32_t > expected(last + 1, 0);
+		for (uint32_t i = 0; i < Blocks; ++i) {
+			expected[Sound::mix_histogram_bucket(after.mix_ms[after.mix_ms.size() - 1 - i] / after.block_ms)] += 1;
+		}
+		for (uint32_t b = 0; b <= last; ++b) {
+			uint32_t counted = after.mix_histogram[b] - before.mix_histogram[b];
+			if (counted != expected[b]) {
+				fail("histogram bucket " + std::to_string(b) + " counted " + std::to_string(counted) + " blocks rather than " + std::to_string(expected[b]) + ".");
+			}
+		}
+
+		playing.stop(0.0f);
+		Sound::init(Sound::NullDevice());
+		Sound::render_offline(out.data(), Sound::DefaultBlockFrames);
+		break;
+	}
+
+	return ok;
+}
+
+//fire 'per_second' one-shots per second of audio (2D and 3D, at assorted rates, on assorted buses, some stopped early)
+// for 'seconds' seconds, with a voice budget so some are virtual; returns the allocations and frees made while mixing:
+// (render_offline() does nothing but run the mixer, as the audio callback does, so everything it allocates would be allocated on the audio thread)
+static uint64_t check_allocations(uint32_t block_frames, uint32_t per_second, uint32_t seconds) {
+	Sound::init(Sound::NullDevice(), block_frames);
+	Sound::set_voice_budget(64);
+	Sound::set_spatialization(Sound::Spatialization());
+	Sound::Sample blip(make_tone(1320.0f, 0.04f));
+	Sound::Sample thud(make_tone(90.0f, 0.3f));
+	char const *buses[] = {"master", "sfx", "distant", "dialog"};
+	Sound::set_bus_low_pass("distant", 800.0f);
+	Sound::set_bus_reverb("sfx", 0.3f);
+
+	std::vector< float > out(block_frames * 2);
+	std::vector< Sound::PlayingSample > playing;
+	playing.reserve(per_second * seconds);
+	uint64_t const blocks = uint64_t(seconds) * 48000 / block_frames;
+	uint32_t seed = 1;
+	auto random = [&seed]() {
+		seed = seed * 1664525U + 1013904223U;
+		return float(seed >> 8) / float(1U << 24);
+	};
+
+	allocations = 0;
+	uint64_t fired = 0;
+	for (uint64_t b = 0; b < blocks; ++b) {
+		//(the game thread is free to allocate, so commands are sent with counting off)
+		for (; fired < (b + 1) * per_second * block_frames / 48000; ++fired) {
+			Sound::Sample const &sample = (fired % 5 == 0 ? thud : blip);
+			Sound::PlayingSample p;
+			if (fired % 2) {
+				p = Sound::play(sample, 0.2f, 2.0f * random() - 1.0f);
+			} else {
+				p = Sound::play_3D(sample, 0.2f, glm::vec3(40.0f * random() - 20.0f, 40.0f * random() - 20.0f, 0.0f), 2.0f);
+				p.set_position(glm::vec3(0.0f, 1.0f, 0.0f), 0.1f);
+			}
+			if (fired % 3 == 0) p.set_rate(0.5f + random(), 0.05f);
+			if (fired % 4 != 0) p.set_bus(buses[fired % 4]);
+			if (fired % 7 == 0) p.stop(0.01f);
+			playing.emplace_back(p);
+		}
+		if (b % 16 == 0) {
+			Sound::listener.set_position_right(glm::vec3(random(), random(), 0.0f), glm::vec3(1.0f, random(), 0.0f), 0.1f);
+		}
+		count_allocations = true;
+		Sound::render_offline(out.data(), block_frames);
+		count_allocations = false;
+	}
+
+	Sound::stop_all_samples();
+	for (uint32_t i = 0; i < 8; ++i) Sound::render_offline(out.data(), block_frames);
+	Sound::set_bus_low_pass("distant", 0.0f);
+	Sound::set_bus_reverb("sfx", 0.0f);
+	return allocations;
+}
+
+int main(int argc, char **argv) {
+	std::string golden = data_path("mixer-golden.f32");
+	std::string bus_golden = data_path("mixer-bus-golden.f32");
+	bool write = false;
+	for (int argi = 1; argi < argc; ++argi) {
+		std::string arg = argv[argi];
+		if (arg == "--golden" && argi + 1 < argc) {
+			golden = argv[argi+1];
+			argi += 1;
+		} else if (arg == "--bus-golden" && argi + 1 < argc) {
+			bus_golden = argv[argi+1];
+			argi += 1;
+		} else if (arg == "--write-golden") {
+			write = true;
+		} else {
+			std::cerr << "Usage:\n\t" << argv[0] << " [--golden <file.f32>] [--bus-golden <file.f32>] [--write-golden]\n"
+				"Golden files default to mixer-golden.f32 and mixer-bus-golden.f32 next to this program;\n"
+				"--write-golden replaces them with this build's output instead of checking against them." << std::endl;
+			return 1;
+		}
+	}
+
+	Sound::init(Sound::NullDevice());
+
+	//------ golden output ------
+	std::vector< float > rendered = render_script();
+	if (!(write ? write_golden(golden, rendered) : check_golden(golden, rendered))) return 1;
+
+	std::vector< float > bus_rendered = render_bus_script();
+	if (!(write ? write_golden(bus_golden, bus_rendered) : check_golden(bus_golden, bus_rendered))) return 1;
+
+	//------ ramp accuracy ------
+	for (uint32_t block_frames : {64, 256, 1024, 2048}) {
+		float max_diff = check_ramps(block_frames);
+		if (max_diff > 1e-5f) {
+			std::cerr << "Ramps are off by up to " << max_diff << " with " << block_frames << "-frame blocks." << std::endl;
+			return 1;
+		}
+	}
+	std::cout << "Ramps are exact (to within 1e-5) at 64- to 2048-frame blocks." << std::endl;
+
+	//------ virtual voices ------
+	Sound::add_bus("rival");
+	for (float rate : {1.0f, 1.3f}) {
+		if (!check_virtualization(rate)) return 1;
+	}
+	std::cout << "Virtual voices stay in place exactly (at rates 1 and 1.3)." << std::endl;
+
+	//------ spatialization ------
+	if (!check_spatialization()) return 1;
+	std::cout << "Interaural delays and Doppler shifts are right (to within 0.02 samples and 0.2Hz)." << std::endl;
+
+	//------ statistics ------
+	if (!check_stats()) return 1;
+	std::cout << "Statistics (histogram buckets, peak, and late callbacks) are right." << std::endl;
+
+	//------ allocations ------
+	for (uint32_t block_frames : {256, 1024}) {
+		constexpr uint32_t PerSecond = 4000;
+		constexpr uint32_t Seconds = 10;
+		uint64_t count = check_allocations(block_frames, PerSecond, Seconds);
+		if (count != 0) {
+			std::cerr << "Mixing allocated or freed memory " << count << " times (" << PerSecond << " one-shots per second, " << block_frames << "-frame blocks)." << std::endl;
+			return 1;
+		}
+	}
+	std::cout << "Mixing never allocated (4000 one-shots per second for 10 seconds, at 256- and 1024-frame blocks)." << std::endl;
+	Sound::init(Sound::NullDevice());
+
+	//------ benchmark ------
+	constexpr uint32_t Frames = 1024;
+	constexpr uint32_t Blocks = 1000;
+	std::vector< float > out(Frames * 2);
+
+	std::vector< float > tone_data = make_tone(220.0f, 1.37f);
+	Sound::Sample tone(tone_data);
+
+	//the in-bounds fast path is what keeps pitched voices affordable, so check it on its own:
+	// (it should be faster than the general path; it is 1.1-1.4x faster on an SSE2 laptop)
+	double fast_ms = 0.0, general_ms = 0.0;
+	time_resampler(tone_data, Frames, &fast_ms, &general_ms);
+	std::cout << "Resampling a " << Frames << "-frame block (cubic, at pitched voices' rates): " << fast_ms << " ms on the in-bounds fast path, "
+	          << general_ms << " ms on the general path (" << (general_ms / fast_ms) << "x faster)." << std::endl;
+	if (!(fast_ms <= general_ms)) {
+		std::cerr << "The resampler's in-bounds fast path is slower than its general path." << std::endl;
+		return 1;
+	}
+
+	std::cout << "Mixing " << Blocks << " blocks of " << Frames << " frames (" << (Frames * 1000.0f / 48000.0f) << " ms of audio each):" << std::endl;
+	Sound::set_voice_budget(-1U); //(mix every voice)
+	enum Kind { Plain, Pitched, Spatialized };
+	//pitched voices are read through the (cubic) resampler before being mixed, so cost several times what plain
+	// voices do; comparing the fastest blocks (which are the least noisy), fail if they cost more than plain voices
+	// plus the resampling timed above (they measure 0.8-1.15x that), or -- as a backstop for slower resampling
+	// everywhere -- more than five times plain voices in every row with enough voices that the per-block overhead
+	// doesn't matter (they measure 3-4x; a single row can be further off, since plain rows are noisy too):
+	constexpr double PitchedOverheadLimit = 1.3;
+	constexpr double PitchedCostLimit = 5.0;
+	double plain_best = 0.0;
+	double pitched_cost = std::numeric_limits< double >::infinity(); //(lowest of the rows with 64 or more voices)
+	for (uint32_t voices : {1, 16, 64, 128, 256}) for (Kind kind : {Plain, Pitched, Spatialized}) {
+		//let anything still playing fade out:
+		Sound::stop_all_samples();
+		for (uint32_t i = 0; i < 4; ++i) Sound::render_offline(out.data(), Frames);
+
+		Sound::Spatialization spatialization; //(defaults turn every effect on)
+		if (kind != Spatialized) {
+			spatialization.head_delay = spatialization.air_absorption = spatialization.speed_of_sound = 0.0f;
+		}
+		Sound::set_spatialization(spatialization);
+
+		std::vector< Sound::PlayingSample > playing;
+		for (uint32_t v = 0; v < voices; ++v) {
+			if (kind == Spatialized) {
+				//all 3D (and moving, below):
+				playing.emplace_back(Sound::loop_3D(tone, 0.1f, glm::vec3(float(v) - 0.5f * voices, 1.0f, 0.0f), 4.0f));
+				continue;
+			}
+			//half 2D, half 3D:
+			if (v % 2) playing.emplace_back(Sound::loop(tone, 0.1f, (v % 9) / 4.0f - 1.0f));
+			else playing.emplace_back(Sound::loop_3D(tone, 0.1f, glm::vec3(float(v), 1.0f, 0.0f), 4.0f));
+			if (kind == Pitched) playing.back().set_rate(0.75f + 0.5f * float(v % 17) / 16.0f, 0.0f);
+		}
+		uint32_t started = uint32_t(std::count_if(playing.begin(), playing.end(), [](Sound::PlayingSample const &p){ return !p.stopped(); }));
+
+		double total = 0.0;
+		double best = std::numeric_limits< double >::infinity();
+		double worst = 0.0;
+		for (uint32_t b = 0; b < Blocks; ++b) {
+			//keep the ramps busy:
+			if (b % 8 == 0) {
+				for (auto const &p : playing) p.set_volume(0.05f + 0.01f * float(b % 64) / 8.0f, 0.05f);
+			}
+			if (kind == Spatialized) {
+				//circle the listener:
+				for (uint32_t v = 0; v < voices; ++v) {
+					float angle = 0.01f * float(b) + 6.28318530718f * float(v) / float(voices);
+					playing[v].set_position(glm::vec3(std::cos(angle), std::sin(angle), 0.0f) * (2.0f + float(v % 7)), float(Frames) / 48000.0f);
+				}
+			}
+			auto before = std::chrono::high_resolution_clock::now();
+			Sound::render_offline(out.data(), Frames);
+			auto after = std::chrono::high_resolution_clock::now();
+			double ms = std::chrono::duration< double, std::milli >(after - before).count();
+			total += ms;
+			best = std::min(best, ms);
+			worst = std::max(worst, ms);
+		}
+		double average = total / Blocks;
+		std::cout << "  " << voices << (kind == Pitched ? " pitched voices" : kind == Spatialized ? " spatialized 3D voices" : " voices");
+		if (started != voices) std::cout << " (only " << started << " started)";
+		std::cout << ": " << average << " ms/block average, " << best << " ms best, " << worst << " ms worst, "
+		          << (started / average) << " voices/ms";
+		if (kind == Plain) plain_best = best;
+		if (kind == Pitched) {
+			double cost = best / plain_best;
+			double overhead = best / (plain_best + voices * fast_ms);
+			std::cout << " (" << cost << "x plain voices; " << overhead << "x plain voices plus resampling)";
+			if (voices >= 16 && overhead > PitchedOverheadLimit) {
+				std::cout << std::endl;
+				std::cerr << voices << " pitched voices cost " << overhead << "x as much as plain voices plus resampling to mix (limit is " << PitchedOverheadLimit << "x)." << std::endl;
+				return 1;
+			}
+			if (voices >= 64) pitched_cost = std::min(pitched_cost, cost);
+		}
+		std::cout << std::endl;
+	}
+	if (pitched_cost > PitchedCostLimit) {
+		std::cerr << "Pitched voices cost at least " << pitched_cost << "x as much as plain voices to mix (limit is " << PitchedCostLimit << "x)." << std::endl;
+		return 1;
+	}
+
+	Sound::set_spatialization(Sound::Spatialization());
+
+	//------ many emitters ------
+	//3D emitters scattered over a 200m square around the listener, with and without a voice budget:
+	std::cout << "Mixing " << Blocks << " blocks with many 3D emitters:" << std::endl;
+	for (uint32_t emitters : {256, 1024, 4096}) for (uint32_t budget : {64U, -1U}) {
+		Sound::stop_all_samples();
+		for (uint32_t i = 0; i < 4; ++i) Sound::render_offline(out.data(), Frames);
+		Sound::set_voice_budget(budget);
+
+		std::vector< Sound::PlayingSample > playing;
+		uint32_t seed = 1;
+		auto random = [&seed]() { //(a fixed sequence, so runs are comparable)
+			seed = seed * 1664525U + 1013904223U;
+			return float(seed >> 8) / float(1U << 24);
+		};
+		for (uint32_t e = 0; e < emitters; ++e) {
+			playing.emplace_back(Sound::loop_3D(tone, 0.5f, glm::vec3(200.0f * random() - 100.0f, 200.0f * random() - 100.0f, 0.0f), 2.0f));
+		}
+		uint32_t started = uint32_t(std::count_if(playing.begin(), playing.end(), [](Sound::PlayingSample const &p){ return !p.stopped(); }));
+
+		double total = 0.0;
+		for (uint32_t b = 0; b < Blocks / 4; ++b) {
+			auto before = std::chrono::high_resolution_clock::now();
+			Sound::render_offline(out.data(), Frames);
+			auto after = std::chrono::high_resolution_clock::now();
+			total += std::chrono::duration< double, std::milli >(after - before).count();
+		}
+		std::cout << "  " << started << " emitters, " << (budget == -1U ? std::string("no budget") : "budget of " + std::to_string(budget)) << ": "
+		          << total / (Blocks / 4) << " ms/block average" << std::endl;
+	}
+
+	//------ bus effects ------
+	//the cost of each effect, on a bus with 64 voices mixed into it (compared to the same voices with no effects):
+	std::cout << "Mixing " << Blocks << " blocks with 64 voices on a bus with effects:" << std::endl;
+	Sound::set_voice_budget(-1U);
+	struct Effects { char const *name; bool low_pass, reverb, ducking; };
+	for (Effects effects : { Effects{"no effects", false, false, false}, Effects{"low-pass", true, false, false}, Effects{"reverb", false, true, false}, Effects{"ducking", false, false, true}, Effects{"all three", true, true, true} }) {
+		Sound::stop_all_samples();
+		for (uint32_t i = 0; i < 4; ++i) Sound::render_offline(out.data(), Frames);
+		Sound::set_bus_low_pass("sfx", effects.low_pass ? 2000.0f : 0.0f);
+		Sound::set_bus_reverb("sfx", effects.reverb ? 0.3f : 0.0f);
+		Sound::set_bus_ducking("sfx", effects.ducking ? "dialog" : "");
+
+		for (uint32_t v = 0; v < 64; ++v) {
+			Sound::loop(tone, 0.05f, (v % 9) / 4.0f - 1.0f).set_bus("sfx");
+		}
+		double total = 0.0;
+		for (uint32_t b = 0; b < Blocks; ++b) {
+			auto before = std::chrono::high_resolution_clock::now();
+			Sound::render_offline(out.data(), Frames);
+			auto after = std::chrono::high_resolution_clock::now();
+			total += std::chrono::duration< double, std::milli >(after - before).count();
+		}
+		std::cout << "  " << effects.name << ": " << total / Blocks << " ms/block average" << std::endl;
+	}
+	Sound::set_bus_low_pass("sfx", 0.0f);
+	Sound::set_bus_reverb("sfx", 0.0f);
+	Sound::set_bus_ducking("sfx", "");
+
+	//------ latency ------
+	//play() calls land at (pseudo-)random points in the block being output, and are heard from the start of the next block:
+	// on a device, the frames still to be output from the current block are sitting in the device's buffer, so the delay
+	// measured here is the part that depends on the block size -- hardware and driver buffering (at least another block
+	// for SDL's double-buffering) come on top:
+	std::cout << "Delay from play() to output, and the cost of 1s of audio with 64 voices, by block size:" << std::endl;
+	Sound::Sample click(std::vector< float >(64, 0.5f));
+	for (uint32_t block_frames : {128, 256, 512, 1024}) {
+		Sound::stop_all_samples();
+		for (uint32_t i = 0; i < 4; ++i) Sound::render_offline(out.data(), Frames);
+		Sound::init(Sound::NullDevice(), block_frames);
+
+		uint32_t seed = 1;
+		auto random = [&seed]() {
+			seed = seed * 1664525U + 1013904223U;
+			return seed >> 8;
+		};
+		constexpr uint32_t Trials = 200;
+		uint64_t total_frames = 0;
+		uint32_t worst_frames = 0;
+		for (uint32_t t = 0; t < Trials; ++t) {
+			Sound::render_offline(out.data(), random() % block_frames);
+			Sound::play(click);
+			uint32_t frames = 0;
+			float frame[2] = {0.0f, 0.0f};
+			while (frame[0] == 0.0f && frame[1] == 0.0f) {
+				Sound::render_offline(frame, 1);
+				frames += 1;
+			}
+			total_frames += frames - 1; //(frames output before the click)
+			worst_frames = std::max(worst_frames, frames - 1);
+			Sound::render_offline(out.data(), 256); //(let the click finish)
+		}
+
+		for (uint32_t v = 0; v < 64; ++v) {
+			Sound::loop(tone, 0.05f, (v % 9) / 4.0f - 1.0f);
+		}
+		constexpr uint32_t Seconds = 4;
+		uint32_t rendered = 0;
+		auto before = std::chrono::high_resolution_clock::now();
+		for (; rendered < Seconds * 48000; rendered += Frames) Sound::render_offline(out.data(), Frames);
+		auto after = std::chrono::high_resolution_clock::now();
+		double ms = std::chrono::duration< double, std::milli >(after - before).count() * 48000.0 / double(rendered);
+
+		std::cout << "  " << block_frames << "-frame blocks: " << (1000.0 * double(total_frames) / Trials / 48000.0) << " ms average, "
+		          << (1000.0 * worst_frames / 48000.0) << " ms worst delay; " << ms << " ms to mix 1s of audio" << std::endl;
+	}
+
+	Sound::shutdown();
+
+	return 0;
+}
@@ -0,0 +1,117 @@
+/*
+ * bench-pack compares loading the files in a pack (see Pack.hpp) from the
+ *  pack against loading the same files loose from a directory, through vfs.hpp:
+ *  - "stream" reads each file through vfs_open() into a buffer (as the loaders
+ *    built on read_chunk() do);
+ *  - "mapped" gets each file with vfs_read() and touches every cache line
+ *    (as a loader that uses the data in place would).
+ *
+ * "cold" runs first ask the operating system to drop the files from its
+ *  page cache (Linux only; dirty pages may stay cached), so include reading
+ *  from disk; "warm" runs are the average of several runs right after each other.
+ * Pack times include mounting the pack (opening, mapping, and checking its index).
+ *
+ */
+
+#include "Pack.hpp"
+#include "vfs.hpp"
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#define BENCH_PACK_CAN_EVICT
+#endif
+
+int main(int argc, char **argv) {
+	if (argc < 3 || argc > 4) {
+		std::cerr << "Usage:\n\t" << argv[0] << " <directory> <file.pack> [runs=20]\n"
+			"Times loading the pack's files from the pack and from 'directory'." << std::endl;
+		return 1;
+	}
+	std::string directory = argv[1];
+	if (directory.empty() || directory.back() != '/') directory += '/';
+	std::string pack_filename = argv[2];
+	uint32_t runs = (argc > 3 ? uint32_t(std::stoul(argv[3])) : 20);
+
+	std::vector< std::string > names;
+	uint64_t bytes = 0;
+	{
+		Pack pack(pack_filename);
+		for (uint32_t i = 0; i < pack.entry_count; ++i) {
+			names.emplace_back(pack.name(pack.entries[i]));
+			bytes += pack.entries[i].size;
+		}
+	}
+	std::cout << names.size() << " files, " << bytes << " bytes." << std::endl;
+
+	//drop the files from the page cache (returns false if that isn't possible here):
+	auto evict = [&]() {
+#ifdef BENCH_PACK_CAN_EVICT
+		std::vector< std::string > paths;
+		for (auto const &name : names) paths.emplace_back(directory + name);
+		paths.emplace_back(pack_filename);
+		for (auto const &path : paths) {
+			int fd = open(path.c_str(), O_RDONLY);
+			if (fd < 0) return false;
+			posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+			close(fd);
+		}
+		return true;
+#else
+		return false;
+#endif
+	};
+
+	uint64_t checksum = 0; //(so reads aren't optimized away)
+	auto load_all = [&](bool packed, bool stream) {
+		auto start = std::chrono::steady_clock::now();
+		if (packed && !vfs_mount(pack_filename, directory)) {
+			throw std::runtime_error("Can't mount '" + pack_filename + "'.");
+		}
+		for (auto const &name : names) {
+			std::string path = directory + name;
+			if (stream) {
+				std::unique_ptr< std::istream > file = vfs_open(path);
+				file->seekg(0, std::ios::end);
+				std::vector< char > data(size_t(file->tellg()));
+				file->seekg(0);
+				if (!file->read(data.data(), data.size())) throw std::runtime_error("Failed to read '" + path + "'.");
+				for (size_t i = 0; i < data.size(); i += 64) checksum += uint8_t(data[i]);
+			} else {
+				std::shared_ptr< DataFile const > file = vfs_read(path);
+				for (size_t i = 0; i < file->size; i += 64) checksum += file->data[i];
+			}
+		}
+		vfs_unmount_all();
+		return std::chrono::duration< double, std::milli >(std::chrono::steady_clock::now() - start).count();
+	};
+
+	bool can_evict = evict();
+	if (!can_evict) std::cout << "(can't drop files from the page cache here, so no cold runs)" << std::endl;
+
+	std::cout << "              cold ms   warm ms" << std::endl;
+	for (bool packed : {false, true}) {
+		for (bool stream : {true, false}) {
+			std::cout << "  " << (packed ? "pack " : "loose") << " " << (stream ? "stream" : "mapped") << std::fixed << std::setprecision(3);
+			if (can_evict) {
+				evict();
+				std::cout << "  " << std::setw(8) << load_all(packed, stream);
+			} else {
+				std::cout << "  " << std::setw(8) << "-";
+			}
+			load_all(packed, stream); //(make sure everything is cached)
+			double total = 0.0;
+			for (uint32_t run = 0; run < runs; ++run) total += load_all(packed, stream);
+			std::cout << "  " << std::setw(8) << total / runs << std::defaultfloat << std::endl;
+		}
+	}
+	std::cout << "(checksum " << checksum << ")" << std::endl;
+	return 0;
+}
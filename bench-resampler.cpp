@@ -0,0 +1,131 @@
+/*
+ * bench-resampler checks and times the resamplers in resample.hpp:
+ *  - resample() (load-time rate conversion) and resample_run() (per-voice
+ *    playback rates, with each of its interpolation modes) are fed sine
+ *    tones, and their output is compared to the exact tone at the output
+ *    rate (or, for ramped rates, at the positions the ramp should read).
+ *
+ * Prints the signal-to-noise ratio and speed of each case, and exits with
+ *  an error if any case falls below its expected quality.
+ *
+ */
+
+#include "resample.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+constexpr double Tau = 6.28318530717958647692;
+
+//worst acceptable signal-to-noise ratio (in dB) for tones in the passband:
+constexpr double MinSNR = 85.0;
+
+static std::vector< float > make_sine(double frequency, uint32_t rate, size_t count, double step = 1.0) {
+	std::vector< float > data(count);
+	for (size_t i = 0; i < count; ++i) {
+		data[i] = float(0.5 * std::sin(Tau * frequency * (double(i) * step) / double(rate)));
+	}
+	return data;
+}
+
+//SNR (in dB) of 'got' against 'expected', skipping 'margin' values at each end (where the filters see the zero padding):
+static double snr(std::vector< float > const &got, std::vector< float > const &expected, size_t margin) {
+	double signal = 0.0;
+	double noise = 0.0;
+	for (size_t i = margin; i + margin < std::min(got.size(), expected.size()); ++i) {
+		signal += double(expected[i]) * double(expected[i]);
+		noise += (double(got[i]) - double(expected[i])) * (double(got[i]) - double(expected[i]));
+	}
+	return 10.0 * std::log10(signal / std::max(noise, 1e-30));
+}
+
+template< typename F >
+static double time_ms(F const &f) {
+	auto before = std::chrono::high_resolution_clock::now();
+	f();
+	auto after = std::chrono::high_resolution_clock::now();
+	return std::chrono::duration< double, std::milli >(after - before).count();
+}
+
+int main() {
+	bool failed = false;
+	auto report = [&](std::string const &name, double db, double ms, size_t count, double min_snr) {
+		std::cout << "  " << name << ": " << db << " dB SNR, " << (count / ms / 1000.0) << " Msamples/s";
+		if (!(db >= min_snr)) {
+			std::cout << " (FAILED; expected at least " << min_snr << " dB)";
+			failed = true;
+		}
+		std::cout << std::endl;
+	};
+
+	//------ load-time conversion ------
+	std::cout << "resample() (two seconds of audio):" << std::endl;
+	struct Rates { uint32_t in, out; };
+	for (Rates rates : { Rates{44100, 48000}, Rates{22050, 48000}, Rates{32000, 48000}, Rates{96000, 48000}, Rates{44100, 22050} }) {
+		//tones well inside the passband, plus one near its edge:
+		double nyquist = 0.5 * std::min(rates.in, rates.out);
+		for (double frequency : { 440.0, 0.25 * nyquist, 0.8 * nyquist }) {
+			std::vector< float > in = make_sine(frequency, rates.in, 2 * rates.in);
+			std::vector< float > out;
+			double ms = time_ms([&](){ resample(in, rates.in, rates.out, &out); });
+			double db = snr(out, make_sine(frequency, rates.out, out.size()), rates.out / 10);
+			report(std::to_string(rates.in) + " -> " + std::to_string(rates.out) + " Hz, " + std::to_string(int(frequency)) + " Hz tone", db, ms, out.size(), MinSNR);
+		}
+	}
+
+	//------ per-voice rates ------
+	std::cout << "resample_run() (1kHz tone):" << std::endl;
+	struct Mode { Interpolation interpolation; char const *name; double min_snr; };
+	struct Steps { double start, end; };
+	for (Steps steps : { Steps{0.5, 0.5}, Steps{44100.0 / 48000.0, 44100.0 / 48000.0}, Steps{1.0, 1.0}, Steps{4.0 / 3.0, 4.0 / 3.0}, Steps{1.5, 1.5}, Steps{0.8, 1.25} }) {
+		constexpr uint32_t Rate = 48000;
+		constexpr double Frequency = 1000.0;
+		std::vector< float > in = make_sine(Frequency, Rate, 2 * Rate);
+
+		//in mixer-sized pieces, as the mixer would, with the step ramping linearly from start to end:
+		constexpr uint32_t Block = 1024;
+		uint32_t blocks = uint32_t(double(in.size()) / (0.5 * (steps.start + steps.end)) / Block) - 1;
+		float step_change = float((steps.end - steps.start) / (blocks * Block));
+
+		//expected output (reading at exactly the positions that resample_run() should):
+		std::vector< float > expected(blocks * Block);
+		for (size_t n = 0; n < expected.size(); ++n) {
+			double block_start = float(steps.start + (n / Block) * Block * double(step_change)); //(rounded like the mixer rounds it)
+			size_t b = (n / Block) * Block;
+			double position = 0.0;
+			for (size_t earlier = 0; earlier < n / Block; ++earlier) {
+				double s = float(steps.start + earlier * Block * double(step_change));
+				position += Block * s + double(step_change) * (double(Block) * (Block - 1) * 0.5);
+			}
+			double m = double(n - b);
+			position += m * block_start + double(step_change) * (m * (m - 1.0) * 0.5);
+			expected[n] = float(0.5 * std::sin(Tau * Frequency * position / Rate));
+		}
+
+		std::string name = "step " + std::to_string(steps.start);
+		if (steps.end != steps.start) name += " -> " + std::to_string(steps.end);
+		//(cubic interpolation's error grows with frequency; at 1kHz it should be well below audibility)
+		for (Mode mode : { Mode{Interpolation::Linear, "linear", 50.0}, Mode{Interpolation::Cubic, "cubic", 70.0}, Mode{Interpolation::Sinc, "windowed sinc", MinSNR} }) {
+			std::vector< float > out(expected.size());
+			double ms = time_ms([&](){
+				uint32_t index = 0;
+				float fraction = 0.0f;
+				for (uint32_t block = 0; block < blocks; ++block) {
+					float step = float(steps.start + block * Block * double(step_change));
+					resample_run(mode.interpolation, in.data(), uint32_t(in.size()), false, &index, &fraction, step, step_change, Block, out.data() + block * Block);
+				}
+			});
+			report(name + ", " + mode.name, snr(out, expected, Rate / 10), ms, out.size(), mode.min_snr);
+		}
+	}
+
+	if (failed) {
+		std::cerr << "Some cases were below their expected quality." << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,127 @@
+#include "crc32c.hpp"
+
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#include <nmmintrin.h>
+#define CRC32C_USE_SSE42
+#define CRC32C_TARGET __attribute__((target("sse4.2")))
+#elif defined(_M_X64)
+#include <nmmintrin.h>
+#include <intrin.h>
+#define CRC32C_USE_SSE42
+#define CRC32C_TARGET
+#elif defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define CRC32C_USE_ARM
+#endif
+
+namespace {
+	//slicing-by-8 tables for the reflected polynomial 0x82f63b78:
+	struct Tables {
+		Tables() {
+			for (uint32_t i = 0; i < 256; ++i) {
+				uint32_t c = i;
+				for (uint32_t k = 0; k < 8; ++k) {
+					c = (c & 1) ? (c >> 1) ^ 0x82f63b78U : (c >> 1);
+				}
+				table[0][i] = c;
+			}
+			for (uint32_t i = 0; i < 256; ++i) {
+				for (uint32_t t = 1; t < 8; ++t) {
+					table[t][i] = (table[t-1][i] >> 8) ^ table[0][table[t-1][i] & 0xff];
+				}
+			}
+		}
+		uint32_t table[8][256];
+	};
+
+	Tables const &get_tables() {
+		static Tables tables;
+		return tables;
+	}
+
+	uint32_t crc32c_software(uint8_t const *data, size_t size, uint32_t crc) {
+		auto const &t = get_tables().table;
+		while (size >= 8) {
+			uint32_t lo, hi;
+			std::memcpy(&lo, data, 4);
+			std::memcpy(&hi, data + 4, 4);
+			lo ^= crc; //(little-endian, like the chunk files themselves)
+			crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24]
+			    ^ t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^ t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+			data += 8;
+			size -= 8;
+		}
+		for (; size > 0; --size, ++data) {
+			crc = (crc >> 8) ^ t[0][(crc ^ *data) & 0xff];
+		}
+		return crc;
+	}
+
+#if defined(CRC32C_USE_SSE42)
+	CRC32C_TARGET uint32_t crc32c_sse42(uint8_t const *data, size_t size, uint32_t crc) {
+	#if defined(__x86_64__) || defined(_M_X64)
+		uint64_t c = crc;
+		for (; size >= 8; size -= 8, data += 8) {
+			uint64_t v;
+			std::memcpy(&v, data, 8);
+			c = _mm_crc32_u64(c, v);
+		}
+		crc = uint32_t(c);
+	#endif
+		for (; size >= 4; size -= 4, data += 4) {
+			uint32_t v;
+			std::memcpy(&v, data, 4);
+			crc = _mm_crc32_u32(crc, v);
+		}
+		for (; size > 0; --size, ++data) {
+			crc = _mm_crc32_u8(crc, *data);
+		}
+		return crc;
+	}
+
+	bool has_sse42() {
+	#if defined(_M_X64)
+		int info[4];
+		__cpuid(info, 1);
+		return (info[2] & (1 << 20)) != 0;
+	#else
+		return __builtin_cpu_supports("sse4.2");
+	#endif
+	}
+#elif defined(CRC32C_USE_ARM)
+	uint32_t crc32c_arm(uint8_t const *data, size_t size, uint32_t crc) {
+		for (; size >= 8; size -= 8, data += 8) {
+			uint64_t v;
+			std::memcpy(&v, data, 8);
+			crc = __crc32cd(crc, v);
+		}
+		for (; size > 0; --size, ++data) {
+			crc = __crc32cb(crc, *data);
+		}
+		return crc;
+	}
+#endif
+}
+
+bool crc32c_hardware() {
+#if defined(CRC32C_USE_SSE42)
+	static bool const hardware = has_sse42();
+	return hardware;
+#elif defined(CRC32C_USE_ARM)
+	return true;
+#else
+	return false;
+#endif
+}
+
+uint32_t crc32c(uint8_t const *data, size_t size, uint32_t crc) {
+	crc = ~crc;
+#if defined(CRC32C_USE_SSE42)
+	if (crc32c_hardware()) return ~crc32c_sse42(data, size, crc);
+#elif defined(CRC32C_USE_ARM)
+	return ~crc32c_arm(data, size, crc);
+#endif
+	return ~crc32c_software(data, size, crc);
+}
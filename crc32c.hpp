@@ -0,0 +1,20 @@
+#pragma once
+
+/*
+ * CRC-32C (Castagnoli) checksums, used to validate chunks in chunk files
+ *  (see ChunkFile.hpp).
+ *
+ * Uses the CPU's CRC32 instruction when there is one (SSE4.2 on x86, checked
+ *  at runtime; the CRC extension on ARMv8) and a table-driven version otherwise.
+ *
+ */
+
+#include <cstddef>
+#include <cstdint>
+
+//checksum of 'size' bytes at 'data':
+// (pass a previous result as 'crc' to continue a checksum over several pieces)
+uint32_t crc32c(uint8_t const *data, size_t size, uint32_t crc = 0);
+
+//is the hardware version in use?
+bool crc32c_hardware();
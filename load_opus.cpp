@@ -7,14 +7,17 @@
 #include <cmath>
 #include <stdexcept>
 #include <iostream>
+#include <algorithm>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
 
 void load_opus(std::string const &filename, std::vector< float > *data_) {
 	assert(data_);
 	auto &data = *data_;
 	data.clear();
 
-	std::cout << "loading '" << filename << "'..."; std::cout.flush();
-
 	//will hold opusfile * int a std::unique_ptr so that it will automatically be deleted:
 	int err = 0;
 	std::unique_ptr< OggOpusFile, decltype(&op_free) > op(
@@ -40,7 +43,6 @@ void load_opus(std::string const &filename, std::vector< float > *data_) {
 		int ret = op_read_float_stereo(op.get(), pcm.data(), int(pcm.size()));
 		if (ret >= 0) {
 			//positive return values are the number of samples read per channel; copy into data:
-			data.reserve(data.size() + ret);
 			for (uint32_t i = 0; i < uint32_t(ret); ++i) {
 				data.emplace_back((pcm[2*i] + pcm[2*i+1]) * 0.5f); //downmix to mono by averaging
 			}
@@ -50,5 +52,165 @@ void load_opus(std::string const &filename, std::vector< float > *data_) {
 		}
 	}
 
-	std::cout << " done." << std::endl;
+	//(printed all at once, since samples may be loading on several threads)
+	std::cout << "loaded '" << filename << "' (" << data.size() << " samples)." << std::endl;
+}
+
+//------------------------------------------
+
+struct OpusStream::Decoder {
+	std::string filename;
+	//(only used by the decoding thread once that is started)
+	std::unique_ptr< OggOpusFile, decltype(&op_free) > op = std::unique_ptr< OggOpusFile, decltype(&op_free) >(nullptr, op_free);
+
+	std::mutex mutex; //protects everything below
+	std::condition_variable wake; //notified on restart() and on destruction
+	std::condition_variable decoded; //notified when more data is decoded (or decoding stops)
+
+	bool loop = false; //seek back to the start at the end of the file?
+	bool at_end = false; //stopped decoding at the end of the file?
+	bool started = false; //has restart() been called yet?
+	bool seek_pending = false; //should the decoding thread seek back to the start?
+	bool clear_pending = false; //...and throw away anything decoded ahead?
+	bool quit = false; //should the thread exit?
+
+	std::thread thread;
+};
+
+//largest number of samples (per channel) returned by one op_read_float_stereo() call (120ms):
+static constexpr uint32_t MaxFrameSize = 5760;
+
+//restart() waits until this many values are decoded, so playback doesn't begin by running out:
+static constexpr uint32_t PrerollSize = 4096;
+
+OpusStream::OpusStream(std::string const &filename) : decoder(new Decoder), ring(new float[RingSize]) {
+	decoder->filename = filename;
+
+	int err = 0;
+	decoder->op.reset(op_open_file(filename.c_str(), &err));
+	if (err != 0) {
+		throw std::runtime_error("opusfile error " + std::to_string(err) + " opening \"" + filename + "\".");
+	}
+
+	//start decoding right away, so that the beginning is ready to play:
+	decoder->thread = std::thread([this](){
+		Decoder &d = *decoder;
+		std::vector< float > pcm(2 * MaxFrameSize);
+		bool decoded_since_seek = false; //(avoids looping forever over an empty file)
+		uint32_t reported_underruns = 0;
+
+		std::unique_lock< std::mutex > lock(d.mutex);
+		while (!d.quit) {
+			if (uint32_t count = underruns.load(std::memory_order_relaxed); count != reported_underruns) {
+				std::cerr << "WARNING: '" << d.filename << "' ran out of decoded audio (" << (count - reported_underruns) << " times)." << std::endl;
+				reported_underruns = count;
+			}
+
+			if (d.seek_pending) {
+				//restart() was called:
+				if (d.clear_pending) {
+					//(safe because there is no consumer right now)
+					read.store(written.load(std::memory_order_relaxed), std::memory_order_relaxed);
+				}
+				d.at_end = false;
+				int err = op_pcm_seek(d.op.get(), 0);
+				if (err != 0) {
+					std::cerr << "WARNING: opusfile error " << err << " seeking in \"" << d.filename << "\"; stopping stream." << std::endl;
+					d.at_end = true;
+				}
+				ended.store(d.at_end, std::memory_order_release);
+				decoded_since_seek = false;
+				d.seek_pending = d.clear_pending = false;
+				d.decoded.notify_all();
+			}
+
+			uint64_t w = written.load(std::memory_order_relaxed);
+			uint64_t space = RingSize - (w - read.load(std::memory_order_acquire));
+			if (d.at_end || space < MaxFrameSize) {
+				//nothing to do for now; check again soon (the ring holds far more than this):
+				d.wake.wait_for(lock, std::chrono::milliseconds(10));
+				continue;
+			}
+
+			//decode without holding the lock, so restart() doesn't wait on it:
+			lock.unlock();
+			int ret = op_read_float_stereo(d.op.get(), pcm.data(), int(pcm.size()));
+			if (ret > 0) {
+				//downmix to mono (by averaging) into the ring:
+				for (uint32_t i = 0; i < uint32_t(ret); ++i) {
+					ring[(w + i) & (RingSize - 1)] = (pcm[2*i] + pcm[2*i+1]) * 0.5f;
+				}
+				written.store(w + uint32_t(ret), std::memory_order_release);
+				decoded_since_seek = true;
+			}
+			lock.lock();
+
+			if (ret < 0) {
+				std::cerr << "WARNING: opusfile read error " << ret << " reading \"" << d.filename << "\"; stopping stream." << std::endl;
+				d.at_end = true;
+			} else if (ret == 0) {
+				if (d.loop && decoded_since_seek) {
+					d.seek_pending = true;
+				} else {
+					d.at_end = true;
+				}
+			}
+			if (d.at_end) {
+				ended.store(true, std::memory_order_release);
+			}
+			d.decoded.notify_all();
+		}
+	});
+}
+
+OpusStream::~OpusStream() {
+	{
+		std::lock_guard< std::mutex > lock(decoder->mutex);
+		decoder->quit = true;
+	}
+	decoder->wake.notify_one();
+	decoder->thread.join();
+}
+
+void OpusStream::restart(bool loop) {
+	Decoder &d = *decoder;
+	std::unique_lock< std::mutex > lock(d.mutex);
+
+	if (d.started) {
+		//played before, so start over and throw away whatever was decoded ahead:
+		d.seek_pending = true;
+		d.clear_pending = true;
+	}
+	//(otherwise, the ring already starts at the beginning of the file)
+
+	d.loop = loop;
+	if (d.at_end && d.loop) {
+		//decoder already stopped at the end of the file, but should continue from the start:
+		d.seek_pending = true;
+	}
+	d.started = true;
+
+	d.wake.notify_one();
+	d.decoded.wait(lock, [&](){
+		return !d.seek_pending && (d.at_end || written.load(std::memory_order_relaxed) - read.load(std::memory_order_relaxed) >= PrerollSize);
+	});
+}
+
+uint32_t OpusStream::peek(float const **data, uint32_t count) const {
+	uint64_t r = read.load(std::memory_order_relaxed);
+	uint64_t available = written.load(std::memory_order_acquire) - r;
+	uint32_t offset = uint32_t(r & (RingSize - 1));
+	*data = ring.get() + offset;
+	return uint32_t(std::min< uint64_t >({ uint64_t(count), available, uint64_t(RingSize - offset) }));
+}
+
+void OpusStream::consume(uint32_t count) {
+	assert(count <= written.load(std::memory_order_relaxed) - read.load(std::memory_order_relaxed));
+	read.store(read.load(std::memory_order_relaxed) + count, std::memory_order_release);
+}
+
+bool OpusStream::finished() const {
+	//(check 'ended' first, so that no values can be written between the two checks)
+	return ended.load(std::memory_order_acquire)
+	    && read.load(std::memory_order_relaxed) == written.load(std::memory_order_acquire);
 }
@@ -1,7 +1,45 @@
 #pragma once
 
+#include <atomic>
+#include <memory>
 #include <string>
 #include <vector>
 
 //Load an opus file as 48kHz floating-point mono; throws on error:
 void load_opus(std::string const &filename, std::vector< float > *data);
+
+//An OpusStream decodes an opus file as 48kHz floating-point mono a bit at a time:
+// a background thread decodes ahead into a ring buffer, which one consumer
+// (the audio thread, via Sound::Stream) reads from without blocking.
+struct OpusStream {
+	//opens the file and starts decoding; throws on error:
+	OpusStream(std::string const &filename);
+	~OpusStream();
+
+	//(game thread; only while no consumer is reading)
+	//prepare to read from the start of the file, looping back to the start at the end if 'loop' is set:
+	// (waits until the first few thousand values are decoded)
+	void restart(bool loop);
+
+	//(consumer) get up to 'count' decoded values, contiguous in memory, starting at *data;
+	// returns the number available (which may be zero if the decoder has fallen behind):
+	uint32_t peek(float const **data, uint32_t count) const;
+	//(consumer) mark 'count' values (at most the number returned by peek) as read:
+	void consume(uint32_t count);
+	//(consumer) has every value been read? (never true when looping)
+	bool finished() const;
+
+	//number of times a consumer has found the ring empty before the end of the file:
+	std::atomic< uint32_t > underruns{0};
+
+	//internals:
+	struct Decoder;
+	std::unique_ptr< Decoder > decoder;
+
+	//ring of decoded values (written by the decoder thread):
+	static constexpr uint32_t RingSize = 1 << 16; //(~1.4 seconds of audio)
+	std::unique_ptr< float[] > ring;
+	alignas(64) std::atomic< uint64_t > written{0}; //values written so far (advanced by decoder)
+	alignas(64) std::atomic< uint64_t > read{0}; //values read so far (advanced by consumer)
+	std::atomic< bool > ended{false}; //has the decoder written the last value?
+};
@@ -1,4 +1,5 @@
 #include "load_save_png.hpp"
+#include "vfs.hpp"
 
 #include <png.h>
 
@@ -17,7 +18,8 @@ void save_png(std::ostream &to, unsigned int width, unsigned int height, glm::u8
 void load_png(std::string filename, glm::uvec2 *size, std::vector< glm::u8vec4 > *data, OriginLocation origin) {
 	assert(size);
 
-	std::ifstream file(filename.c_str(), std::ios::binary);
+	std::unique_ptr< std::istream > stream = vfs_open(filename); //(from a pack, if one holds it)
+	std::istream &file = *stream;
 	if (!file) {
 		throw std::runtime_error("Failed to open PNG image file '" + filename + "'.");
 	}
@@ -1,10 +1,10 @@
 #include "load_wav.hpp"
+#include "resample.hpp"
 
 #include <SDL.h>
 
 #include <iostream>
 #include <cassert>
-#include <algorithm>
 
 constexpr uint32_t AUDIO_RATE = 48000;
 
@@ -22,10 +22,12 @@ void load_wav(std::string const &filename, std::vector< float > *data_) {
 	}
 
 	//based on the SDL_AudioCVT example in the docs: https://wiki.libsdl.org/SDL_AudioCVT
+	// (only the format and channels are converted here; SDL's rate conversion is low quality, so resample() does that)
+	std::vector< float > converted;
 	SDL_AudioCVT cvt;
-	SDL_BuildAudioCVT(&cvt, have->format, have->channels, have->freq, AUDIO_F32SYS, 1, AUDIO_RATE);
+	SDL_BuildAudioCVT(&cvt, have->format, have->channels, have->freq, AUDIO_F32SYS, 1, have->freq);
 	if (cvt.needed) {
-		std::cout << "WAV file '" + filename + "' didn't load as " + std::to_string(AUDIO_RATE) + " Hz, float32, mono; converting." << std::endl;
+		std::cout << "WAV file '" + filename + "' didn't load as float32, mono; converting." << std::endl;
 		cvt.len = audio_len;
 		cvt.buf = (Uint8 *)SDL_malloc(cvt.len * cvt.len_mult);
 		SDL_memcpy(cvt.buf, audio_buf, audio_len);
@@ -33,18 +35,18 @@ void load_wav(std::string const &filename, std::vector< float > *data_) {
 		int final_size = cvt.len_cvt;
 		assert(final_size >= 0 && final_size <= cvt.len * cvt.len_mult && "Converted audio should fit in buffer.");
 		assert(final_size % 4 == 0 && "Converted audio should consist of 4-byte elements.");
-		data.assign(reinterpret_cast< float * >(cvt.buf), reinterpret_cast< float * >(cvt.buf + final_size));
+		converted.assign(reinterpret_cast< float * >(cvt.buf), reinterpret_cast< float * >(cvt.buf + final_size));
 		SDL_free(cvt.buf);
 	} else {
-		data.assign(reinterpret_cast< float * >(audio_buf), reinterpret_cast< float * >(audio_buf + audio_len));
+		converted.assign(reinterpret_cast< float * >(audio_buf), reinterpret_cast< float * >(audio_buf + audio_len));
 	}
+	int freq = have->freq;
 	SDL_FreeWAV(audio_buf);
 
-	float min = 0.0f;
-	float max = 0.0f;
-	for (auto d : data) {
-		min = std::min(min, d);
-		max = std::max(max, d);
+	if (freq != int(AUDIO_RATE)) {
+		std::cout << "WAV file '" + filename + "' is " + std::to_string(freq) + " Hz; resampling to " + std::to_string(AUDIO_RATE) + " Hz." << std::endl;
+		resample(converted, uint32_t(freq), AUDIO_RATE, &data);
+	} else {
+		data = std::move(converted);
 	}
-	std::cout << "Range: " << min << ", " << max << std::endl;
 }
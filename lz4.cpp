@@ -0,0 +1,135 @@
+#include "lz4.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+	//block format limits:
+	constexpr size_t MinMatch = 4; //matches are at least this long
+	constexpr size_t LastLiterals = 5; //the last five bytes are always literals
+	constexpr size_t MatchSafety = 12; //...and the last match starts at least twelve bytes before the end
+	constexpr size_t MaxOffset = 65535;
+
+	constexpr uint32_t HashBits = 16;
+
+	uint32_t read32(uint8_t const *at) {
+		uint32_t ret;
+		std::memcpy(&ret, at, 4);
+		return ret;
+	}
+
+	//lengths of 15 or more continue in extra bytes (255 meaning "keep going"):
+	void write_length(std::vector< uint8_t > &out, size_t length) {
+		length -= 15;
+		while (length >= 255) {
+			out.emplace_back(uint8_t(255));
+			length -= 255;
+		}
+		out.emplace_back(uint8_t(length));
+	}
+
+	void write_sequence(std::vector< uint8_t > &out, uint8_t const *literals, size_t literal_count, size_t offset, size_t match_length) {
+		size_t match_code = (match_length ? match_length - MinMatch : 0);
+		out.emplace_back(uint8_t((std::min< size_t >(literal_count, 15) << 4) | std::min< size_t >(match_code, 15)));
+		if (literal_count >= 15) write_length(out, literal_count);
+		out.insert(out.end(), literals, literals + literal_count);
+		if (match_length == 0) return; //(the last sequence is only literals)
+		out.emplace_back(uint8_t(offset & 0xff));
+		out.emplace_back(uint8_t(offset >> 8));
+		if (match_code >= 15) write_length(out, match_code);
+	}
+}
+
+std::vector< uint8_t > lz4_compress(uint8_t const *data, size_t size) {
+	std::vector< uint8_t > out;
+	out.reserve(size + size / 255 + 16);
+
+	//position + 1 of the last place each (hashed) four bytes were seen (0 for "never"):
+	std::vector< uint32_t > table(size_t(1) << HashBits, 0);
+	auto hash = [](uint32_t sequence) {
+		return (sequence * 2654435761U) >> (32 - HashBits);
+	};
+
+	size_t anchor = 0; //start of literals not yet written
+	size_t at = 0;
+	size_t match_limit = (size > MatchSafety ? size - MatchSafety : 0); //matches must start before here
+	size_t end_limit = (size > LastLiterals ? size - LastLiterals : 0); //...and end by here
+	while (at < match_limit) {
+		uint32_t sequence = read32(data + at);
+		uint32_t &entry = table[hash(sequence)];
+		size_t candidate = entry;
+		entry = uint32_t(at + 1);
+		if (candidate == 0 || at - (candidate - 1) > MaxOffset || read32(data + candidate - 1) != sequence) {
+			at += 1;
+			continue;
+		}
+		candidate -= 1;
+
+		//extend the match forward:
+		size_t length = MinMatch;
+		while (at + length < end_limit && data[candidate + length] == data[at + length]) length += 1;
+
+		write_sequence(out, data + anchor, at - anchor, at - candidate, length);
+		at += length;
+		anchor = at;
+	}
+	write_sequence(out, data + anchor, size - anchor, 0, 0);
+	return out;
+}
+
+void lz4_decompress(uint8_t const *data, size_t size, uint8_t *out, size_t out_size) {
+	size_t in = 0;
+	size_t written = 0;
+
+	auto read_length = [&](size_t length) {
+		if (length != 15) return length;
+		while (true) {
+			if (in >= size) throw std::runtime_error("LZ4 data ends in a length.");
+			uint8_t more = data[in++];
+			length += more;
+			if (more != 255) return length;
+		}
+	};
+
+	while (true) {
+		if (in >= size) throw std::runtime_error("LZ4 data ends before its last sequence.");
+		uint8_t token = data[in++];
+
+		size_t literal_count = read_length(token >> 4);
+		if (literal_count > size - in || literal_count > out_size - written) {
+			throw std::runtime_error("LZ4 literals run past the end of the data.");
+		}
+		if (literal_count <= 16 && size - in >= 16 && out_size - written >= 16) {
+			std::memcpy(out + written, data + in, 16); //(fixed-size copies are faster; extra bytes are overwritten later)
+		} else {
+			std::memcpy(out + written, data + in, literal_count);
+		}
+		in += literal_count;
+		written += literal_count;
+
+		if (in == size) break; //(the last sequence has no match)
+
+		if (size - in < 2) throw std::runtime_error("LZ4 data ends in a match offset.");
+		size_t offset = size_t(data[in]) | (size_t(data[in + 1]) << 8);
+		in += 2;
+		if (offset == 0 || offset > written) throw std::runtime_error("LZ4 match offset is out of range.");
+
+		size_t length = read_length(token & 0xf) + MinMatch;
+		if (length > out_size - written) throw std::runtime_error("LZ4 match runs past the end of the output.");
+		uint8_t const *from = out + written - offset;
+		uint8_t *to = out + written;
+		if (offset >= 8 && length + 8 <= out_size - written) {
+			//(eight bytes at a time -- possibly writing a few past the match, which later sequences overwrite)
+			for (size_t i = 0; i < length; i += 8) std::memcpy(to + i, from + i, 8);
+		} else if (offset >= length) {
+			std::memcpy(to, from, length);
+		} else {
+			//(overlapping matches repeat the last 'offset' bytes)
+			for (size_t i = 0; i < length; ++i) to[i] = from[i];
+		}
+		written += length;
+	}
+
+	if (written != out_size) throw std::runtime_error("LZ4 data decompressed to the wrong size.");
+}
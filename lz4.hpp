@@ -0,0 +1,23 @@
+#pragma once
+
+/*
+ * Compression in the LZ4 block format (https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md),
+ *  used for compressed entries in Packs (see Pack.hpp).
+ *
+ * LZ4 decompresses at several GB/s, so compressed assets usually load faster
+ *  than reading the uncompressed bytes from disk; the compressor here is a
+ *  simple greedy one (output is readable by the reference decoder, but is a
+ *  bit larger than the reference compressor's).
+ *
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//compress 'size' bytes from 'data':
+std::vector< uint8_t > lz4_compress(uint8_t const *data, size_t size);
+
+//decompress 'size' bytes from 'data' into exactly 'out_size' bytes at 'out':
+// (throws if the compressed data is malformed or doesn't decompress to exactly 'out_size' bytes)
+void lz4_decompress(uint8_t const *data, size_t size, uint8_t *out, size_t out_size);
@@ -6,6 +6,10 @@
 
 //For asset loading:
 #include "Load.hpp"
+#include "HotReload.hpp"
+#include "vfs.hpp"
+#include "data_path.hpp"
+#include "Mesh.hpp"
 
 //For sound init:
 #include "Sound.hpp"
@@ -24,6 +28,7 @@
 #include <iostream>
 #include <stdexcept>
 #include <memory>
+#include <string>
 #include <algorithm>
 
 int main(int argc, char **argv) {
@@ -32,6 +37,10 @@ int main(int argc, char **argv) {
 	try {
 #endif
 
+	//(for reporting time-to-first-frame, below)
+	auto startup_time = std::chrono::high_resolution_clock::now();
+	bool shown_first_frame = false;
+
 	//------------  initialization ------------
 
 	//Initialize SDL library:
@@ -93,11 +102,29 @@ int main(int argc, char **argv) {
 	//SDL_ShowCursor(SDL_DISABLE);
 
 	//------------ init sound --------------
-	Sound::init();
+	//(pass --low-latency-audio to mix in smaller blocks; see Sound.hpp)
+	bool low_latency_audio = false;
+	for (int i = 1; i < argc; ++i) {
+		if (std::string(argv[i]) == "--low-latency-audio") low_latency_audio = true;
+	}
+	Sound::init(low_latency_audio ? Sound::LowLatencyBlockFrames : Sound::DefaultBlockFrames);
 
 	//------------ load assets --------------
+	//(pass --hot-reload to reload assets when their files change; see HotReload.hpp)
+	bool hot_reload = false;
+	for (int i = 1; i < argc; ++i) {
+		if (std::string(argv[i]) == "--hot-reload") hot_reload = true;
+	}
+
+	//read assets from the pack, if there is one (but not when hot-reloading, since edits go to the loose files):
+	if (!hot_reload && vfs_mount(data_path("assets.pack"))) {
+		std::cout << "Reading assets from '" << data_path("assets.pack") << "'." << std::endl;
+	}
+
 	call_load_functions();
 
+	if (hot_reload) HotReload::init();
+
 	//------------ create game mode + make current --------------
 	Mode::set_current(std::make_shared< PlayMode >());
 
@@ -123,6 +150,9 @@ int main(int argc, char **argv) {
 		//every pass through the game loop creates one frame of output
 		//  by performing three steps:
 
+		//(between frames, swap in any assets that were reloaded)
+		HotReload::update();
+
 		{ //(1) process any events that are pending
 			static SDL_Event evt;
 			while (SDL_PollEvent(&evt) == 1) {
@@ -172,16 +202,25 @@ int main(int argc, char **argv) {
 		}
 
 		{ //(3) call the current mode's "draw" function to produce output:
-		
+
+			//stream in a few MB of any background-loaded mesh data first:
+			MeshBuffer::upload_pending(4 * 1024 * 1024);
+
 			Mode::current->draw(drawable_size);
 		}
 
 		//Wait until the recently-drawn frame is shown before doing it all again:
 		SDL_GL_SwapWindow(window);
+
+		if (!shown_first_frame) {
+			shown_first_frame = true;
+			std::cout << "First frame after " << std::chrono::duration< double, std::milli >(std::chrono::high_resolution_clock::now() - startup_time).count() << " ms." << std::endl;
+		}
 	}
 
 
 	//------------  teardown ------------
+	HotReload::shutdown();
 	Sound::shutdown();
 
 	SDL_GL_DeleteContext(context);
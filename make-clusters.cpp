@@ -0,0 +1,258 @@
+/*
+ * make-clusters reads a '.pnct' mesh file, splits every mesh into clusters of
+ *  ~64-128 triangles, and writes the file back with a 'clu0' chunk that
+ *  records each cluster's vertex range, bounding sphere, and normal cone.
+ *
+ * Triangles are re-ordered within each mesh (so clusters are contiguous
+ *  vertex ranges), but meshes keep their vertex ranges, so the 'idx0' chunk
+ *  -- and any other chunks -- are written back unchanged.
+ *
+ * The input may be a version 1 or 2 chunk file; the output is version 2 (see ChunkFile.hpp).
+ *
+ * Clustering is done by bucketing triangles by their dominant normal axis
+ *  (which keeps normal cones tight) and then recursively splitting each
+ *  bucket at the median centroid along its longest axis.
+ *
+ */
+
+#include "ChunkFile.hpp"
+#include "MappedFile.hpp"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cmath>
+
+//vertex format used by '.pnct' files (see Mesh.cpp):
+struct Vertex {
+	glm::vec3 Position;
+	glm::vec3 Normal;
+	glm::u8vec4 Color;
+	glm::vec2 TexCoord;
+};
+static_assert(sizeof(Vertex) == 3*4+3*4+4*1+2*4, "Vertex is packed.");
+
+struct Triangle {
+	Vertex v[3];
+};
+static_assert(sizeof(Triangle) == 3*sizeof(Vertex), "Triangle is packed.");
+
+struct IndexEntry {
+	uint32_t name_begin, name_end;
+	uint32_t vertex_begin, vertex_end;
+};
+static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
+
+struct ClusterEntry {
+	uint32_t vertex_begin, vertex_end;
+	glm::vec3 center;
+	float radius;
+	glm::vec3 cone_axis;
+	float cone_cutoff;
+};
+static_assert(sizeof(ClusterEntry) == 4+4+4*3+4+4*3+4, "Cluster entry should be packed");
+
+//clusters are split until they have at most this many triangles:
+// (median splits mean most clusters end up with between half this and this many)
+constexpr uint32_t MaxClusterTriangles = 128;
+
+static glm::vec3 centroid(Triangle const &tri) {
+	return (tri.v[0].Position + tri.v[1].Position + tri.v[2].Position) / 3.0f;
+}
+
+static glm::vec3 face_normal(Triangle const &tri) {
+	glm::vec3 n = glm::cross(tri.v[1].Position - tri.v[0].Position, tri.v[2].Position - tri.v[0].Position);
+	float len = glm::length(n);
+	if (len == 0.0f) return glm::vec3(0.0f); //degenerate
+	return n / len;
+}
+
+//compute bounds for triangles [begin,end) which start at vertex 'vertex_begin':
+static ClusterEntry make_cluster(Triangle const *begin, Triangle const *end, uint32_t vertex_begin) {
+	ClusterEntry entry;
+	entry.vertex_begin = vertex_begin;
+	entry.vertex_end = vertex_begin + uint32_t(end - begin) * 3;
+
+	//bounding sphere around the box center:
+	glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+	glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+	for (Triangle const *t = begin; t != end; ++t) {
+		for (uint32_t i = 0; i < 3; ++i) {
+			min = glm::min(min, t->v[i].Position);
+			max = glm::max(max, t->v[i].Position);
+		}
+	}
+	entry.center = 0.5f * (min + max);
+	entry.radius = 0.0f;
+	for (Triangle const *t = begin; t != end; ++t) {
+		for (uint32_t i = 0; i < 3; ++i) {
+			entry.radius = std::max(entry.radius, glm::length(t->v[i].Position - entry.center));
+		}
+	}
+
+	//normal cone around the average face normal:
+	glm::vec3 sum = glm::vec3(0.0f);
+	for (Triangle const *t = begin; t != end; ++t) {
+		sum += face_normal(*t);
+	}
+	entry.cone_axis = glm::vec3(0.0f, 0.0f, 1.0f);
+	entry.cone_cutoff = 2.0f; //never back-facing
+	if (glm::length(sum) > 0.0f) {
+		entry.cone_axis = glm::normalize(sum);
+		float min_dot = 1.0f;
+		for (Triangle const *t = begin; t != end; ++t) {
+			glm::vec3 n = face_normal(*t);
+			if (n == glm::vec3(0.0f)) continue;
+			min_dot = std::min(min_dot, glm::dot(n, entry.cone_axis));
+		}
+		//cone half-angle 'a' has cos(a) == min_dot; cutoff is sin(a) == cos(90deg - a):
+		if (min_dot > 0.0f) {
+			entry.cone_cutoff = std::sqrt(std::max(0.0f, 1.0f - min_dot * min_dot));
+		}
+	}
+
+	return entry;
+}
+
+//recursively split triangles [begin,end) at the median centroid until clusters are small enough:
+static void split(Triangle *begin, Triangle *end, uint32_t vertex_begin, std::vector< ClusterEntry > *clusters) {
+	uint32_t count = uint32_t(end - begin);
+	if (count == 0) return;
+	if (count <= MaxClusterTriangles) {
+		clusters->emplace_back(make_cluster(begin, end, vertex_begin));
+		return;
+	}
+
+	glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+	glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+	for (Triangle const *t = begin; t != end; ++t) {
+		glm::vec3 c = centroid(*t);
+		min = glm::min(min, c);
+		max = glm::max(max, c);
+	}
+	glm::vec3 size = max - min;
+	int axis = 0;
+	if (size.y > size[axis]) axis = 1;
+	if (size.z > size[axis]) axis = 2;
+
+	Triangle *mid = begin + count / 2;
+	std::nth_element(begin, mid, end, [axis](Triangle const &a, Triangle const &b) {
+		return centroid(a)[axis] < centroid(b)[axis];
+	});
+
+	split(begin, mid, vertex_begin, clusters);
+	split(mid, end, vertex_begin + uint32_t(mid - begin) * 3, clusters);
+}
+
+//which of the six axis directions is the triangle's normal closest to?
+static uint32_t normal_bucket(Triangle const &tri) {
+	glm::vec3 n = face_normal(tri);
+	glm::vec3 a = glm::abs(n);
+	if (a.x >= a.y && a.x >= a.z) return (n.x >= 0.0f ? 0 : 1);
+	if (a.y >= a.z) return (n.y >= 0.0f ? 2 : 3);
+	return (n.z >= 0.0f ? 4 : 5);
+}
+
+int main(int argc, char **argv) {
+	if (argc != 3) {
+		std::cerr << "Usage:\n\t" << argv[0] << " <in.pnct> <out.pnct>\n(in and out may be the same file)" << std::endl;
+		return 1;
+	}
+	std::string in_filename = argv[1];
+	std::string out_filename = argv[2];
+
+	std::vector< Vertex > data;
+	std::vector< char > strings;
+	std::vector< IndexEntry > index;
+	ChunkFileWriter extra; //any other chunks (passed through unchanged)
+	{ //(copied out, since 'in' and 'out' may be the same file)
+		MappedFile mapped(in_filename);
+		ChunkFile file(mapped.data, mapped.size);
+		file.validate();
+		ChunkView< Vertex > data_view;
+		ChunkView< char > strings_view;
+		ChunkView< IndexEntry > index_view;
+		file.read("pnct", &data_view);
+		file.read("str0", &strings_view);
+		file.read("idx0", &index_view);
+		data.assign(data_view.begin(), data_view.end());
+		strings.assign(strings_view.begin(), strings_view.end());
+		index.assign(index_view.begin(), index_view.end());
+		for (auto const &chunk : file.chunks) {
+			std::string const &magic = chunk.magic;
+			if (magic == "pnct" || magic == "str0" || magic == "idx0") continue;
+			if (magic == "clu0") {
+				std::cout << "NOTE: replacing existing clusters." << std::endl;
+			} else {
+				extra.add(magic, mapped.data + chunk.offset, chunk.size, chunk.version);
+			}
+		}
+	}
+
+	//meshes are split in vertex order, so clusters come out sorted by vertex_begin:
+	std::vector< IndexEntry > sorted = index;
+	std::sort(sorted.begin(), sorted.end(), [](IndexEntry const &a, IndexEntry const &b) {
+		return a.vertex_begin < b.vertex_begin;
+	});
+
+	std::vector< ClusterEntry > clusters;
+	uint32_t last_end = 0;
+	for (auto const &entry : sorted) {
+		std::string name(strings.begin() + entry.name_begin, strings.begin() + entry.name_end);
+		if (!(entry.vertex_begin <= entry.vertex_end && entry.vertex_end <= data.size())) {
+			std::cerr << "ERROR: mesh '" << name << "' has an out-of-range vertex range." << std::endl;
+			return 1;
+		}
+		if (entry.vertex_begin < last_end) {
+			std::cout << "NOTE: skipping mesh '" << name << "' because it overlaps another mesh." << std::endl;
+			continue;
+		}
+		if ((entry.vertex_end - entry.vertex_begin) % 3 != 0) {
+			std::cout << "NOTE: skipping mesh '" << name << "' because it isn't made of whole triangles." << std::endl;
+			continue;
+		}
+		last_end = entry.vertex_end;
+
+		Triangle *begin = reinterpret_cast< Triangle * >(data.data() + entry.vertex_begin);
+		Triangle *end = reinterpret_cast< Triangle * >(data.data() + entry.vertex_end);
+
+		uint32_t before = uint32_t(clusters.size());
+		if (end - begin <= MaxClusterTriangles) {
+			//small meshes are kept as a single cluster:
+			split(begin, end, entry.vertex_begin, &clusters);
+		} else {
+			//group triangles by normal direction, then split each group spatially:
+			std::stable_sort(begin, end, [](Triangle const &a, Triangle const &b) {
+				return normal_bucket(a) < normal_bucket(b);
+			});
+			for (Triangle *bucket_begin = begin; bucket_begin != end; /* later */) {
+				uint32_t bucket = normal_bucket(*bucket_begin);
+				Triangle *bucket_end = bucket_begin;
+				while (bucket_end != end && normal_bucket(*bucket_end) == bucket) ++bucket_end;
+				split(bucket_begin, bucket_end, entry.vertex_begin + uint32_t(bucket_begin - begin) * 3, &clusters);
+				bucket_begin = bucket_end;
+			}
+		}
+		std::cout << "'" << name << "': " << (end - begin) << " triangles -> " << (clusters.size() - before) << " clusters." << std::endl;
+	}
+
+	ChunkFileWriter out;
+	out.add("pnct", data);
+	out.add("str0", strings);
+	out.add("idx0", index);
+	out.add("clu0", clusters);
+	out.chunks.insert(out.chunks.end(), extra.chunks.begin(), extra.chunks.end());
+	std::ofstream file(out_filename, std::ios::binary);
+	out.write(&file);
+	if (!file) {
+		std::cerr << "ERROR: failed to write '" << out_filename << "'." << std::endl;
+		return 1;
+	}
+	std::cout << "Wrote " << clusters.size() << " clusters to '" << out_filename << "'." << std::endl;
+
+	return 0;
+}
@@ -0,0 +1,363 @@
+/*
+ * make-lods reads a '.pnct' mesh file, builds a chain of simplified versions
+ *  (levels of detail) of every mesh, and writes the file back with the
+ *  simplified vertex data appended to the 'pnct' chunk and a 'lod0' chunk
+ *  that records each level's vertex range and geometric error.
+ *
+ * Simplification is quadric-error-metric edge collapse (Garland & Heckbert '97):
+ *  - triangle corners are welded by position;
+ *  - every vertex accumulates the (area-weighted) plane quadrics of its faces,
+ *    plus strongly-weighted perpendicular planes along boundary edges;
+ *  - edges are collapsed onto whichever endpoint has the lower error, cheapest
+ *    first, rejecting collapses that would flip a face.
+ * Collapsing onto an existing endpoint means each output corner can keep the
+ *  normal/color/texcoord of the original corner it came from.
+ *
+ * Existing vertex ranges are unchanged, so 'idx0' and any other chunks
+ *  (e.g., 'clu0' from make-clusters) are written back as-is.
+ *
+ * The input may be a version 1 or 2 chunk file; the output is version 2 (see ChunkFile.hpp).
+ *
+ */
+
+#include "ChunkFile.hpp"
+#include "MappedFile.hpp"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <queue>
+#include <string>
+#include <tuple>
+#include <vector>
+#include <cmath>
+
+//vertex format used by '.pnct' files (see Mesh.cpp):
+struct Vertex {
+	glm::vec3 Position;
+	glm::vec3 Normal;
+	glm::u8vec4 Color;
+	glm::vec2 TexCoord;
+};
+static_assert(sizeof(Vertex) == 3*4+3*4+4*1+2*4, "Vertex is packed.");
+
+struct IndexEntry {
+	uint32_t name_begin, name_end;
+	uint32_t vertex_begin, vertex_end;
+};
+static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
+
+struct LodEntry {
+	uint32_t mesh; //index of mesh in 'idx0' chunk
+	uint32_t vertex_begin, vertex_end;
+	float error; //approximate maximum distance from the original surface (in mesh units)
+};
+static_assert(sizeof(LodEntry) == 4+4+4+4, "LOD entry should be packed");
+
+//symmetric 4x4 matrix representing a sum of squared distances to planes:
+struct Quadric {
+	double a[10] = {0,0,0,0,0,0,0,0,0,0}; //xx xy xz xw yy yz yw zz zw ww
+	double weight = 0.0; //total weight of planes, for turning evaluate() into a mean squared distance
+
+	void add_plane(glm::vec3 const &n, float d, double weight) {
+		double p[4] = {n.x, n.y, n.z, d};
+		uint32_t k = 0;
+		for (uint32_t i = 0; i < 4; ++i) {
+			for (uint32_t j = i; j < 4; ++j) {
+				a[k++] += weight * p[i] * p[j];
+			}
+		}
+		this->weight += weight;
+	}
+	Quadric &operator+=(Quadric const &o) {
+		for (uint32_t k = 0; k < 10; ++k) a[k] += o.a[k];
+		weight += o.weight;
+		return *this;
+	}
+	double evaluate(glm::vec3 const &v) const {
+		double x = v.x, y = v.y, z = v.z;
+		return a[0]*x*x + 2.0*a[1]*x*y + 2.0*a[2]*x*z + 2.0*a[3]*x
+		     + a[4]*y*y + 2.0*a[5]*y*z + 2.0*a[6]*y
+		     + a[7]*z*z + 2.0*a[8]*z
+		     + a[9];
+	}
+};
+
+//boundary edges are held in place by planes this much stronger than face planes:
+constexpr double BoundaryWeight = 100.0;
+
+//simplify the triangles in data[begin,end), appending one vertex range per level to 'out':
+static void simplify(std::vector< Vertex > const &data, uint32_t begin, uint32_t end,
+	uint32_t levels, float ratio, std::vector< Vertex > *out, std::vector< LodEntry > *lods, uint32_t mesh_index) {
+
+	//--- weld triangle corners by position ---
+	struct Vert {
+		glm::vec3 position;
+		Quadric quadric;
+		std::vector< uint32_t > faces; //may include removed faces
+		uint32_t version = 0; //incremented whenever quadric/neighborhood changes
+		bool removed = false;
+	};
+	struct Face {
+		uint32_t v[3];
+		uint32_t corner; //index of the original triangle's first vertex in 'data'
+		bool removed = false;
+	};
+	std::vector< Vert > verts;
+	std::vector< Face > faces;
+	{
+		std::map< std::tuple< float, float, float >, uint32_t > welded;
+		for (uint32_t c = begin; c + 2 < end; c += 3) {
+			Face face;
+			face.corner = c;
+			for (uint32_t i = 0; i < 3; ++i) {
+				glm::vec3 const &p = data[c+i].Position;
+				auto ret = welded.emplace(std::make_tuple(p.x, p.y, p.z), uint32_t(verts.size()));
+				if (ret.second) {
+					verts.emplace_back();
+					verts.back().position = p;
+				}
+				face.v[i] = ret.first->second;
+			}
+			if (face.v[0] == face.v[1] || face.v[1] == face.v[2] || face.v[2] == face.v[0]) continue; //degenerate
+			for (uint32_t i = 0; i < 3; ++i) {
+				verts[face.v[i]].faces.emplace_back(uint32_t(faces.size()));
+			}
+			faces.emplace_back(face);
+		}
+	}
+	if (faces.empty()) return;
+
+	auto face_normal = [&](uint32_t a, uint32_t b, uint32_t c) {
+		return glm::cross(verts[b].position - verts[a].position, verts[c].position - verts[a].position);
+	};
+
+	//--- accumulate quadrics ---
+	std::map< std::pair< uint32_t, uint32_t >, uint32_t > edge_faces; //undirected edge -> count of faces
+	for (auto const &f : faces) {
+		glm::vec3 n = face_normal(f.v[0], f.v[1], f.v[2]);
+		float len = glm::length(n);
+		if (len == 0.0f) continue;
+		n /= len;
+		float d = -glm::dot(n, verts[f.v[0]].position);
+		for (uint32_t i = 0; i < 3; ++i) {
+			verts[f.v[i]].quadric.add_plane(n, d, 0.5 * len);
+			uint32_t a = f.v[i], b = f.v[(i+1)%3];
+			edge_faces[std::make_pair(std::min(a,b), std::max(a,b))] += 1;
+		}
+	}
+	for (auto const &f : faces) {
+		glm::vec3 n = face_normal(f.v[0], f.v[1], f.v[2]);
+		if (n == glm::vec3(0.0f)) continue;
+		n = glm::normalize(n);
+		for (uint32_t i = 0; i < 3; ++i) {
+			uint32_t a = f.v[i], b = f.v[(i+1)%3];
+			if (edge_faces[std::make_pair(std::min(a,b), std::max(a,b))] != 1) continue;
+			glm::vec3 along = verts[b].position - verts[a].position;
+			float len2 = glm::dot(along, along);
+			if (len2 == 0.0f) continue;
+			glm::vec3 perp = glm::normalize(glm::cross(along, n));
+			float d = -glm::dot(perp, verts[a].position);
+			verts[a].quadric.add_plane(perp, d, BoundaryWeight * len2);
+			verts[b].quadric.add_plane(perp, d, BoundaryWeight * len2);
+		}
+	}
+
+	//--- queue of candidate collapses (lazily invalidated by version numbers) ---
+	struct Collapse {
+		double cost;
+		double distance2; //cost divided by quadric weight
+		uint32_t from, to;
+		uint32_t from_version, to_version;
+		bool operator>(Collapse const &o) const { return cost > o.cost; }
+	};
+	std::priority_queue< Collapse, std::vector< Collapse >, std::greater< Collapse > > queue;
+	auto push_edge = [&](uint32_t a, uint32_t b) {
+		Quadric q = verts[a].quadric;
+		q += verts[b].quadric;
+		double a_into_b = std::max(0.0, q.evaluate(verts[b].position));
+		double b_into_a = std::max(0.0, q.evaluate(verts[a].position));
+		double weight = std::max(q.weight, 1e-20);
+		if (a_into_b <= b_into_a) {
+			queue.push(Collapse{a_into_b, a_into_b / weight, a, b, verts[a].version, verts[b].version});
+		} else {
+			queue.push(Collapse{b_into_a, b_into_a / weight, b, a, verts[b].version, verts[a].version});
+		}
+	};
+	for (auto const &ef : edge_faces) {
+		push_edge(ef.first.first, ef.first.second);
+	}
+
+	//would moving 'from' onto 'to' flip (or collapse) any face that doesn't contain both?
+	auto flips = [&](uint32_t from, uint32_t to) {
+		for (uint32_t fi : verts[from].faces) {
+			Face const &f = faces[fi];
+			if (f.removed) continue;
+			if (f.v[0] == to || f.v[1] == to || f.v[2] == to) continue;
+			glm::vec3 before = face_normal(f.v[0], f.v[1], f.v[2]);
+			uint32_t v[3] = {f.v[0], f.v[1], f.v[2]};
+			for (auto &x : v) if (x == from) x = to;
+			glm::vec3 after = face_normal(v[0], v[1], v[2]);
+			if (glm::dot(before, after) <= 0.0f) return true;
+		}
+		return false;
+	};
+
+	//--- collapse edges, snapshotting a level whenever the face count reaches a target ---
+	uint32_t alive = uint32_t(faces.size());
+	uint32_t snapshot_alive = alive; //face count at last snapshot (level 0 is the original)
+	double max_distance2 = 0.0;
+	for (uint32_t level = 1; level < levels; ++level) {
+		uint32_t target = std::max(1u, uint32_t(std::floor(faces.size() * std::pow(ratio, float(level)))));
+
+		while (alive > target && !queue.empty()) {
+			Collapse c = queue.top();
+			queue.pop();
+			Vert &from = verts[c.from];
+			Vert &to = verts[c.to];
+			if (from.removed || to.removed) continue;
+			if (from.version != c.from_version || to.version != c.to_version) continue;
+			if (flips(c.from, c.to)) continue;
+
+			max_distance2 = std::max(max_distance2, c.distance2);
+
+			//move faces from 'from' onto 'to', removing faces that had both:
+			for (uint32_t fi : from.faces) {
+				Face &f = faces[fi];
+				if (f.removed) continue;
+				if (f.v[0] == c.to || f.v[1] == c.to || f.v[2] == c.to) {
+					f.removed = true;
+					alive -= 1;
+				} else {
+					for (auto &x : f.v) if (x == c.from) x = c.to;
+					to.faces.emplace_back(fi);
+				}
+			}
+			to.quadric += from.quadric;
+			to.version += 1;
+			from.removed = true;
+			from.faces.clear();
+
+			//re-queue edges around 'to':
+			std::vector< uint32_t > neighbors;
+			for (uint32_t fi : to.faces) {
+				Face const &f = faces[fi];
+				if (f.removed) continue;
+				for (uint32_t x : f.v) if (x != c.to) neighbors.emplace_back(x);
+			}
+			std::sort(neighbors.begin(), neighbors.end());
+			neighbors.erase(std::unique(neighbors.begin(), neighbors.end()), neighbors.end());
+			for (uint32_t n : neighbors) push_edge(c.to, n);
+		}
+
+		if (alive >= snapshot_alive || alive == 0) break; //couldn't simplify any further (or simplified away entirely)
+		snapshot_alive = alive;
+
+		LodEntry lod;
+		lod.mesh = mesh_index;
+		lod.vertex_begin = uint32_t(out->size());
+		for (auto const &f : faces) {
+			if (f.removed) continue;
+			for (uint32_t i = 0; i < 3; ++i) {
+				Vertex v = data[f.corner + i];
+				v.Position = verts[f.v[i]].position;
+				out->emplace_back(v);
+			}
+		}
+		lod.vertex_end = uint32_t(out->size());
+		//worst mean squared distance of any collapse so far -> distance estimate:
+		lod.error = float(std::sqrt(max_distance2));
+		lods->emplace_back(lod);
+	}
+}
+
+int main(int argc, char **argv) {
+	if (argc < 3 || argc > 5) {
+		std::cerr << "Usage:\n\t" << argv[0] << " <in.pnct> <out.pnct> [levels=4] [ratio=0.5]\n"
+			"Builds 'levels' levels of detail (including the original), each with ~'ratio' times the triangles of the last.\n"
+			"(in and out may be the same file)" << std::endl;
+		return 1;
+	}
+	std::string in_filename = argv[1];
+	std::string out_filename = argv[2];
+	uint32_t levels = (argc > 3 ? uint32_t(std::stoul(argv[3])) : 4);
+	float ratio = (argc > 4 ? std::stof(argv[4]) : 0.5f);
+	if (levels < 1 || !(ratio > 0.0f && ratio < 1.0f)) {
+		std::cerr << "ERROR: need levels >= 1 and 0 < ratio < 1." << std::endl;
+		return 1;
+	}
+
+	std::vector< Vertex > data;
+	std::vector< char > strings;
+	std::vector< IndexEntry > index;
+	ChunkFileWriter extra; //any other chunks (passed through unchanged)
+	{ //(copied out, since 'in' and 'out' may be the same file)
+		MappedFile mapped(in_filename);
+		ChunkFile file(mapped.data, mapped.size);
+		file.validate();
+		ChunkView< Vertex > data_view;
+		ChunkView< char > strings_view;
+		ChunkView< IndexEntry > index_view;
+		file.read("pnct", &data_view);
+		file.read("str0", &strings_view);
+		file.read("idx0", &index_view);
+		data.assign(data_view.begin(), data_view.end());
+		strings.assign(strings_view.begin(), strings_view.end());
+		index.assign(index_view.begin(), index_view.end());
+		for (auto const &chunk : file.chunks) {
+			std::string const &magic = chunk.magic;
+			if (magic == "pnct" || magic == "str0" || magic == "idx0") continue;
+			if (magic == "lod0") {
+				//(old LOD vertex data can't be told apart from other vertex data, so it can't be replaced)
+				std::cerr << "ERROR: '" << in_filename << "' already has levels of detail; re-export it first." << std::endl;
+				return 1;
+			}
+			extra.add(magic, mapped.data + chunk.offset, chunk.size, chunk.version);
+		}
+	}
+
+	std::vector< Vertex > lod_data;
+	std::vector< LodEntry > lods;
+	for (uint32_t i = 0; i < index.size(); ++i) {
+		IndexEntry const &entry = index[i];
+		std::string name(strings.begin() + entry.name_begin, strings.begin() + entry.name_end);
+		if (!(entry.vertex_begin <= entry.vertex_end && entry.vertex_end <= data.size())) {
+			std::cerr << "ERROR: mesh '" << name << "' has an out-of-range vertex range." << std::endl;
+			return 1;
+		}
+		uint32_t before = uint32_t(lods.size());
+		simplify(data, entry.vertex_begin, entry.vertex_end, levels, ratio, &lod_data, &lods, i);
+
+		std::cout << "'" << name << "': " << (entry.vertex_end - entry.vertex_begin) / 3;
+		for (uint32_t l = before; l < lods.size(); ++l) {
+			std::cout << " -> " << (lods[l].vertex_end - lods[l].vertex_begin) / 3 << " (err " << lods[l].error << ")";
+		}
+		std::cout << " triangles." << std::endl;
+	}
+
+	//LOD vertex ranges are relative to lod_data, which goes after the existing data:
+	for (auto &lod : lods) {
+		lod.vertex_begin += uint32_t(data.size());
+		lod.vertex_end += uint32_t(data.size());
+	}
+	data.insert(data.end(), lod_data.begin(), lod_data.end());
+
+	ChunkFileWriter out;
+	out.add("pnct", data);
+	out.add("str0", strings);
+	out.add("idx0", index);
+	out.chunks.insert(out.chunks.end(), extra.chunks.begin(), extra.chunks.end());
+	out.add("lod0", lods);
+	std::ofstream file(out_filename, std::ios::binary);
+	out.write(&file);
+	if (!file) {
+		std::cerr << "ERROR: failed to write '" << out_filename << "'." << std::endl;
+		return 1;
+	}
+	std::cout << "Wrote " << lods.size() << " levels of detail (" << lod_data.size() << " vertices) to '" << out_filename << "'." << std::endl;
+
+	return 0;
+}
@@ -0,0 +1,60 @@
+/*
+ * make-pack bundles data files into a pack (see Pack.hpp), which the game and
+ *  asset viewers mount (through vfs.hpp) in place of the loose files.
+ *
+ * Entries are named by their paths relative to the given directory, so
+ *  'make-pack ../dist ../dist/assets.pack phone-bank.pnct' makes an entry that
+ *  replaces data_path("phone-bank.pnct") when the pack is mounted at data_path("").
+ *
+ */
+
+#include "Pack.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+int main(int argc, char **argv) {
+	bool compress = false;
+	std::vector< std::string > args;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--lz4") compress = true;
+		else args.emplace_back(arg);
+	}
+	if (args.size() < 3) {
+		std::cerr << "Usage:\n\t" << argv[0] << " [--lz4] <directory> <out.pack> <file> [file ...]\n"
+			"Packs the files (named relative to 'directory') into 'out.pack'.\n"
+			"With --lz4, files are compressed when that saves at least an eighth of their size." << std::endl;
+		return 1;
+	}
+	std::string directory = args[0];
+	if (directory.empty() || directory.back() != '/') directory += '/';
+	std::string out_filename = args[1];
+
+	std::vector< std::pair< std::string, std::vector< uint8_t > > > files;
+	uint64_t total = 0;
+	for (size_t i = 2; i < args.size(); ++i) {
+		std::ifstream file(directory + args[i], std::ios::binary);
+		if (!file) {
+			std::cerr << "ERROR: can't read '" << directory + args[i] << "'." << std::endl;
+			return 1;
+		}
+		files.emplace_back(args[i], std::vector< uint8_t >(std::istreambuf_iterator< char >(file), std::istreambuf_iterator< char >()));
+		total += files.back().second.size();
+	}
+
+	Pack::write(out_filename, files, compress);
+
+	Pack pack(out_filename);
+	std::cout << "Wrote '" << out_filename << "': " << pack.entry_count << " files, " << total << " bytes -> " << pack.file->size << " bytes." << std::endl;
+	for (uint32_t i = 0; i < pack.entry_count; ++i) {
+		Pack::Entry const &entry = pack.entries[i];
+		std::cout << "  " << pack.name(entry) << ": " << entry.size << " bytes";
+		if (entry.compression == Pack::LZ4) std::cout << " (lz4: " << entry.stored_size << " bytes)";
+		std::cout << std::endl;
+	}
+	return 0;
+}
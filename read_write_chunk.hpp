@@ -2,14 +2,20 @@
 
 #include <iostream>
 #include <vector>
+#include <string>
+#include <memory>
 #include <stdexcept>
+#include <type_traits>
 #include <cassert>
+#include <cstdint>
+#include <cstring>
 
 //helper function that reads an array of structures preceded by a simple header:
 //Expected format:
 // |ma|gi|c.|..| <-- four byte "magic number"
 // |sz|sz|sz|sz| <-- four byte (native endian) size
 // |TT...TT| * (sz/sizeof(TT)) <-- enough T structures to make up sz bytes
+//(this is version 1 of the chunk format; see ChunkFile.hpp for version 2, and for reading either)
 
 template< typename T >
 void read_chunk(std::istream &from, std::string const &magic, std::vector< T > *to_) {
@@ -40,6 +46,19 @@ void read_chunk(std::istream &from, std::string const &magic, std::vector< T > *
 	}
 }
 
+//helper function that returns the magic number of the next chunk without reading it:
+// (returns "" if there is no next chunk; useful for reading optional chunks)
+inline std::string peek_chunk_magic(std::istream &from) {
+	std::string magic = "";
+	auto pos = from.tellg();
+	char buffer[4];
+	if (from.read(buffer, 4)) {
+		magic = std::string(buffer, 4);
+	}
+	from.clear();
+	from.seekg(pos);
+	return magic;
+}
 
 //helper function to write a chunk of data in the same format as read_chunk:
 template< typename T >
@@ -63,3 +82,115 @@ void write_chunk(std::string const &magic, std::vector< T > const &from, std::os
 	to.write(reinterpret_cast< const char * >(&header), sizeof(header));
 	to.write(reinterpret_cast< const char * >(from.data()), from.size() * sizeof(T));
 }
+
+//------------------------------------------------
+//Zero-copy reading of the same format from memory (e.g., a MappedFile or a vfs_read() DataFile):
+//
+// std::shared_ptr< DataFile const > data = vfs_read(filename);
+// ChunkReader file(data->data, data->size, data);
+// ChunkView< glm::vec3 > positions;
+// read_chunk(file, "p...", &positions); //positions[i] points into 'data'
+//
+//Chunks hold no padding, so a chunk's contents might not be aligned for T;
+// such chunks are copied into aligned storage (and counted in ChunkReader::copied_bytes).
+// (version 2 chunk files are aligned; see ChunkFile.hpp)
+
+//Read-only view of a chunk's elements (like a std::span< T const >):
+template< typename T >
+struct ChunkView {
+	static_assert(std::is_trivially_copyable< T >::value, "chunk elements are read as raw bytes");
+
+	T const *data() const { return elements; }
+	size_t size() const { return count; }
+	size_t size_bytes() const { return count * sizeof(T); }
+	bool empty() const { return count == 0; }
+
+	T const *begin() const { return elements; }
+	T const *end() const { return elements + count; }
+	T const &operator[](size_t i) const {
+		assert(i < count);
+		return elements[i];
+	}
+
+	T const *elements = nullptr;
+	size_t count = 0;
+	std::shared_ptr< void const > storage; //keeps 'elements' valid (the ChunkReader's storage, or a copy)
+};
+
+//Reads chunks, in order, from a region of memory:
+struct ChunkReader {
+	//'storage' (if given) keeps [data, data+size) valid and is shared with the views read from it:
+	ChunkReader(uint8_t const *data_, size_t size_, std::shared_ptr< void const > storage_ = nullptr)
+		: data(data_), size(size_), storage(storage_) { }
+
+	bool at_end() const { return offset == size; }
+
+	uint8_t const *data = nullptr;
+	size_t size = 0;
+	std::shared_ptr< void const > storage;
+
+	size_t offset = 0; //start of the next chunk
+	size_t copied_bytes = 0; //bytes copied because chunk contents weren't aligned for their element type
+};
+
+//helper that views 'size' bytes at 'begin' as an array of T (size must be a multiple of sizeof(T)):
+// returns false if they weren't aligned for T, so had to be copied
+template< typename T >
+bool view_chunk(uint8_t const *begin, size_t size, std::shared_ptr< void const > const &storage, ChunkView< T > *to_) {
+	assert(to_);
+	auto &to = *to_;
+	assert(size % sizeof(T) == 0);
+
+	to.count = size / sizeof(T);
+	if (reinterpret_cast< uintptr_t >(begin) % alignof(T) == 0) {
+		to.elements = reinterpret_cast< T const * >(begin);
+		to.storage = storage;
+		return true;
+	} else {
+		auto copy = std::make_shared< std::vector< T > >(to.count);
+		if (size) std::memcpy(copy->data(), begin, size);
+		to.elements = copy->data();
+		to.storage = copy;
+		return false;
+	}
+}
+
+template< typename T >
+void read_chunk(ChunkReader &from, std::string const &magic, ChunkView< T > *to_) {
+	assert(to_);
+	auto &to = *to_;
+
+	struct ChunkHeader {
+		char magic[4] = {'\0', '\0', '\0', '\0'};
+		uint32_t size = 0;
+	};
+	static_assert(sizeof(ChunkHeader) == 8, "header is packed");
+
+	if (from.size - from.offset < sizeof(ChunkHeader)) {
+		throw std::runtime_error("Failed to read chunk header");
+	}
+	ChunkHeader header;
+	std::memcpy(&header, from.data + from.offset, sizeof(header));
+	if (std::string(header.magic,4) != magic) {
+		throw std::runtime_error("Unexpected magic number in chunk");
+	}
+
+	if (header.size % sizeof(T) != 0) {
+		throw std::runtime_error("Size of chunk not divisible by element size");
+	}
+	if (header.size > from.size - from.offset - sizeof(ChunkHeader)) {
+		throw std::runtime_error("Failed to read chunk data.");
+	}
+
+	uint8_t const *begin = from.data + from.offset + sizeof(ChunkHeader);
+	from.offset += sizeof(ChunkHeader) + header.size;
+
+	if (!view_chunk(begin, header.size, from.storage, &to)) {
+		from.copied_bytes += header.size;
+	}
+}
+
+inline std::string peek_chunk_magic(ChunkReader const &from) {
+	if (from.size - from.offset < 4) return "";
+	return std::string(reinterpret_cast< char const * >(from.data + from.offset), 4);
+}
@@ -0,0 +1,406 @@
+#include "resample.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <numeric>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define RESAMPLE_USE_SSE
+#endif
+
+namespace {
+	constexpr double Pi = 3.14159265358979323846;
+
+	//Kaiser window shape parameter (~90dB stopband attenuation):
+	constexpr double KaiserBeta = 9.0;
+
+	//zeroth-order modified Bessel function of the first kind (used by the Kaiser window):
+	double bessel_i0(double x) {
+		double sum = 1.0;
+		double term = 1.0;
+		for (uint32_t k = 1; k < 100; ++k) {
+			term *= (x / (2.0 * k)) * (x / (2.0 * k));
+			sum += term;
+			if (term < sum * 1e-17) break;
+		}
+		return sum;
+	}
+
+	//fill 'taps' (2 * half values) with a windowed-sinc filter for reading 'fraction' of the way past a sample:
+	// - tap k multiplies the sample at (read position index) - (half - 1) + k
+	// - 'cutoff' is relative to the input's Nyquist frequency
+	void make_taps(double fraction, uint32_t half, double cutoff, float *taps) {
+		double const window_scale = 1.0 / bessel_i0(KaiserBeta);
+		double sum = 0.0;
+		std::vector< double > values(2 * half);
+		for (uint32_t k = 0; k < 2 * half; ++k) {
+			double t = double(k) - double(half - 1) - fraction; //distance (in samples) from read position
+			double x = t / double(half);
+			double window = (std::abs(x) < 1.0 ? bessel_i0(KaiserBeta * std::sqrt(1.0 - x * x)) * window_scale : 0.0);
+			double sinc = (t == 0.0 ? 1.0 : std::sin(Pi * cutoff * t) / (Pi * cutoff * t));
+			values[k] = cutoff * sinc * window;
+			sum += values[k];
+		}
+		//normalize so that constant signals pass through unchanged:
+		for (uint32_t k = 0; k < 2 * half; ++k) {
+			taps[k] = float(values[k] / sum);
+		}
+	}
+
+	//dot product of 'count' (a multiple of four) values:
+	inline float dot(float const *a, float const *b, uint32_t count) {
+		assert(count % 4 == 0);
+#ifdef RESAMPLE_USE_SSE
+		__m128 acc = _mm_setzero_ps();
+		for (uint32_t i = 0; i < count; i += 4) {
+			acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+		}
+		acc = _mm_add_ps(acc, _mm_shuffle_ps(acc, acc, _MM_SHUFFLE(1,0,3,2)));
+		acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, _MM_SHUFFLE(2,3,0,1)));
+		return _mm_cvtss_f32(acc);
+#else
+		float acc[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+		for (uint32_t i = 0; i < count; i += 4) {
+			for (uint32_t j = 0; j < 4; ++j) {
+				acc[j] += a[i+j] * b[i+j];
+			}
+		}
+		return (acc[0] + acc[2]) + (acc[1] + acc[3]);
+#endif
+	}
+
+	//---- load-time conversion ----
+
+	//at most this many polyphase filters are built; rate pairs that would need more have their read positions rounded:
+	// (common rates like 44100 -> 48000 need only 160)
+	constexpr uint32_t MaxPhases = 4096;
+
+	//filter half-width (in input samples) when not downsampling:
+	constexpr uint32_t ConvertHalf = 24;
+
+	//fraction of the (lower) Nyquist frequency kept by the filter:
+	constexpr double ConvertPassband = 0.95;
+
+	//---- per-voice rate changes ----
+
+	//filter half-width and number of tabulated read positions (which are linearly interpolated between):
+	constexpr uint32_t RunHalf = 8;
+	constexpr uint32_t RunTaps = 2 * RunHalf;
+	constexpr uint32_t RunPhases = 256;
+	constexpr double RunPassband = 0.9;
+
+	//built during static initialization, so the mixer never has to:
+	struct RunTable {
+		float taps[(RunPhases + 1) * RunTaps];
+		RunTable() {
+			for (uint32_t p = 0; p <= RunPhases; ++p) {
+				make_taps(double(p) / double(RunPhases), RunHalf, RunPassband, taps + p * RunTaps);
+			}
+		}
+	} const run_table;
+}
+
+void resample(std::vector< float > const &in, uint32_t in_rate, uint32_t out_rate, std::vector< float > *out_) {
+	assert(out_);
+	assert(in_rate > 0 && out_rate > 0);
+	auto &out = *out_;
+
+	if (in_rate == out_rate || in.empty()) {
+		out = in;
+		return;
+	}
+
+	//each output sample is read from input position n * in_rate / out_rate; in units of 1/phases of an input sample,
+	// this is exact if phases = out_rate / gcd (since in_rate * phases / out_rate is then a whole number):
+	uint32_t phases = out_rate / std::gcd(in_rate, out_rate);
+	phases = std::min(phases, MaxPhases);
+
+	//when downsampling, lower the cutoff (and widen the filter to match):
+	double scale = std::min(1.0, double(out_rate) / double(in_rate));
+	uint32_t half = uint32_t(std::ceil(ConvertHalf / scale));
+	half = (half + 1) / 2 * 2; //(keeps the tap count a multiple of four)
+	uint32_t taps = 2 * half;
+
+	std::vector< float > bank(size_t(phases) * taps);
+	for (uint32_t p = 0; p < phases; ++p) {
+		make_taps(double(p) / double(phases), half, ConvertPassband * scale, &bank[size_t(p) * taps]);
+	}
+
+	//input with zeros before and after, so that every read has a full window:
+	std::vector< float > padded(size_t(half - 1) + in.size() + size_t(half) + 1, 0.0f);
+	std::copy(in.begin(), in.end(), padded.begin() + (half - 1));
+
+	out.resize(size_t((uint64_t(in.size()) * out_rate + in_rate - 1) / in_rate));
+
+	//read position is 'whole' / phases + 'remainder' / (phases * out_rate) input samples:
+	uint64_t const step = uint64_t(in_rate) * phases;
+	uint64_t whole = 0;
+	uint64_t remainder = 0;
+	for (size_t n = 0; n < out.size(); ++n) {
+		uint64_t index = whole / phases;
+		uint32_t phase = uint32_t(whole % phases);
+		assert(index + taps <= padded.size());
+		out[n] = dot(&padded[size_t(index)], &bank[size_t(phase) * taps], taps);
+
+		remainder += step;
+		whole += remainder / out_rate;
+		remainder %= out_rate;
+	}
+}
+
+namespace {
+	//data[at], for any 'at' (wrapped around if looping, otherwise zero outside the data):
+	inline float fetch(float const *data, uint32_t size, bool loop, int64_t at) {
+		if (at >= 0 && at < int64_t(size)) return data[at];
+		if (!loop) return 0.0f;
+		at %= int64_t(size);
+		if (at < 0) at += size;
+		return data[at];
+	}
+
+#ifdef RESAMPLE_USE_SSE
+	//linear4() and cubic4() on values already in registers:
+	inline __m128 linear4(__m128 B, __m128 C, __m128 T) {
+		return _mm_add_ps(B, _mm_mul_ps(T, _mm_sub_ps(C, B)));
+	}
+
+	inline __m128 cubic4(__m128 A, __m128 B, __m128 C, __m128 D, __m128 T) {
+		//b + 0.5 t (c - a + t (2a - 5b + 4c - d + t (3(b - c) + d - a))):
+		__m128 t3 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(3.0f), _mm_sub_ps(B, C)), _mm_sub_ps(D, A));
+		__m128 t2 = _mm_sub_ps(_mm_add_ps(_mm_add_ps(A, A), _mm_mul_ps(_mm_set1_ps(4.0f), C)), _mm_add_ps(_mm_mul_ps(_mm_set1_ps(5.0f), B), D));
+		__m128 t1 = _mm_sub_ps(C, A);
+		__m128 sum = _mm_add_ps(t1, _mm_mul_ps(T, _mm_add_ps(t2, _mm_mul_ps(T, t3))));
+		return _mm_add_ps(B, _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), T), sum));
+	}
+#endif
+
+	//interpolate four output values at once, given the samples around each read position ('b' and 'c' on either side)
+	// and the read positions' fractional parts 't':
+	inline void linear4(float const *b, float const *c, float const *t, float *out) {
+#ifdef RESAMPLE_USE_SSE
+		_mm_storeu_ps(out, linear4(_mm_loadu_ps(b), _mm_loadu_ps(c), _mm_loadu_ps(t)));
+#else
+		for (uint32_t k = 0; k < 4; ++k) {
+			out[k] = b[k] + t[k] * (c[k] - b[k]);
+		}
+#endif
+	}
+
+	//(Catmull-Rom spline through a, b, c, d)
+	inline void cubic4(float const *a, float const *b, float const *c, float const *d, float const *t, float *out) {
+#ifdef RESAMPLE_USE_SSE
+		_mm_storeu_ps(out, cubic4(_mm_loadu_ps(a), _mm_loadu_ps(b), _mm_loadu_ps(c), _mm_loadu_ps(d), _mm_loadu_ps(t)));
+#else
+		for (uint32_t k = 0; k < 4; ++k) {
+			float t3 = 3.0f * (b[k] - c[k]) + d[k] - a[k];
+			float t2 = 2.0f * a[k] - 5.0f * b[k] + 4.0f * c[k] - d[k];
+			float t1 = c[k] - a[k];
+			out[k] = b[k] + 0.5f * t[k] * (t1 + t[k] * (t2 + t[k] * t3));
+		}
+#endif
+	}
+}
+
+namespace {
+	//resample_run()'s output loop, compiled separately for each kind of interpolation:
+	template< Interpolation interpolation >
+	void interpolate_run(float const *data, uint32_t size, bool loop, uint32_t index, float fraction, float step, float step_change, uint32_t count, float *out) {
+	//read positions are tracked four at a time (one per lane), relative to the sample at 'at';
+	// 'at' is moved forward as they advance, so they stay small enough for float to be precise over a run:
+	// (lane k starts k * step + k (k-1) / 2 * step_change past the first read position,
+	//  and value n + k moves 4 * (step + n * step_change) + (4k + 6) * step_change to value n + k + 4's position)
+	int64_t at = index;
+	float position[4];
+	for (uint32_t k = 0; k < 4; ++k) {
+		position[k] = fraction + float(k) * step + float(k * (k - 1) / 2) * step_change;
+	}
+#ifdef RESAMPLE_USE_SSE
+	__m128 P = _mm_loadu_ps(position);
+	__m128 const lane_advance = _mm_mul_ps(_mm_setr_ps(6.0f, 10.0f, 14.0f, 18.0f), _mm_set1_ps(step_change));
+#endif
+
+	float window[RunTaps]; //(for windowed-sinc reads near the ends of the data)
+
+	uint32_t n = 0;
+#ifdef RESAMPLE_USE_SSE
+	//when every read of the run stays inside the data (the usual case), linear and cubic reads need no bounds checks
+	// or wrapping, and their samples can go straight from the data to registers:
+	// (read positions never decrease, so the run's last position bounds them all)
+	double const last = double(index) + double(fraction) + double(count) * double(step) + 0.5 * double(count) * double(count) * std::max(0.0, double(step_change));
+	if (interpolation != Interpolation::Sinc && index >= 1 && last + 4.0 < double(size)) {
+		//each group's positions depend on the last group's, which makes the loop above wait on float conversions;
+		// so this loop reads two groups at once, each with its own positions, which advance past eight values at a time:
+		// (value n + 8 is read 8 * (step + n * step_change) + 28 * step_change positions after value n)
+		__m128 const pair_advance = _mm_mul_ps(_mm_setr_ps(28.0f, 36.0f, 44.0f, 52.0f), _mm_set1_ps(step_change));
+		__m128 P2 = _mm_add_ps(P, _mm_add_ps(_mm_set1_ps(4.0f * step), lane_advance));
+		auto read_group = [&](float const *src, int32_t const *offset, __m128 T, float *to) {
+			//load the four samples around each read position, and transpose so each register holds one of a, b, c, d:
+			__m128 r0 = _mm_loadu_ps(src + offset[0] - 1);
+			__m128 r1 = _mm_loadu_ps(src + offset[1] - 1);
+			__m128 r2 = _mm_loadu_ps(src + offset[2] - 1);
+			__m128 r3 = _mm_loadu_ps(src + offset[3] - 1);
+			_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+			if (interpolation == Interpolation::Cubic) _mm_storeu_ps(to, cubic4(r0, r1, r2, r3, T));
+			else _mm_storeu_ps(to, linear4(r1, r2, T));
+		};
+		for (; n + 8 <= count; n += 8) {
+			__m128i O = _mm_cvttps_epi32(P);
+			__m128i O2 = _mm_cvttps_epi32(P2);
+			int32_t offset[8];
+			_mm_storeu_si128(reinterpret_cast< __m128i * >(offset), O);
+			_mm_storeu_si128(reinterpret_cast< __m128i * >(offset + 4), O2);
+			__m128 T = _mm_sub_ps(P, _mm_cvtepi32_ps(O));
+			__m128 T2 = _mm_sub_ps(P2, _mm_cvtepi32_ps(O2));
+
+			//(both groups' positions stay relative to the first group's first sample)
+			__m128 whole = _mm_cvtepi32_ps(_mm_shuffle_epi32(O, _MM_SHUFFLE(0,0,0,0)));
+			__m128 A = _mm_add_ps(_mm_set1_ps(8.0f * (step + float(n) * step_change)), pair_advance);
+			P = _mm_sub_ps(_mm_add_ps(P, A), whole);
+			P2 = _mm_sub_ps(_mm_add_ps(P2, _mm_add_ps(A, _mm_set1_ps(32.0f * step_change))), whole);
+
+			float const *src = data + at;
+			at += offset[0];
+			read_group(src, offset, T, out + n);
+			read_group(src, offset + 4, T2, out + n + 4);
+		}
+		//(any remaining values are read by the loop below, from P)
+	}
+#endif
+
+	for (; n < count; n += 4) {
+		uint32_t lanes = std::min(4U, count - n);
+
+		//split read positions into sample offsets and fractions, and advance them:
+		// (positions may be very slightly negative, but only by rounding)
+		int32_t offset[4];
+		float t[4];
+#ifdef RESAMPLE_USE_SSE
+		__m128i O = _mm_cvttps_epi32(P);
+		_mm_storeu_si128(reinterpret_cast< __m128i * >(offset), O);
+		_mm_storeu_ps(t, _mm_sub_ps(P, _mm_cvtepi32_ps(O)));
+		__m128 A = _mm_add_ps(_mm_set1_ps(4.0f * (step + float(n) * step_change)), lane_advance);
+		P = _mm_sub_ps(_mm_add_ps(P, A), _mm_set1_ps(float(offset[0])));
+#else
+		for (uint32_t k = 0; k < 4; ++k) {
+			offset[k] = int32_t(position[k]);
+			t[k] = position[k] - float(offset[k]);
+		}
+		for (uint32_t k = 0; k < 4; ++k) {
+			position[k] += 4.0f * (step + float(n) * step_change) + float(4 * k + 6) * step_change - float(offset[0]);
+		}
+#endif
+		int64_t const group = at;
+		at += offset[0];
+		if (loop && at >= int64_t(size)) at %= size;
+
+		//(values are written straight to 'out' unless this is a partial group at the end)
+		float tail[4];
+		float *values = (lanes == 4 ? out + n : tail);
+		if (interpolation == Interpolation::Sinc) {
+			for (uint32_t k = 0; k < lanes; ++k) {
+				int64_t i = group + offset[k];
+
+				//find the RunTaps values around the read position:
+				float const *taps_in;
+				if (i >= int64_t(RunHalf - 1) && i + RunHalf < int64_t(size)) {
+					taps_in = data + (i - (RunHalf - 1));
+				} else {
+					for (uint32_t j = 0; j < RunTaps; ++j) {
+						window[j] = fetch(data, size, loop, i - int64_t(RunHalf - 1) + int64_t(j));
+					}
+					taps_in = window;
+				}
+
+				//filter with the two nearest tabulated phases, and interpolate:
+				float phase = t[k] * float(RunPhases);
+				uint32_t row = std::min(uint32_t(std::max(phase, 0.0f)), RunPhases - 1);
+				float amt = phase - float(row);
+				float const *taps = run_table.taps + row * RunTaps;
+				float a = dot(taps_in, taps, RunTaps);
+				float b = dot(taps_in, taps + RunTaps, RunTaps);
+				values[k] = a + amt * (b - a);
+			}
+		} else {
+			//gather the samples around each read position (one at a time), then interpolate (vectorized):
+			float a[4], b[4], c[4], d[4];
+			if (group >= 1 && group + offset[3] + 2 < int64_t(size)) {
+				//whole group is within the data:
+				float const *src = data + group;
+#ifdef RESAMPLE_USE_SSE
+				//load the four samples around each read position, and transpose so each register holds one of a, b, c, d:
+				__m128 r0 = _mm_loadu_ps(src + offset[0] - 1);
+				__m128 r1 = _mm_loadu_ps(src + offset[1] - 1);
+				__m128 r2 = _mm_loadu_ps(src + offset[2] - 1);
+				__m128 r3 = _mm_loadu_ps(src + offset[3] - 1);
+				_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+				_mm_storeu_ps(a, r0);
+				_mm_storeu_ps(b, r1);
+				_mm_storeu_ps(c, r2);
+				_mm_storeu_ps(d, r3);
+#else
+				for (uint32_t k = 0; k < 4; ++k) {
+					a[k] = src[offset[k] - 1];
+					b[k] = src[offset[k]];
+					c[k] = src[offset[k] + 1];
+					d[k] = src[offset[k] + 2];
+				}
+#endif
+			} else {
+				for (uint32_t k = 0; k < 4; ++k) {
+					int64_t i = group + offset[k];
+					a[k] = fetch(data, size, loop, i - 1);
+					b[k] = fetch(data, size, loop, i);
+					c[k] = fetch(data, size, loop, i + 1);
+					d[k] = fetch(data, size, loop, i + 2);
+				}
+			}
+			if (interpolation == Interpolation::Cubic) cubic4(a, b, c, d, t, values);
+			else linear4(b, c, t, values);
+		}
+
+		if (values == tail) {
+			for (uint32_t k = 0; k < lanes; ++k) {
+				out[n + k] = values[k];
+			}
+		}
+	}
+	}
+}
+
+void resample_run(Interpolation interpolation, float const *data, uint32_t size, bool loop, uint32_t *index_, float *fraction_, float step, float step_change, uint32_t count, float *out) {
+	assert(index_ && fraction_ && out);
+	assert(step >= 0.0f && step + float(count) * step_change >= -1e-3f);
+	assert(size > 0);
+
+	if (interpolation == Interpolation::Linear) {
+		interpolate_run< Interpolation::Linear >(data, size, loop, *index_, *fraction_, step, step_change, count, out);
+	} else if (interpolation == Interpolation::Cubic) {
+		interpolate_run< Interpolation::Cubic >(data, size, loop, *index_, *fraction_, step, step_change, count, out);
+	} else {
+		interpolate_run< Interpolation::Sinc >(data, size, loop, *index_, *fraction_, step, step_change, count, out);
+	}
+
+	//store the position after the last value, computed exactly (so that runs don't drift):
+	resample_skip(size, loop, index_, fraction_, step, step_change, count);
+}
+
+void resample_skip(uint32_t size, bool loop, uint32_t *index_, float *fraction_, float step, float step_change, uint32_t count) {
+	assert(index_ && fraction_);
+	assert(size > 0);
+
+	double dc = double(count);
+	double end = double(*fraction_) + dc * double(step) + (dc * (dc - 1.0) * 0.5) * double(step_change);
+	int64_t whole = int64_t(end); //(std::floor is a library call on many targets)
+	if (double(whole) > end) whole -= 1;
+	float fraction = float(end - double(whole));
+	if (fraction >= 1.0f) { //(can round up to one)
+		fraction = 0.0f;
+		whole += 1;
+	}
+	int64_t index = int64_t(*index_) + std::max< int64_t >(whole, 0);
+	if (loop) index %= size;
+	*index_ = uint32_t(std::min< int64_t >(index, size));
+	*fraction_ = fraction;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+/*
+ * Resampling of mono audio:
+ *  - resample() converts whole buffers between sampling rates, using a
+ *    polyphase windowed-sinc (Kaiser window) filter bank (used when
+ *    loading non-48kHz sounds);
+ *  - resample_run() reads a buffer at an arbitrary (and changing) rate
+ *    from a fractional position, by linear, cubic, or windowed-sinc
+ *    interpolation (used by the mixer for per-voice playback rates).
+ *
+ */
+
+#include <cstdint>
+#include <vector>
+
+//convert 'in' (sampled at 'in_rate' Hz) to 'out_rate' Hz:
+// (when downsampling, frequencies above the new Nyquist limit are filtered out)
+void resample(std::vector< float > const &in, uint32_t in_rate, uint32_t out_rate, std::vector< float > *out);
+
+//how resample_run() computes values between samples, from cheapest to best:
+enum class Interpolation : uint8_t {
+	Linear, //2 samples; fine for noisy sounds, but dulls highs and adds audible aliasing to tones
+	Cubic, //4 samples (Catmull-Rom spline); good for most sound effects
+	Sinc, //16 samples (windowed sinc); for music and other sounds played near their original rate
+};
+
+//write 'count' values to 'out', read from 'data' (of 'size' values) starting at position *index + *fraction;
+// value n+1 is read 'step' + n * 'step_change' positions after value n (so the rate can ramp smoothly).
+// *index and *fraction are updated to the position of value 'count'.
+// positions outside [0,size) read as zero -- or, if 'loop' is set, wrap around (and *index is wrapped, too).
+// note: filters with a fixed cutoff, so 'step' values much larger than one will alias
+void resample_run(Interpolation interpolation, float const *data, uint32_t size, bool loop, uint32_t *index, float *fraction, float step, float step_change, uint32_t count, float *out);
+
+//advance *index and *fraction exactly as resample_run() would, without reading or writing any values:
+// (non-looping positions stop at 'size')
+void resample_skip(uint32_t size, bool loop, uint32_t *index, float *fraction, float step, float step_change, uint32_t count);
@@ -3,6 +3,8 @@
 #include "Load.hpp"
 #include "GL.hpp"
 #include "load_save_png.hpp"
+#include "vfs.hpp"
+#include "data_path.hpp"
 
 #include <SDL.h>
 
@@ -18,6 +20,10 @@ int main(int argc, char **argv) {
 	try {
 #endif
 
+	//(for reporting time-to-first-frame, below)
+	auto startup_time = std::chrono::high_resolution_clock::now();
+	bool shown_first_frame = false;
+
 	//------------  initialization ------------
 
 	//Initialize SDL library:
@@ -76,6 +82,9 @@ int main(int argc, char **argv) {
 	}
 
 	//------------ load resources --------------
+	if (vfs_mount(data_path("assets.pack"))) {
+		std::cout << "Reading assets from '" << data_path("assets.pack") << "'." << std::endl;
+	}
 	call_load_functions();
 
 	//------------ create game mode + make current --------------
@@ -176,6 +185,11 @@ int main(int argc, char **argv) {
 
 		//Wait until the recently-drawn frame is shown before doing it all again:
 		SDL_GL_SwapWindow(window);
+
+		if (!shown_first_frame) {
+			shown_first_frame = true;
+			std::cout << "First frame after " << std::chrono::duration< double, std::milli >(std::chrono::high_resolution_clock::now() - startup_time).count() << " ms." << std::endl;
+		}
 	}
 
 
@@ -0,0 +1,57 @@
+/*
+ * upgrade-chunks rewrites a chunk-based file (e.g., a '.pnct', '.scene', or
+ *  '.w' file from the exporters in 'scenes/') as a version 2 chunk file with a
+ *  table of contents, aligned chunks, and checksums (see ChunkFile.hpp).
+ *
+ * Every chunk is kept as-is and in the same order, so loaders read the result
+ *  exactly as they read the original (just faster, and with corruption caught).
+ *
+ */
+
+#include "ChunkFile.hpp"
+#include "MappedFile.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <string>
+
+int main(int argc, char **argv) {
+	if (argc != 3) {
+		std::cerr << "Usage:\n\t" << argv[0] << " <in> <out>\n(in and out may be the same file)" << std::endl;
+		return 1;
+	}
+	std::string in_filename = argv[1];
+	std::string out_filename = argv[2];
+
+	ChunkFileWriter out;
+	uint32_t in_version = 0;
+	size_t in_size = 0;
+	{ //(copied out, since 'in' and 'out' may be the same file)
+		MappedFile mapped(in_filename);
+		ChunkFile file(mapped.data, mapped.size);
+		file.validate();
+		if (file.trailing != 0) {
+			std::cerr << "ERROR: '" << in_filename << "' has " << file.trailing << " bytes of trailing data (is it a chunk file?)." << std::endl;
+			return 1;
+		}
+		for (auto const &chunk : file.chunks) {
+			out.add(chunk.magic, mapped.data + chunk.offset, chunk.size, chunk.version);
+		}
+		in_version = file.version;
+		in_size = mapped.size;
+	}
+
+	std::ofstream file(out_filename, std::ios::binary);
+	out.write(&file);
+	if (!file) {
+		std::cerr << "ERROR: failed to write '" << out_filename << "'." << std::endl;
+		return 1;
+	}
+	std::cout << "Wrote '" << out_filename << "': " << out.chunks.size() << " chunks (";
+	for (auto const &chunk : out.chunks) {
+		std::cout << (&chunk == &out.chunks[0] ? "" : ", ") << chunk.magic;
+	}
+	std::cout << "), version " << in_version << " -> " << ChunkFile::Version << ", " << in_size << " -> " << size_t(file.tellp()) << " bytes." << std::endl;
+
+	return 0;
+}
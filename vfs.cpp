@@ -0,0 +1,122 @@
+#include "vfs.hpp"
+#include "Pack.hpp"
+#include "MappedFile.hpp"
+#include "data_path.hpp"
+
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <streambuf>
+#include <vector>
+
+namespace {
+	struct Mount {
+		std::string directory;
+		std::shared_ptr< Pack const > pack;
+	};
+
+	std::mutex mutex; //protects 'mounts' (files are read from many threads while loading)
+	std::vector< Mount > mounts; //in the order they were mounted
+
+	//find the pack entry for 'path' (pack is nullptr if no mounted pack holds it):
+	std::pair< std::shared_ptr< Pack const >, Pack::Entry const * > find_packed(std::string const &path) {
+		std::lock_guard< std::mutex > lock(mutex);
+		for (auto m = mounts.rbegin(); m != mounts.rend(); ++m) {
+			if (path.compare(0, m->directory.size(), m->directory) != 0) continue;
+			Pack::Entry const *entry = m->pack->find(std::string_view(path).substr(m->directory.size()));
+			if (entry) return std::make_pair(m->pack, entry);
+		}
+		return std::make_pair(nullptr, nullptr);
+	}
+
+	//read-only, seekable stream buffer over a DataFile:
+	struct DataFileBuf : std::streambuf {
+		DataFileBuf(std::shared_ptr< DataFile const > const &file_) : file(file_) {
+			char *begin = const_cast< char * >(reinterpret_cast< char const * >(file->data)); //(never written through)
+			setg(begin, begin, begin + file->size);
+		}
+		pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override {
+			if (!(which & std::ios_base::in)) return pos_type(off_type(-1));
+			off_type base = (dir == std::ios_base::beg ? 0 : dir == std::ios_base::cur ? off_type(gptr() - eback()) : off_type(egptr() - eback()));
+			off_type to = base + off;
+			if (to < 0 || to > off_type(egptr() - eback())) return pos_type(off_type(-1));
+			setg(eback(), eback() + to, egptr());
+			return pos_type(to);
+		}
+		pos_type seekpos(pos_type pos, std::ios_base::openmode which) override {
+			return seekoff(off_type(pos), std::ios_base::beg, which);
+		}
+		std::shared_ptr< DataFile const > file;
+	};
+
+	struct DataFileStream : std::istream {
+		DataFileStream(std::shared_ptr< DataFile const > const &file) : std::istream(nullptr), buf(file) {
+			rdbuf(&buf);
+		}
+		DataFileBuf buf;
+	};
+}
+
+bool vfs_mount(std::string const &filename) {
+	return vfs_mount(filename, data_path(""));
+}
+
+bool vfs_mount(std::string const &filename, std::string const &directory) {
+	{ //(a missing pack isn't an error -- e.g., when running from a build with loose files)
+		std::ifstream exists(filename, std::ios::binary);
+		if (!exists) return false;
+	}
+	auto pack = std::make_shared< Pack const >(filename);
+	std::lock_guard< std::mutex > lock(mutex);
+	mounts.emplace_back(Mount{directory, pack});
+	return true;
+}
+
+void vfs_unmount_all() {
+	std::lock_guard< std::mutex > lock(mutex);
+	mounts.clear();
+}
+
+bool vfs_exists(std::string const &path) {
+	if (find_packed(path).first) return true;
+	std::ifstream file(path, std::ios::binary);
+	return bool(file);
+}
+
+std::shared_ptr< DataFile const > vfs_read(std::string const &path) {
+	auto ret = std::make_shared< DataFile >();
+	auto packed = find_packed(path);
+	if (packed.first) {
+		Pack const &pack = *packed.first;
+		Pack::Entry const &entry = *packed.second;
+		if (entry.compression == Pack::Stored) {
+			//use the mapped pack in place:
+			ret->data = pack.stored(entry);
+			ret->storage = pack.file;
+		} else {
+			auto buffer = std::make_shared< std::vector< uint8_t > >(size_t(entry.size));
+			try {
+				pack.extract(entry, buffer->data());
+			} catch (std::exception &e) {
+				throw std::runtime_error("Failed to read '" + path + "' from pack '" + pack.filename + "': " + e.what());
+			}
+			ret->data = buffer->data();
+			ret->storage = buffer;
+		}
+		ret->size = size_t(entry.size);
+	} else {
+		auto file = std::make_shared< MappedFile const >(path);
+		ret->data = file->data;
+		ret->size = file->size;
+		ret->storage = file;
+	}
+	return ret;
+}
+
+std::unique_ptr< std::istream > vfs_open(std::string const &path) {
+	if (find_packed(path).first) {
+		return std::make_unique< DataFileStream >(vfs_read(path));
+	} else {
+		return std::make_unique< std::ifstream >(path, std::ios::binary);
+	}
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+/*
+ * The virtual filesystem reads data files from mounted Packs (see Pack.hpp)
+ *  when they hold them, and from disk otherwise. Loaders open files through
+ *  it using the same paths as before (e.g., data_path("level.scene")):
+ *
+ * vfs_mount(data_path("assets.pack")); //once, at startup
+ * ...
+ * std::unique_ptr< std::istream > file = vfs_open(data_path("level.scene"));
+ *
+ * A pack mounted at a directory (by default, data_path("")) provides the files
+ *  under that directory; packs mounted later are checked first, and loose files last.
+ *
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <string>
+
+//Mount the pack 'filename' so it provides files in 'directory' (which should end in '/'):
+// returns false (doing nothing) if there is no such file; throws if the pack is malformed.
+bool vfs_mount(std::string const &filename);
+bool vfs_mount(std::string const &filename, std::string const &directory);
+
+//Unmount all packs (data already read from them stays valid):
+void vfs_unmount_all();
+
+//Does the file exist (in a pack or on disk)?
+bool vfs_exists(std::string const &path);
+
+//A file's whole contents, held in memory:
+// (a view of a memory-mapped pack or file when possible; otherwise, decompressed)
+struct DataFile {
+	uint8_t const *data = nullptr;
+	size_t size = 0;
+	std::shared_ptr< void const > storage; //keeps 'data' valid
+};
+
+//Read a whole file; throws if it doesn't exist or can't be read:
+std::shared_ptr< DataFile const > vfs_read(std::string const &path);
+
+//Open a file as a stream:
+// (like std::ifstream(path, std::ios::binary) -- check the stream to see if this failed)
+std::unique_ptr< std::istream > vfs_open(std::string const &path);